@@ -0,0 +1,97 @@
+// Startup and inference latency of Facemesh compiled for the graph executor
+// and for the AOT executor.
+//
+// Usage: aot_bench [graph.so] [aot.so] [iterations]
+// The AOT module is exported with
+//   python scripts/convert_facemesh.py --executor aot --output-dir
+//   models/facemesh/aot
+// Load is the construction of the wrapper: loading the module, creating its
+// executor and allocating the storage. First is the first inference after
+// the load, steady the following ones.
+
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <opencv2/core.hpp>
+#include <string>
+
+#include "latency_stats.h"
+#include "spdlog/fmt/fmt.h"
+#include "tvm_facemesh.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Each load maps the library again, the previous instance is unloaded
+constexpr int nb_loads = 5;
+
+struct ExecutorStats {
+    mukham::LatencyStats load;
+    mukham::LatencyStats first;
+    mukham::LatencyStats steady;
+};
+
+bool Run(const fs::path& model_path, const cv::Mat& face, int iterations,
+         ExecutorStats& stats) {
+    tvm_facemesh::TVM_FacemeshResult result;
+    for (int load = 0; load < nb_loads; ++load) {
+        auto start = mukham::Clock::now();
+        auto facemesh = std::make_unique<tvm_facemesh::TVM_Facemesh>(
+            model_path);
+        stats.load.Add(mukham::ElapsedMs(start, mukham::Clock::now()));
+        if (!facemesh->CanExecute()) return false;
+
+        start = mukham::Clock::now();
+        facemesh->Detect(face, result);
+        stats.first.Add(mukham::ElapsedMs(start, mukham::Clock::now()));
+
+        // The steady state of the last load only
+        if (load + 1 < nb_loads) continue;
+        for (int idx = 0; idx < iterations; ++idx) {
+            start = mukham::Clock::now();
+            facemesh->Detect(face, result);
+            stats.steady.Add(mukham::ElapsedMs(start, mukham::Clock::now()));
+        }
+    }
+    return true;
+}
+
+void Print(const std::string& name, ExecutorStats& stats) {
+    fmt::print("{:<8} {:10.2f} {:10.2f} {:10.3f} {:10.3f} {:10.3f}\n", name,
+               stats.load.Percentile(50), stats.first.Percentile(50),
+               stats.steady.Mean(), stats.steady.Percentile(50),
+               stats.steady.Percentile(99));
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const auto model_dir = fs::current_path() / "models" / "facemesh";
+    fs::path graph_path =
+        argc > 1 ? fs::path(argv[1]) : model_dir / "face_landmark.so";
+    fs::path aot_path =
+        argc > 2 ? fs::path(argv[2]) : model_dir / "aot" / "face_landmark.so";
+    const int iterations = argc > 3 ? std::atoi(argv[3]) : 200;
+
+    cv::Mat face(192, 192, CV_8UC3);
+    cv::randu(face, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    ExecutorStats graph;
+    if (!Run(graph_path, face, iterations, graph)) {
+        fmt::print("Failed to load {}\n", graph_path.string());
+        return -1;
+    }
+    ExecutorStats aot;
+    if (!Run(aot_path, face, iterations, aot)) {
+        fmt::print("Failed to load {}\n", aot_path.string());
+        return -1;
+    }
+
+    fmt::print("{} loads, {} iterations, medians in ms\n", nb_loads,
+               iterations);
+    fmt::print("{:<8} {:>10} {:>10} {:>10} {:>10} {:>10}\n", "executor",
+               "load", "first", "mean", "p50", "p99");
+    Print("graph", graph);
+    Print("aot", aot);
+    return 0;
+}
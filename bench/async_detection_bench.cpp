@@ -0,0 +1,77 @@
+// Throughput of Blazeface with the synchronous DetectFace against the
+// double-buffered SubmitFrame/CompleteFrame pair.
+//
+// Usage: async_detection_bench [model.so] [frames] [buffers]
+// Every frame is a 1920x1080 noise frame that is blurred before detection,
+// standing in for the decoding and preprocessing of a video frame, which the
+// asynchronous path overlaps with the inference.
+
+#include <cstdlib>
+#include <filesystem>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <vector>
+
+#include "latency_stats.h"
+#include "spdlog/fmt/fmt.h"
+#include "tvm_blazeface.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void PrepareFrame(const cv::Mat& source, cv::Mat& frame) {
+    cv::GaussianBlur(source, frame, cv::Size(5, 5), 0);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    fs::path model_path = argc > 1 ? fs::path(argv[1])
+                                   : fs::current_path() / "models" /
+                                         "blazeface" /
+                                         "face_detection_front.so";
+    const int nb_frames = argc > 2 ? std::atoi(argv[2]) : 200;
+    const int nb_buffers = argc > 3 ? std::atoi(argv[3]) : 2;
+
+    cv::Mat source(1080, 1920, CV_8UC3);
+    cv::randu(source, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    tvm_blazeface::TVM_Blazeface detector(model_path);
+    if (!detector.CanExecute() || !detector.EnableAsync(nb_buffers)) {
+        fmt::print("Failed to load {}\n", model_path.string());
+        return -1;
+    }
+
+    std::vector<tvm_blazeface::Detection> detections;
+    cv::Mat frame;
+
+    auto start = mukham::Clock::now();
+    for (int idx = 0; idx < nb_frames; ++idx) {
+        PrepareFrame(source, frame);
+        detections = detector.DetectFace(frame);
+    }
+    const double sync_ms = mukham::ElapsedMs(start, mukham::Clock::now());
+
+    // The frame is letterboxed into its buffer by SubmitFrame, so one
+    // preparation buffer is enough
+    start = mukham::Clock::now();
+    for (int idx = 0; idx < nb_frames; ++idx) {
+        PrepareFrame(source, frame);
+        if (detector.GetFramesInFlight() == (size_t)nb_buffers)
+            detector.CompleteFrame(detections);
+        detector.SubmitFrame(frame);
+    }
+    while (detector.GetFramesInFlight() > 0) {
+        detector.CompleteFrame(detections);
+    }
+    const double async_ms = mukham::ElapsedMs(start, mukham::Clock::now());
+
+    fmt::print("{} frames of {}x{}, {} buffers\n", nb_frames, source.cols,
+               source.rows, nb_buffers);
+    fmt::print("{:<8} {:>10} {:>10}\n", "mode", "ms/frame", "FPS");
+    fmt::print("{:<8} {:10.3f} {:10.1f}\n", "sync", sync_ms / nb_frames,
+               nb_frames * 1000.0 / sync_ms);
+    fmt::print("{:<8} {:10.3f} {:10.1f}\n", "async", async_ms / nb_frames,
+               nb_frames * 1000.0 / async_ms);
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Cost and identity stability of FaceTracker with many simultaneous faces.
+//
+// Usage: face_tracker_bench [frames]
+// Faces move at constant velocity on a 4K frame and bounce off its borders,
+// the detections are jittered and randomly missed.
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "face_tracker.h"
+#include "latency_stats.h"
+#include "spdlog/fmt/fmt.h"
+
+namespace {
+
+struct SimulatedFace {
+    cv::Rect2d box;
+    double vx, vy;
+    // Track ID the face was last reported with, -1 before its first match
+    int last_id = -1;
+};
+
+void Move(SimulatedFace& face, const cv::Size& frame_size) {
+    auto& box = face.box;
+    box.x += face.vx;
+    box.y += face.vy;
+    if (box.x < 0 || box.x + box.width > frame_size.width) {
+        face.vx = -face.vx;
+        box.x += 2 * face.vx;
+    }
+    if (box.y < 0 || box.y + box.height > frame_size.height) {
+        face.vy = -face.vy;
+        box.y += 2 * face.vy;
+    }
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int nb_frames = argc > 1 ? std::atoi(argv[1]) : 300;
+    const cv::Size frame_size(3840, 2160);
+    const double miss_rate = 0.05;
+
+    fmt::print("{} frames of {}x{}, {:.0f}% missed detections\n", nb_frames,
+               frame_size.width, frame_size.height, miss_rate * 100);
+    fmt::print("{:>6} {:>10} {:>10} {:>10} {:>10} {:>8}\n", "faces",
+               "mean ms", "p50 ms", "p99 ms", "ID switch", "tracks");
+
+    for (int nb_faces : {10, 50, 100, 200}) {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<double> size(40.0, 120.0);
+        std::uniform_real_distribution<double> speed(-8.0, 8.0);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::normal_distribution<double> jitter(0.0, 0.02);
+
+        std::vector<SimulatedFace> faces;
+        for (int i = 0; i < nb_faces; ++i) {
+            const double face_size = size(rng);
+            SimulatedFace face;
+            face.box = cv::Rect2d(
+                uniform(rng) * (frame_size.width - face_size),
+                uniform(rng) * (frame_size.height - face_size), face_size,
+                face_size);
+            face.vx = speed(rng);
+            face.vy = speed(rng);
+            faces.push_back(face);
+        }
+
+        mukham::FaceTracker tracker;
+        mukham::LatencyStats stats;
+        std::vector<cv::Rect2d> detections;
+        std::vector<int> detected_faces;
+        std::vector<int> ids;
+        int id_switches = 0;
+        int max_id = -1;
+
+        for (int frame = 0; frame < nb_frames; ++frame) {
+            detections.clear();
+            detected_faces.clear();
+            for (int i = 0; i < nb_faces; ++i) {
+                auto& face = faces[i];
+                Move(face, frame_size);
+                if (uniform(rng) < miss_rate) continue;
+
+                const double noise = face.box.width * jitter(rng);
+                detections.push_back(
+                    cv::Rect2d(face.box.x + noise, face.box.y - noise,
+                               face.box.width + noise, face.box.height));
+                detected_faces.push_back(i);
+            }
+
+            auto start = mukham::Clock::now();
+            tracker.Update(detections, ids);
+            stats.Add(mukham::ElapsedMs(start, mukham::Clock::now()));
+
+            for (size_t d = 0; d < ids.size(); ++d) {
+                auto& face = faces[detected_faces[d]];
+                if (face.last_id >= 0 && face.last_id != ids[d]) id_switches++;
+                face.last_id = ids[d];
+                max_id = (std::max)(max_id, ids[d]);
+            }
+        }
+
+        fmt::print("{:>6} {:>10.4f} {:>10.4f} {:>10.4f} {:>10} {:>8}\n",
+                   nb_faces, stats.Mean(), stats.Percentile(50),
+                   stats.Percentile(99), id_switches, max_id + 1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+// Resident memory as Facemesh instances are added, the way the landmark
+// workers and the streams create them. The instances share the loaded
+// module and its weights, so the memory should only grow by the
+// activations of each instance.
+//
+// Usage: model_sharing_bench [model.so] [instances]
+
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "memory_usage.h"
+#include "spdlog/fmt/fmt.h"
+#include "tvm_facemesh.h"
+#include "tvm_model.h"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+    fs::path model_path = argc > 1 ? fs::path(argv[1])
+                                   : fs::current_path() / "models" /
+                                         "facemesh" / "face_landmark.so";
+    const int nb_instances = argc > 2 ? std::atoi(argv[2]) : 8;
+
+    cv::Mat face(192, 192, CV_8UC3);
+    cv::randu(face, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    const auto baseline = mukham::GetMemoryUsage();
+    fmt::print("{:<10} {:>12} {:>12} {:>10}\n", "instances", "RSS MB",
+               "delta MB", "modules");
+    fmt::print("{:<10} {:12.1f} {:>12} {:10}\n", 0, baseline.ResidentMB(),
+               "", mukham::TvmModel::NumLoadedModels());
+
+    std::vector<std::unique_ptr<tvm_facemesh::TVM_Facemesh>> instances;
+    double previous_mb = baseline.ResidentMB();
+    for (int idx = 0; idx < nb_instances; ++idx) {
+        auto facemesh = std::make_unique<tvm_facemesh::TVM_Facemesh>(
+            model_path);
+        if (!facemesh->CanExecute()) {
+            fmt::print("Failed to load {}\n", model_path.string());
+            return -1;
+        }
+        // Touches the activations, a graph executor allocates them up front
+        // but the pages are only resident once written
+        tvm_facemesh::TVM_FacemeshResult result;
+        facemesh->Detect(face, result);
+        instances.push_back(std::move(facemesh));
+
+        const auto memory = mukham::GetMemoryUsage();
+        fmt::print("{:<10} {:12.1f} {:12.1f} {:10}\n", idx + 1,
+                   memory.ResidentMB(), memory.ResidentMB() - previous_mb,
+                   mukham::TvmModel::NumLoadedModels());
+        previous_mb = memory.ResidentMB();
+    }
+
+    fmt::print("Peak RSS {:.1f} MB\n",
+               mukham::GetMemoryUsage().PeakResidentMB());
+    return 0;
+}
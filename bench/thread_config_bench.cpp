@@ -0,0 +1,159 @@
+// Throughput of Blazeface and Facemesh running concurrently, each on its own
+// thread like the detect and landmark stages of the pipeline, for several
+// splits of the cores and TVM thread counts.
+//
+// Usage: thread_config_bench [blazeface.so] [facemesh.so] [iterations]
+// The default configuration lets both TVM thread pools use every core, the
+// split ones give Blazeface 1, 2, ... cores and Facemesh the others. Every
+// configuration is run with OpenCV's default thread count and with OpenCV on
+// the calling thread.
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <opencv2/core.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latency_stats.h"
+#include "runtime_threads.h"
+#include "spdlog/fmt/fmt.h"
+#include "tvm_blazeface.h"
+#include "tvm_facemesh.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct ThreadConfig {
+    std::string name;
+    mukham::RuntimeThreadOptions options;
+};
+
+std::vector<int> CoreRange(int first, int last) {
+    std::vector<int> cores;
+    for (int core = first; core <= last; ++core) {
+        cores.push_back(core);
+    }
+    return cores;
+}
+
+std::vector<ThreadConfig> MakeConfigs(int nb_cores) {
+    std::vector<ThreadConfig> configs;
+    configs.push_back({"default", {}});
+
+    ThreadConfig shared{"shared, half threads each", {}};
+    shared.options.detector.tvm_threads = (std::max)(1, nb_cores / 2);
+    shared.options.landmarks.tvm_threads = (std::max)(1, nb_cores / 2);
+    configs.push_back(shared);
+
+    // Blazeface is the lighter model, it gets the smaller share
+    for (int detector_cores = 1; detector_cores <= nb_cores / 2;
+         detector_cores *= 2) {
+        ThreadConfig split;
+        split.options.detector.cores = CoreRange(0, detector_cores - 1);
+        split.options.landmarks.cores =
+            CoreRange(detector_cores, nb_cores - 1);
+        split.name = fmt::format(
+            "cores {} | {}",
+            mukham::FormatCoreList(split.options.detector.cores),
+            mukham::FormatCoreList(split.options.landmarks.cores));
+        configs.push_back(split);
+    }
+    return configs;
+}
+
+struct RunStats {
+    mukham::LatencyStats detector;
+    mukham::LatencyStats landmarks;
+    double detector_ms = 0.0;
+    double landmark_ms = 0.0;
+};
+
+RunStats Run(const mukham::RuntimeThreadOptions& options,
+             tvm_blazeface::TVM_Blazeface& detector,
+             tvm_facemesh::TVM_Facemesh& facemesh, const cv::Mat& frame,
+             const cv::Mat& face, int iterations) {
+    cv::setNumThreads(-1);
+    mukham::ConfigureProcessThreads(options);
+
+    // New threads get new TVM thread pools
+    RunStats stats;
+    std::thread detect_thread([&] {
+        mukham::ConfigureModelThreads(options.detector);
+        const auto start = mukham::Clock::now();
+        for (int idx = 0; idx < iterations; ++idx) {
+            const auto run_start = mukham::Clock::now();
+            detector.DetectFace(frame);
+            stats.detector.Add(
+                mukham::ElapsedMs(run_start, mukham::Clock::now()));
+        }
+        stats.detector_ms = mukham::ElapsedMs(start, mukham::Clock::now());
+    });
+    std::thread landmark_thread([&] {
+        mukham::ConfigureModelThreads(options.landmarks);
+        tvm_facemesh::TVM_FacemeshResult result;
+        const auto start = mukham::Clock::now();
+        for (int idx = 0; idx < iterations; ++idx) {
+            const auto run_start = mukham::Clock::now();
+            facemesh.Detect(face, result);
+            stats.landmarks.Add(
+                mukham::ElapsedMs(run_start, mukham::Clock::now()));
+        }
+        stats.landmark_ms = mukham::ElapsedMs(start, mukham::Clock::now());
+    });
+    detect_thread.join();
+    landmark_thread.join();
+    return stats;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    fs::path blazeface_path = argc > 1 ? fs::path(argv[1])
+                                       : fs::current_path() / "models" /
+                                             "blazeface" /
+                                             "face_detection_front.so";
+    fs::path facemesh_path = argc > 2 ? fs::path(argv[2])
+                                      : fs::current_path() / "models" /
+                                            "facemesh" / "face_landmark.so";
+    const int iterations = argc > 3 ? std::atoi(argv[3]) : 200;
+
+    tvm_blazeface::TVM_Blazeface detector(blazeface_path);
+    if (!detector.CanExecute()) {
+        fmt::print("Failed to load {}\n", blazeface_path.string());
+        return -1;
+    }
+    tvm_facemesh::TVM_Facemesh facemesh(facemesh_path);
+    if (!facemesh.CanExecute()) {
+        fmt::print("Failed to load {}\n", facemesh_path.string());
+        return -1;
+    }
+
+    cv::Mat frame(480, 640, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::Mat face(192, 192, CV_8UC3);
+    cv::randu(face, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    const int nb_cores = (int)std::thread::hardware_concurrency();
+    fmt::print("{} cores, {} iterations per model\n", nb_cores, iterations);
+    fmt::print("{:<28} {:>6} {:>10} {:>10} {:>10} {:>10}\n", "config",
+               "cv", "det FPS", "det p50", "mesh FPS", "mesh p50");
+
+    for (const auto& config : MakeConfigs(nb_cores)) {
+        for (int opencv_threads : {-1, 0}) {
+            auto options = config.options;
+            options.opencv_threads = opencv_threads;
+            auto stats = Run(options, detector, facemesh, frame, face,
+                             iterations);
+            fmt::print(
+                "{:<28} {:>6} {:10.1f} {:10.3f} {:10.1f} {:10.3f}\n",
+                config.name, opencv_threads < 0 ? "auto" : "off",
+                iterations * 1000.0 / stats.detector_ms,
+                stats.detector.Percentile(50),
+                iterations * 1000.0 / stats.landmark_ms,
+                stats.landmarks.Percentile(50));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Latency of tiled Blazeface detection against the number of tiles, with
+// and without the batched executors.
+//
+// Usage: tiled_detection_bench [model.so] [image] [iterations]
+// Without an image a 3840x2160 noise frame is used, which measures the
+// inference cost but finds no face.
+
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <string>
+#include <vector>
+
+#include "latency_stats.h"
+#include "spdlog/fmt/fmt.h"
+#include "tvm_blazeface.h"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+    fs::path model_path = argc > 1 ? fs::path(argv[1])
+                                   : fs::current_path() / "models" /
+                                         "blazeface" /
+                                         "face_detection_front.so";
+    const int iterations = argc > 3 ? std::atoi(argv[3]) : 20;
+
+    cv::Mat frame;
+    if (argc > 2) {
+        frame = cv::imread(argv[2]);
+        if (frame.empty()) {
+            fmt::print("Failed to read the frame\n");
+            return -1;
+        }
+        cv::cvtColor(frame, frame, cv::COLOR_BGR2RGB);
+    } else {
+        frame = cv::Mat(2160, 3840, CV_8UC3);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    }
+
+    const std::vector<std::vector<int>> batch_configs = {{1}, {1, 4, 8}};
+    const std::vector<std::pair<int, int>> grids = {
+        {1, 1}, {2, 2}, {2, 3}, {3, 3}, {3, 4}, {4, 4}};
+
+    fmt::print("Frame {}x{}, {} iterations\n", frame.cols, frame.rows,
+               iterations);
+    fmt::print("{:<10} {:>6} {:>6} {:>10} {:>10} {:>10} {:>12}\n", "batches",
+               "grid", "tiles", "mean ms", "p50 ms", "p90 ms", "ms per tile");
+
+    for (const auto& batch_sizes : batch_configs) {
+        tvm_blazeface::TVM_Blazeface detector(
+            model_path, tvm_blazeface::BlazefaceModel::Front, batch_sizes);
+        if (!detector.CanExecute()) {
+            fmt::print("Failed to load {}\n", model_path.string());
+            return -1;
+        }
+
+        std::string loaded;
+        for (auto batch_size : detector.GetBatchSizes()) {
+            loaded += (loaded.empty() ? "" : ",") + std::to_string(batch_size);
+        }
+
+        for (const auto& [rows, cols] : grids) {
+            tvm_blazeface::TileOptions tiles;
+            tiles.rows = rows;
+            tiles.cols = cols;
+
+            // Warm up the executors and the buffers
+            detector.DetectFaceTiled(frame, tiles);
+
+            mukham::LatencyStats stats;
+            size_t nb_faces = 0;
+            for (int i = 0; i < iterations; ++i) {
+                auto start = mukham::Clock::now();
+                nb_faces = detector.DetectFaceTiled(frame, tiles).size();
+                stats.Add(mukham::ElapsedMs(start, mukham::Clock::now()));
+            }
+
+            fmt::print(
+                "{:<10} {:>6} {:>6} {:>10.2f} {:>10.2f} {:>10.2f} {:>12.2f}"
+                "  ({} faces)\n",
+                loaded, fmt::format("{}x{}", rows, cols), tiles.NumTiles(),
+                stats.Mean(), stats.Percentile(50), stats.Percentile(90),
+                stats.Mean() / tiles.NumTiles(), nb_faces);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+"""
+Build options shared by the conversion scripts
+"""
+
+import tvm
+from tvm import relay
+from tvm.relay.backend import Executor, Runtime
+
+
+def with_uint8_input(mod, input_name: str, scale: float, shift: float = 0.0):
+    """
+    Replaces the float input of the model by a uint8 input of the same
+    shape. The normalisation x * scale + shift becomes the first operation
+    of the graph, where it is fused with the following operators, so the
+    runtime feeds the image bytes without converting them.
+    """
+    func = mod["main"]
+    param = next(p for p in func.params if p.name_hint == input_name)
+    data = relay.var(input_name, shape=param.type_annotation.shape,
+                     dtype="uint8")
+    normalized = relay.cast(data, "float32") * relay.const(scale)
+    if shift != 0.0:
+        normalized = normalized + relay.const(shift)
+    body = relay.bind(func.body, {param: normalized})
+    params = [data if p.same_as(param) else p for p in func.params]
+    return tvm.IRModule.from_expr(relay.Function(params, body))
+
+
+def build_args(executor: str) -> dict:
+    """
+    Arguments of relay.build for the executor the runtime loads the module
+    with. An AOT module has a single entry point with the parameters linked
+    in as constants, the C++ runtime runs it through the packed interface.
+    """
+    if executor == "aot":
+        return {
+            "executor": Executor("aot", {"link-params": True}),
+            "runtime": Runtime("cpp"),
+        }
+    return {}
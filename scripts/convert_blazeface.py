@@ -2,12 +2,15 @@
 Convert Blazeface model
 """
 
+import argparse
 from pathlib import Path
 import platform
 import tflite
 import tvm
 from tvm import relay, transform
-from typing import NamedTuple, Tuple
+from typing import NamedTuple, Optional, Tuple
+
+from build_options import build_args, with_uint8_input
 
 
 class ConversionParams(NamedTuple):
@@ -15,6 +18,12 @@ class ConversionParams(NamedTuple):
     shape: Tuple[int]
     input_name: str
     dtype: str
+    # "graph" or "aot"
+    executor: str = "graph"
+    # Next to the tflite model when None
+    output_dir: Optional[Path] = None
+    # Take the image bytes and normalise them in the graph
+    uint8_input: bool = False
 
 
 def convert(convert_params: ConversionParams):
@@ -37,24 +46,55 @@ def convert(convert_params: ConversionParams):
         shape_dict={convert_params.input_name: convert_params.shape},
         dtype_dict={convert_params.input_name: convert_params.dtype},
     )
+    if convert_params.uint8_input:
+        # The runtime used to map [0, 255] to [-1, 1]
+        mod = with_uint8_input(mod, convert_params.input_name, 2.0 / 255.0,
+                               -1.0)
 
     target = 'llvm'
     with transform.PassContext(opt_level=3):
         #lib = relay.build(mod, tvm.target.Target(target="llvm", host="llvm"), params)
-        lib = relay.build(mod, target, params=params)
+        lib = relay.build(mod, target, params=params,
+                          **build_args(convert_params.executor))
+        output_file = convert_params.model_path
+        if convert_params.output_dir is not None:
+            convert_params.output_dir.mkdir(parents=True, exist_ok=True)
+            output_file = convert_params.output_dir / output_file.name
+        batch = convert_params.shape[0]
+        if batch > 1:
+            output_file = output_file.with_name(
+                f"{output_file.stem}_b{batch}{output_file.suffix}")
         if platform.system() == "Windows":
-            output_file = convert_params.model_path.with_suffix(".dll")
+            output_file = output_file.with_suffix(".dll")
         else:
-            output_file = convert_params.model_path.with_suffix(".so")
+            output_file = output_file.with_suffix(".so")
         lib.export_library(str(output_file))
 
 
 if __name__ == "__main__":
-    model_path = (
-        Path(__file__).absolute().parents[1]
-        / "models"
-        / "blazeface"
-        / "face_detection_front.tflite"
-    )
-    params = ConversionParams(model_path, (1, 128, 128, 3), "input", "float32")
-    convert(params)
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--executor", choices=("graph", "aot"),
+                        default="graph",
+                        help="Executor the modules are built for")
+    parser.add_argument("--output-dir", type=Path, default=None,
+                        help="Directory of the modules, next to the tflite"
+                        " models by default")
+    parser.add_argument("--uint8-input", action="store_true",
+                        help="Take the image bytes and normalise them in the"
+                        " graph")
+    args = parser.parse_args()
+
+    model_dir = Path(__file__).absolute().parents[1] / "models" / "blazeface"
+    models = [
+        ("face_detection_front.tflite", (1, 128, 128, 3)),
+        ("face_detection_short_range.tflite", (1, 128, 128, 3)),
+        ("face_detection_full_range.tflite", (1, 192, 192, 3)),
+    ]
+    # The runtime picks the smallest batch that holds the frames of a call
+    for model_name, shape in models:
+        for batch in (1, 4, 8):
+            params = ConversionParams(
+                model_dir / model_name, (batch,) + shape[1:], "input", "float32",
+                args.executor, args.output_dir, args.uint8_input
+            )
+            convert(params)
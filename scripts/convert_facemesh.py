@@ -2,13 +2,20 @@
 Converts FaceMesh TFLite model to ShareObject
 """
 
+import argparse
 from pathlib import Path
 import tflite
 import tvm
 from tvm import relay, transform
 import platform
+from typing import Optional
 
-def convert(model_path: Path, batch: int, convert) -> None:
+from build_options import build_args, with_uint8_input
+
+
+def convert(model_path: Path, batch: int, convert, executor: str = "graph",
+            output_dir: Optional[Path] = None,
+            uint8_input: bool = False) -> None:
     """
     Converts the facemesh tflite model to
     shared object that can then be used in
@@ -16,6 +23,13 @@ def convert(model_path: Path, batch: int, convert) -> None:
 
     @params:
     model_name : path to the tflite model
+    batch : batch size of the input, the modules with a batch
+            size above 1 are saved as face_landmark_b<batch>
+    executor : "graph" or "aot", an AOT module has a single entry
+               point with the parameters linked in as constants
+    output_dir : directory of the module, next to the tflite model
+                 when None
+    uint8_input : take the image bytes and normalise them in the graph
 
     @returns:
     None
@@ -41,6 +55,9 @@ def convert(model_path: Path, batch: int, convert) -> None:
         shape_dict = {input_tensor: input_shape},
         dtype_dict = {input_tensor: input_dtype}
     )
+    if uint8_input:
+        # The runtime used to map [0, 255] to [0, 1]
+        mod = with_uint8_input(mod, input_tensor, 1.0 / 255.0)
 
     desired_layouts = {
         'nn.conv2d': ['NCHW', 'default'],
@@ -55,19 +72,42 @@ def convert(model_path: Path, batch: int, convert) -> None:
     with transform.PassContext(opt_level=3):
         if convert:
             mod = seq(mod)
-        lib = relay.build(mod, target, params=params)
+        lib = relay.build(mod, target, params=params,
+                          **build_args(executor))
+        output_file = model_path
+        if output_dir is not None:
+            output_dir.mkdir(parents=True, exist_ok=True)
+            output_file = output_dir / output_file.name
+        if batch > 1:
+            output_file = output_file.with_name(
+                f"{model_path.stem}_b{batch}{model_path.suffix}")
         if platform.system() == 'Windows':
-            output_file = model_path.with_suffix(".dll")
+            output_file = output_file.with_suffix(".dll")
         else:
-            output_file = model_path.with_suffix(".so")
+            output_file = output_file.with_suffix(".so")
         lib.export_library(str(output_file))
 
 
 if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--executor', choices=('graph', 'aot'),
+                        default='graph',
+                        help='Executor the modules are built for')
+    parser.add_argument('--output-dir', type=Path, default=None,
+                        help='Directory of the modules, next to the tflite'
+                        ' model by default')
+    parser.add_argument('--uint8-input', action='store_true',
+                        help='Take the image bytes and normalise them in the'
+                        ' graph')
+    args = parser.parse_args()
+
     model_path = (
         Path(__file__).absolute().parents[1]
         / "models"
         / "facemesh"
         / "face_landmark.tflite"
     )
-    convert(model_path, 1, False)
+    # The runtime picks the smallest batch that holds the faces of a frame
+    for batch in (1, 4, 8):
+        convert(model_path, batch, False, args.executor, args.output_dir,
+                args.uint8_input)
@@ -0,0 +1,178 @@
+#include "activation_arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+#include "spdlog/spdlog.h"
+#include "tvm/runtime/device_api.h"
+#include "tvm/runtime/registry.h"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+namespace mukham {
+namespace tr = tvm::runtime;
+
+namespace {
+
+// Alignment of the TVM runtime's own allocations
+constexpr size_t min_alignment = 64;
+
+struct ArenaState {
+    // Set once, before the first model is loaded
+    std::atomic<char*> base{nullptr};
+    size_t reserved_bytes = 0;
+
+    std::mutex mutex;
+    ActivationArenaStats stats;
+};
+
+ArenaState arena;
+thread_local ActivationArena::Scope* current_scope = nullptr;
+
+/**
+ * CPU device API of the runtime, except for the data space allocated inside
+ * an ActivationArena::Scope, which comes from the arena.
+ */
+class ArenaCpuDeviceAPI final : public tr::DeviceAPI {
+   public:
+    explicit ArenaCpuDeviceAPI(tr::DeviceAPI* cpu) : cpu(cpu) {}
+
+    void SetDevice(tr::Device dev) final { cpu->SetDevice(dev); }
+
+    void GetAttr(tr::Device dev, tr::DeviceAttrKind kind,
+                 tr::TVMRetValue* rv) final {
+        cpu->GetAttr(dev, kind, rv);
+    }
+
+    void* AllocDataSpace(tr::Device dev, size_t nbytes, size_t alignment,
+                         DLDataType type_hint) final {
+        if (void* data = ActivationArena::Allocate(nbytes, alignment))
+            return data;
+        return cpu->AllocDataSpace(dev, nbytes, alignment, type_hint);
+    }
+
+    void FreeDataSpace(tr::Device dev, void* ptr) final {
+        // The arena is released with the process
+        if (!ActivationArena::Contains(ptr)) cpu->FreeDataSpace(dev, ptr);
+    }
+
+    void StreamSync(tr::Device dev, TVMStreamHandle stream) final {
+        cpu->StreamSync(dev, stream);
+    }
+
+    void* AllocWorkspace(tr::Device dev, size_t nbytes,
+                         DLDataType type_hint) final {
+        return cpu->AllocWorkspace(dev, nbytes, type_hint);
+    }
+
+    void FreeWorkspace(tr::Device dev, void* ptr) final {
+        cpu->FreeWorkspace(dev, ptr);
+    }
+
+   protected:
+    void CopyDataFromTo(const void* from, size_t from_offset, void* to,
+                        size_t to_offset, size_t nbytes, tr::Device dev_from,
+                        tr::Device dev_to, DLDataType type_hint,
+                        TVMStreamHandle stream) final {
+        std::memcpy(static_cast<char*>(to) + to_offset,
+                    static_cast<const char*>(from) + from_offset, nbytes);
+    }
+
+   private:
+    tr::DeviceAPI* cpu;
+};
+
+bool InstallDeviceAPI() {
+    const auto* cpu_api = tr::Registry::Get("device_api.cpu");
+    if (!cpu_api) return false;
+
+    void* cpu = (*cpu_api)();
+    static ArenaCpuDeviceAPI arena_api(static_cast<tr::DeviceAPI*>(cpu));
+    tr::Registry::Register("device_api.cpu", true)
+        .set_body([](tr::TVMArgs, tr::TVMRetValue* rv) {
+            *rv = static_cast<void*>(&arena_api);
+        });
+
+    // The runtime looks the device API up once
+    return tr::DeviceAPI::Get(DLDevice{kDLCPU, 0}) == &arena_api;
+}
+}  // namespace
+
+bool ActivationArena::Enable(size_t reserved_bytes) {
+    std::lock_guard<std::mutex> lock(arena.mutex);
+    if (arena.base) return true;
+
+#if defined(_WIN32)
+    spdlog::warn("The activation arena is not supported on this platform");
+    return false;
+#else
+    void* base = mmap(nullptr, reserved_bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        spdlog::error("Failed to reserve {} MB for the activation arena",
+                      reserved_bytes >> 20);
+        return false;
+    }
+    if (!InstallDeviceAPI()) {
+        spdlog::error("The activation arena must be enabled before the "
+                      "first model is loaded");
+        munmap(base, reserved_bytes);
+        return false;
+    }
+
+    arena.reserved_bytes = reserved_bytes;
+    arena.base = static_cast<char*>(base);
+    return true;
+#endif
+}
+
+bool ActivationArena::IsEnabled() {
+    std::lock_guard<std::mutex> lock(arena.mutex);
+    return arena.base != nullptr;
+}
+
+ActivationArenaStats ActivationArena::GetStats() {
+    std::lock_guard<std::mutex> lock(arena.mutex);
+    return arena.stats;
+}
+
+ActivationArena::Scope::Scope() : previous(current_scope) {
+    current_scope = this;
+}
+
+ActivationArena::Scope::~Scope() {
+    current_scope = previous;
+    if (used_bytes == 0) return;
+
+    std::lock_guard<std::mutex> lock(arena.mutex);
+    arena.stats.executors++;
+    arena.stats.requested_bytes += used_bytes;
+    arena.stats.arena_bytes = (std::max)(arena.stats.arena_bytes, used_bytes);
+}
+
+void* ActivationArena::Allocate(size_t nbytes, size_t alignment) {
+    char* base = arena.base;
+    if (!current_scope || !base) return nullptr;
+
+    // Every scope starts at the beginning of the arena
+    alignment = (std::max)(alignment, min_alignment);
+    const size_t offset =
+        (current_scope->used_bytes + alignment - 1) / alignment * alignment;
+    if (offset + nbytes > arena.reserved_bytes) {
+        spdlog::warn("The activation arena is full");
+        return nullptr;
+    }
+    current_scope->used_bytes = offset + nbytes;
+    return base + offset;
+}
+
+bool ActivationArena::Contains(const void* ptr) {
+    const char* base = arena.base;
+    const char* data = static_cast<const char*>(ptr);
+    return base && data >= base && data < base + arena.reserved_bytes;
+}
+}  // namespace mukham
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+
+namespace mukham {
+
+struct ActivationArenaStats {
+    size_t executors = 0;
+    // Storage the executors asked for, what they would hold without the
+    // arena
+    size_t requested_bytes = 0;
+    // Largest executor, the part of the arena that becomes resident
+    size_t arena_bytes = 0;
+
+    size_t SavedBytes() const {
+        return requested_bytes > arena_bytes ? requested_bytes - arena_bytes
+                                             : 0;
+    }
+};
+
+/**
+ * Activation storage shared by the TVM executors of models that never run
+ * concurrently.
+ *
+ * While the arena is enabled, the storage an executor allocates when it is
+ * created, see TvmModel::CreateExecutor, is laid out from the start of one
+ * reserved block instead of being allocated for it alone. All the executors
+ * overlap, the memory they keep resident is that of the largest one.
+ *
+ * This only holds when the models run one after another on a single thread
+ * and the outputs of a model are read before the next one runs: the
+ * inputs, activations and outputs of an executor are overwritten by the
+ * next executor that runs.
+ */
+class ActivationArena {
+   public:
+    // Must be called before the first model is loaded, the TVM runtime
+    // keeps the allocator it used first. reserved_bytes is address space,
+    // only the pages the executors touch become resident.
+    static bool Enable(size_t reserved_bytes = size_t(512) << 20);
+    static bool IsEnabled();
+
+    static ActivationArenaStats GetStats();
+
+    // The allocations of the calling thread go to the arena while the scope
+    // lives, each scope is the storage of one executor
+    class Scope {
+       public:
+        Scope();
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+       private:
+        friend class ActivationArena;
+        Scope* previous;
+        size_t used_bytes = 0;
+    };
+
+    // nullptr outside a scope or when the arena is full
+    static void* Allocate(size_t nbytes, size_t alignment);
+    static bool Contains(const void* ptr);
+};
+}  // namespace mukham
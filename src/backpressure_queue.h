@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "spsc_queue.h"
+
+namespace mukham {
+
+// What the producer does when the consumer can not keep up
+enum class BackpressurePolicy : int {
+    // Wait for the consumer, nothing is lost but latency builds up
+    Block = 0,
+    // Evict the oldest queued item to make room for the new one
+    DropOldest = 1,
+    // Replace everything that is queued, the consumer always gets the newest
+    LatestOnly = 2,
+};
+
+inline const char* ToString(BackpressurePolicy policy) {
+    switch (policy) {
+        case BackpressurePolicy::Block:
+            return "block";
+        case BackpressurePolicy::DropOldest:
+            return "drop-oldest";
+        case BackpressurePolicy::LatestOnly:
+            return "latest";
+    }
+    return "unknown";
+}
+
+inline bool ParseBackpressurePolicy(const std::string& name,
+                                    BackpressurePolicy& policy) {
+    for (auto candidate :
+         {BackpressurePolicy::Block, BackpressurePolicy::DropOldest,
+          BackpressurePolicy::LatestOnly}) {
+        if (name == ToString(candidate)) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Bounded queue whose producer side follows a BackpressurePolicy.
+ *
+ * Dropping the oldest item means the producer removes from the consumer end,
+ * which a lock-free SPSC ring can not do safely, so this queue is guarded by
+ * a mutex. It sits behind the capture stage, which runs at the camera rate,
+ * where the lock is not a bottleneck.
+ */
+template <typename T>
+class BackpressureQueue {
+   public:
+    BackpressureQueue(size_t capacity, BackpressurePolicy policy)
+        : max_size(capacity > 0 ? capacity : 1), queue_policy(policy) {}
+
+    BackpressureQueue(const BackpressureQueue&) = delete;
+    BackpressureQueue& operator=(const BackpressureQueue&) = delete;
+
+    void SetPolicy(BackpressurePolicy policy) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue_policy = policy;
+        }
+        not_full.notify_all();
+    }
+
+    BackpressurePolicy GetPolicy() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue_policy;
+    }
+
+    bool Push(T&& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (closed) return false;
+
+        if (items.size() >= max_size) {
+            push_stalls++;
+            switch (queue_policy) {
+                case BackpressurePolicy::Block:
+                    not_full.wait(lock, [this] {
+                        return closed || items.size() < max_size ||
+                               queue_policy != BackpressurePolicy::Block;
+                    });
+                    if (closed) return false;
+                    if (items.size() >= max_size) {
+                        // The policy was switched while waiting
+                        _evict();
+                    }
+                    break;
+                case BackpressurePolicy::DropOldest:
+                    _evict();
+                    break;
+                case BackpressurePolicy::LatestOnly:
+                    break;
+            }
+        }
+
+        if (queue_policy == BackpressurePolicy::LatestOnly) {
+            while (!items.empty()) _evict();
+        }
+
+        items.push_back(std::move(item));
+        pushed++;
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (items.empty()) {
+            pop_stalls++;
+            not_empty.wait(lock, [this] { return closed || !items.empty(); });
+            if (items.empty()) return false;
+        }
+        _pop_front(item);
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    bool TryPop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (items.empty()) return false;
+        _pop_front(item);
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    uint64_t Dropped() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    }
+
+    QueueStats GetStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return {items.size(), max_size,   pushed,
+                popped,       push_stalls, pop_stalls,
+                dropped};
+    }
+
+   private:
+    void _evict() {
+        items.pop_front();
+        dropped++;
+    }
+
+    void _pop_front(T& item) {
+        item = std::move(items.front());
+        items.pop_front();
+        popped++;
+    }
+
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<T> items;
+    size_t max_size;
+    BackpressurePolicy queue_policy;
+    bool closed = false;
+
+    uint64_t pushed = 0;
+    uint64_t popped = 0;
+    uint64_t push_stalls = 0;
+    uint64_t pop_stalls = 0;
+    uint64_t dropped = 0;
+};
+}  // namespace mukham
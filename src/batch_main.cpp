@@ -0,0 +1,1009 @@
+// Headless batch mode: runs the face pipeline over video files as fast as the
+// CPU allows and writes the per-frame detections to a JSON lines file.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <string>
+#include <vector>
+
+#include "activation_arena.h"
+#include "face_models.h"
+#include "face_tracker.h"
+#include "frame_pipeline.h"
+#include "landmark_worker_pool.h"
+#include "latency_stats.h"
+#include "memory_usage.h"
+#include "motion_gate.h"
+#include "multi_stream_runner.h"
+#include "operator_profiler.h"
+#include "roi_tracker.h"
+#include "runtime_threads.h"
+#include "spdlog/fmt/fmt.h"
+#include "spdlog/spdlog.h"
+#include "tvm_model.h"
+
+namespace {
+namespace fs = std::filesystem;
+
+// Operators printed per model, the trace has all of them
+constexpr size_t profiled_operators = 20;
+// The pipeline queues allocate their slots up front
+constexpr int max_queue_capacity = 1024;
+// Each worker is a thread, most with a copy of the landmark model
+constexpr int max_landmark_workers = 64;
+// The decoded frames of a batch are held in memory together
+constexpr int max_frame_batch = 64;
+// Requests of the streams batched together by the detector
+constexpr int max_detector_batch = 64;
+
+struct BatchOptions {
+    mukham::FaceDetectorType detector = mukham::FaceDetectorType::Blazeface;
+    mukham::LandmarkModelType landmarks = mukham::LandmarkModelType::None;
+    double roi_scale = 1.0;
+    double scale = 1.0;
+    std::string output{"detections.jsonl"};
+    // Run the stages on the threaded pipeline instead of one after another
+    bool pipeline = false;
+    size_t queue_capacity = 4;
+    mukham::BackpressurePolicy policy = mukham::BackpressurePolicy::Block;
+    // Feed the videos at their native frame rate, like a live source
+    bool realtime = false;
+    // Spread the faces of a frame over this many landmark workers
+    size_t landmark_workers = 0;
+    // Frames detected together in one batched inference
+    size_t frame_batch = 1;
+    // Blazeface runs the tiles of a frame as one batch
+    tvm_blazeface::TileOptions tiles;
+    // Detect on keyframes only and follow the faces with their landmarks
+    bool track = false;
+    mukham::RoiTrackerOptions tracking;
+    // Reuse the results of the last processed frame while nothing moves
+    bool motion_gate = false;
+    mukham::MotionGateOptions motion;
+    // Run all the videos at once, sharing the models
+    bool multi_stream = false;
+    // Cross-stream batching of the detector requests
+    mukham::DynamicBatcherOptions batching;
+    // Decode and letterbox the next frame while Blazeface runs
+    bool async_detect = false;
+    // The executors of the models share their activation storage
+    bool activation_arena = false;
+    // Thread counts and cores of the models
+    mukham::RuntimeThreadOptions threads;
+    // Time the operators of the TVM models over this many runs instead of
+    // processing videos
+    int profile_runs = 0;
+    std::vector<std::string> profile_modules;
+    std::string profile_trace{"operator_trace.json"};
+    std::vector<std::string> videos;
+};
+
+struct BatchStats {
+    mukham::LatencyStats decode;
+    mukham::LatencyStats preprocess;
+    mukham::LatencyStats detect;
+    mukham::LatencyStats landmark;
+    mukham::LatencyStats total;
+    size_t nb_faces = 0;
+    size_t detector_runs = 0;
+    mukham::MotionGateStats motion;
+    std::vector<mukham::NamedQueueStats> queues;
+    uint64_t dropped_frames = 0;
+    std::vector<mukham::StreamStats> streams;
+    mukham::BatcherStats detector_batches;
+    mukham::BatcherStats landmark_batches;
+};
+
+void PrintUsage(const char* program) {
+    fmt::print(
+        "Usage: {} [options] <video> [<video> ...]\n"
+        "       {} --profile-operators <runs> [options]\n"
+        "  --detector <dlib-hog|opencv-lbp|opencv-tf|blazeface|"
+        "blazeface-full>  (default: blazeface)\n"
+        "  --landmarks <none|dlib|facemesh>  (default: none)\n"
+        "  --roi-scale <value>  ROI scale for the landmark models"
+        " (default: 1.0)\n"
+        "  --scale <value>      Resize factor applied to every frame"
+        " (default: 1.0)\n"
+        "  --output <file>      Detections output file"
+        " (default: detections.jsonl)\n"
+        "  --pipeline           Run the stages on the threaded pipeline\n"
+        "  --queue-size <n>     Capacity of the pipeline queues"
+        " (default: 4)\n"
+        "  --policy <block|drop-oldest|latest>  Capture backpressure policy"
+        " (default: block)\n"
+        "  --realtime           Play the videos at their native frame rate,"
+        " implies --pipeline\n"
+        "  --landmark-workers <n>  Run the landmark models of the faces of a"
+        " frame on n workers (default: 0)\n"
+        "  --frame-batch <n>    Detect the faces of n frames in one inference,"
+        " Blazeface only (default: 1)\n"
+        "  --tiles <rows>x<cols>  Detect on a grid of overlapping tiles,"
+        " Blazeface only (default: 1x1)\n"
+        "  --tile-overlap <value>  Fraction of a tile shared with its"
+        " neighbours (default: 0.25)\n"
+        "  --track              Run the detector on keyframes only and track"
+        " the faces with their landmarks\n"
+        "  --keyframe-interval <n>  Frames between two detections when"
+        " tracking (default: 15)\n"
+        "  --motion-gate        Skip the models on frames where nothing"
+        " moved\n"
+        "  --motion-threshold <value>  Gray level difference that counts as"
+        " motion (default: 12)\n"
+        "  --multi-stream       Process all the videos concurrently with one"
+        " set of models\n"
+        "  --max-batch <n>      Largest batch of detector requests across"
+        " the streams (default: 8)\n"
+        "  --batch-delay <ms>   Time a request waits for others to fill its"
+        " batch (default: 2)\n"
+        "  --async-detect       Prepare the next frame while Blazeface runs"
+        " on the current one\n"
+        "  --opencv-threads <n>  Threads of cv::resize and cv::dnn"
+        " (default: OpenCV's)\n"
+        "  --detector-threads <n>  TVM threads of the detector"
+        " (default: TVM's)\n"
+        "  --detector-cores <list>  Cores of the detector, e.g. 0 or 0-1\n"
+        "  --landmark-threads <n>  TVM threads of the landmark model, with"
+        " --pipeline\n"
+        "  --landmark-cores <list>  Cores of the landmark model and its"
+        " workers, e.g. 1-3, with --pipeline\n"
+        "  --activation-arena   Share the activation memory of the models,"
+        " one after another on one thread only\n"
+        "  --profile-operators <runs>  Time the operators of the TVM models"
+        " through the debug executor\n"
+        "  --profile-module <file>  Another compiled module to profile\n"
+        "  --profile-trace <file>  Chrome trace of the profiled runs"
+        " (default: operator_trace.json)\n",
+        program, program);
+}
+
+// A whole number within [min_value, max_value]. std::atoi takes "4x" as 4,
+// and a negative count assigned to a size_t wraps around
+bool ParseInt(const std::string& text, int min_value, int max_value,
+              int& value) {
+    char* end = nullptr;
+    errno = 0;
+    const long parsed = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || errno == ERANGE ||
+        parsed < min_value || parsed > max_value)
+        return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+bool ParseArgs(int argc, char** argv, BatchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg{argv[i]};
+        auto next_value = [&](std::string& value) {
+            if (i + 1 >= argc) {
+                spdlog::error("Missing value for {}", arg);
+                return false;
+            }
+            value = argv[++i];
+            return true;
+        };
+
+        std::string value;
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "--detector") {
+            if (!next_value(value) ||
+                !mukham::ParseFaceDetectorType(value, options.detector)) {
+                spdlog::error("Invalid detector: {}", value);
+                return false;
+            }
+        } else if (arg == "--landmarks") {
+            if (!next_value(value) ||
+                !mukham::ParseLandmarkModelType(value, options.landmarks)) {
+                spdlog::error("Invalid landmark model: {}", value);
+                return false;
+            }
+        } else if (arg == "--roi-scale") {
+            if (!next_value(value)) return false;
+            options.roi_scale = std::atof(value.c_str());
+        } else if (arg == "--scale") {
+            if (!next_value(value)) return false;
+            options.scale = std::atof(value.c_str());
+        } else if (arg == "--output") {
+            if (!next_value(options.output)) return false;
+        } else if (arg == "--pipeline") {
+            options.pipeline = true;
+        } else if (arg == "--queue-size") {
+            int capacity;
+            if (!next_value(value) ||
+                !ParseInt(value, 1, max_queue_capacity, capacity)) {
+                spdlog::error("Queue size must be between 1 and {}: {}",
+                              max_queue_capacity, value);
+                return false;
+            }
+            options.queue_capacity = capacity;
+        } else if (arg == "--policy") {
+            if (!next_value(value) ||
+                !mukham::ParseBackpressurePolicy(value, options.policy)) {
+                spdlog::error("Invalid policy: {}", value);
+                return false;
+            }
+        } else if (arg == "--landmark-workers") {
+            int nb_workers;
+            if (!next_value(value) ||
+                !ParseInt(value, 0, max_landmark_workers, nb_workers)) {
+                spdlog::error("Landmark workers must be between 0 and {}: {}",
+                              max_landmark_workers, value);
+                return false;
+            }
+            options.landmark_workers = nb_workers;
+        } else if (arg == "--frame-batch") {
+            int nb_frames;
+            if (!next_value(value) ||
+                !ParseInt(value, 1, max_frame_batch, nb_frames)) {
+                spdlog::error("Frame batch must be between 1 and {}: {}",
+                              max_frame_batch, value);
+                return false;
+            }
+            options.frame_batch = nb_frames;
+        } else if (arg == "--tiles") {
+            if (!next_value(value) ||
+                std::sscanf(value.c_str(), "%dx%d", &options.tiles.rows,
+                            &options.tiles.cols) != 2 ||
+                options.tiles.rows < 1 || options.tiles.cols < 1) {
+                spdlog::error("Invalid tile grid: {}", value);
+                return false;
+            }
+        } else if (arg == "--tile-overlap") {
+            if (!next_value(value)) return false;
+            options.tiles.overlap = std::atof(value.c_str());
+        } else if (arg == "--track") {
+            options.track = true;
+        } else if (arg == "--keyframe-interval") {
+            if (!next_value(value)) return false;
+            options.tracking.keyframe_interval = std::atoi(value.c_str());
+        } else if (arg == "--motion-gate") {
+            options.motion_gate = true;
+        } else if (arg == "--motion-threshold") {
+            if (!next_value(value)) return false;
+            options.motion.pixel_threshold = std::atof(value.c_str());
+        } else if (arg == "--multi-stream") {
+            options.multi_stream = true;
+        } else if (arg == "--max-batch") {
+            int max_batch;
+            if (!next_value(value) ||
+                !ParseInt(value, 1, max_detector_batch, max_batch)) {
+                spdlog::error("Max batch must be between 1 and {}: {}",
+                              max_detector_batch, value);
+                return false;
+            }
+            options.batching.max_batch_size = max_batch;
+        } else if (arg == "--batch-delay") {
+            if (!next_value(value)) return false;
+            options.batching.max_delay_ms = std::atof(value.c_str());
+        } else if (arg == "--async-detect") {
+            options.async_detect = true;
+        } else if (arg == "--opencv-threads") {
+            if (!next_value(value)) return false;
+            options.threads.opencv_threads = std::atoi(value.c_str());
+        } else if (arg == "--detector-threads") {
+            if (!next_value(value)) return false;
+            options.threads.detector.tvm_threads = std::atoi(value.c_str());
+        } else if (arg == "--detector-cores") {
+            if (!next_value(value) ||
+                !mukham::ParseCoreList(value, options.threads.detector.cores)) {
+                spdlog::error("Invalid core list: {}", value);
+                return false;
+            }
+        } else if (arg == "--landmark-threads") {
+            if (!next_value(value)) return false;
+            options.threads.landmarks.tvm_threads = std::atoi(value.c_str());
+        } else if (arg == "--landmark-cores") {
+            if (!next_value(value) ||
+                !mukham::ParseCoreList(value,
+                                       options.threads.landmarks.cores)) {
+                spdlog::error("Invalid core list: {}", value);
+                return false;
+            }
+        } else if (arg == "--activation-arena") {
+            options.activation_arena = true;
+        } else if (arg == "--profile-operators") {
+            if (!next_value(value)) return false;
+            options.profile_runs = std::atoi(value.c_str());
+        } else if (arg == "--profile-module") {
+            if (!next_value(value)) return false;
+            options.profile_modules.push_back(value);
+        } else if (arg == "--profile-trace") {
+            if (!next_value(value)) return false;
+            options.profile_trace = value;
+        } else if (arg == "--realtime") {
+            options.realtime = true;
+            options.pipeline = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            spdlog::error("Unknown option: {}", arg);
+            return false;
+        } else {
+            options.videos.push_back(arg);
+        }
+    }
+
+    if (options.scale <= 0.0) {
+        spdlog::error("Scale must be positive");
+        return false;
+    }
+    if (options.batching.max_delay_ms < 0.0) {
+        spdlog::error("Batch delay must not be negative");
+        return false;
+    }
+    if (options.frame_batch > 1 && options.pipeline) {
+        spdlog::error("--frame-batch is not supported with --pipeline");
+        return false;
+    }
+    if (options.multi_stream && options.frame_batch > 1) {
+        spdlog::error("--multi-stream batches the frames of the videos");
+        return false;
+    }
+    if (options.frame_batch > 1 && options.tiles.NumTiles() > 1) {
+        spdlog::error("--frame-batch and --tiles both use the batch");
+        return false;
+    }
+    if (options.track &&
+        options.landmarks == mukham::LandmarkModelType::None) {
+        spdlog::error("--track needs a landmark model");
+        return false;
+    }
+    if (options.track && options.frame_batch > 1) {
+        spdlog::error("--track is not supported with --frame-batch");
+        return false;
+    }
+    if (options.motion_gate && options.frame_batch > 1) {
+        spdlog::error("--motion-gate is not supported with --frame-batch");
+        return false;
+    }
+    if (options.async_detect &&
+        (options.pipeline || options.multi_stream || options.frame_batch > 1 ||
+         options.tiles.NumTiles() > 1 || options.track ||
+         options.motion_gate)) {
+        spdlog::error("--async-detect only runs the plain per frame path");
+        return false;
+    }
+    if (options.async_detect &&
+        options.detector != mukham::FaceDetectorType::Blazeface &&
+        options.detector != mukham::FaceDetectorType::BlazefaceFullRange) {
+        spdlog::error("--async-detect needs a Blazeface detector");
+        return false;
+    }
+    if (options.multi_stream && (!options.threads.detector.IsDefault() ||
+                                 !options.threads.landmarks.IsDefault())) {
+        spdlog::error("--multi-stream does not support per model threads");
+        return false;
+    }
+    if (!options.pipeline && !options.threads.landmarks.IsDefault()) {
+        spdlog::error("The landmark model runs on its own thread with"
+                      " --pipeline only");
+        return false;
+    }
+    if (options.activation_arena &&
+        (options.pipeline || options.multi_stream || options.async_detect ||
+         options.landmark_workers > 0)) {
+        spdlog::error("--activation-arena runs the models on one thread"
+                      " only");
+        return false;
+    }
+    if (options.profile_runs < 0) {
+        spdlog::error("The number of profiled runs must be positive");
+        return false;
+    }
+    if (options.profile_runs > 0 && !options.videos.empty()) {
+        spdlog::error("--profile-operators does not process videos");
+        return false;
+    }
+    return !options.videos.empty() || options.profile_runs > 0;
+}
+
+std::string EscapeJson(const std::string& value) {
+    std::string escaped;
+    for (auto c : value) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+void WriteFrame(std::ofstream& out, const std::string& video, int frame_idx,
+                const mukham::FaceDetections& detections,
+                const std::vector<int>& face_ids,
+                const std::vector<std::vector<cv::Point2d>>& landmarks) {
+    std::string line = fmt::format("{{\"video\":\"{}\",\"frame\":{},\"faces\":[",
+                                   EscapeJson(video), frame_idx);
+    for (size_t i = 0; i < detections.faces.size(); ++i) {
+        const auto& face = detections.faces[i];
+        if (i > 0) line += ",";
+        line += fmt::format("{{\"id\":{},\"x\":{:.2f},\"y\":{:.2f},"
+                            "\"w\":{:.2f},\"h\":{:.2f},\"landmarks\":[",
+                            i < face_ids.size() ? face_ids[i] : -1, face.x,
+                            face.y, face.width, face.height);
+        if (i < landmarks.size()) {
+            for (size_t j = 0; j < landmarks[i].size(); ++j) {
+                if (j > 0) line += ",";
+                line += fmt::format("[{:.2f},{:.2f}]", landmarks[i][j].x,
+                                    landmarks[i][j].y);
+            }
+        }
+        line += "]}";
+    }
+    line += "],\"keypoints\":[";
+    for (size_t i = 0; i < detections.keypoints.size(); ++i) {
+        if (i > 0) line += ",";
+        line += fmt::format("[{:.2f},{:.2f}]", detections.keypoints[i].x,
+                            detections.keypoints[i].y);
+    }
+    line += "]}\n";
+    out << line;
+}
+
+// Runs the compiled modules of the selected models, and the given ones,
+// through the debug executor and prints their slowest operators
+bool ProfileOperators(const BatchOptions& options) {
+    std::vector<fs::path> modules;
+    if (options.detector == mukham::FaceDetectorType::Blazeface)
+        modules.push_back(mukham::GetBlazefaceModelPath());
+    if (options.detector == mukham::FaceDetectorType::BlazefaceFullRange)
+        modules.push_back(mukham::GetBlazefaceModelPath(
+            tvm_blazeface::BlazefaceModel::FullRange));
+    if (options.landmarks == mukham::LandmarkModelType::Facemesh)
+        modules.push_back(mukham::GetFacemeshModelPath());
+    for (const auto& module : options.profile_modules) {
+        modules.push_back(module);
+    }
+
+    std::vector<mukham::ModelProfile> profiles;
+    for (const auto& module : modules) {
+        mukham::ModelProfile profile;
+        if (!mukham::OperatorProfiler::Profile(module, options.profile_runs,
+                                               profile))
+            return false;
+        fmt::print("{}\n", mukham::OperatorProfiler::FormatReport(
+                               profile, profiled_operators));
+        profiles.push_back(std::move(profile));
+    }
+    if (profiles.empty()) {
+        spdlog::error("The selected models are not TVM models");
+        return false;
+    }
+    if (!mukham::OperatorProfiler::WriteChromeTrace(profiles,
+                                                    options.profile_trace))
+        return false;
+    fmt::print("Operator trace written to {}\n", options.profile_trace);
+    return true;
+}
+
+void PrintStats(const std::string& name, mukham::LatencyStats& stats) {
+    fmt::print(
+        "  {:<12} mean {:8.3f} ms  p50 {:8.3f} ms  p90 {:8.3f} ms"
+        "  p99 {:8.3f} ms  max {:8.3f} ms\n",
+        name, stats.Mean(), stats.Percentile(50), stats.Percentile(90),
+        stats.Percentile(99), stats.Max());
+}
+
+void PrintBatcherStats(const std::string& name, mukham::BatcherStats& stats) {
+    if (stats.batches == 0) return;
+    fmt::print(
+        "{} batches: {}, mean size {:.2f}, queueing delay p50 {:.3f} ms"
+        "  p99 {:.3f} ms\n",
+        name, stats.batches, stats.MeanBatchSize(),
+        stats.queue_delay.Percentile(50), stats.queue_delay.Percentile(99));
+    for (size_t size = 1; size < stats.batch_sizes.size(); ++size) {
+        if (stats.batch_sizes[size] == 0) continue;
+        fmt::print("  size {:<3} {} batches\n", size, stats.batch_sizes[size]);
+    }
+}
+
+bool ProcessVideo(const std::string& video, const BatchOptions& options,
+                  mukham::FaceModels& models,
+                  mukham::LandmarkWorkerPool* landmark_pool,
+                  std::ofstream& out, BatchStats& stats) {
+    cv::VideoCapture capture;
+    if (!capture.open(video)) {
+        spdlog::error("Failed to open {}", video);
+        return false;
+    }
+
+    spdlog::info("Processing {}", video);
+    int frame_idx = 0;
+    cv::Mat frame;
+    // Frames of the current batch, with their decode and preprocess times
+    std::vector<cv::Mat> rgb_frames(options.frame_batch);
+    std::vector<double> decode_ms(options.frame_batch);
+    std::vector<double> preprocess_ms(options.frame_batch);
+    std::vector<mukham::FaceDetections> batch_detections;
+    std::vector<cv::Rect2d> rois;
+    std::vector<std::vector<cv::Point2d>> landmarks;
+    mukham::RoiTracker tracker(options.tracking);
+    mukham::FaceTracker face_tracker;
+    std::vector<int> face_ids;
+    mukham::MotionGate motion_gate(options.motion);
+
+    bool end_of_video = false;
+    while (!end_of_video) {
+        size_t nb_frames = 0;
+        while (nb_frames < options.frame_batch) {
+            auto decode_start = mukham::Clock::now();
+            if (!capture.read(frame) || frame.empty()) {
+                end_of_video = true;
+                break;
+            }
+            auto decode_end = mukham::Clock::now();
+
+            auto& rgb_frame = rgb_frames[nb_frames];
+            cv::cvtColor(frame, rgb_frame, cv::COLOR_BGR2RGB);
+            if (options.scale != 1.0) {
+                cv::resize(rgb_frame, rgb_frame, cv::Size(0, 0),
+                           options.scale, options.scale, cv::INTER_LINEAR);
+            }
+            auto preprocess_end = mukham::Clock::now();
+
+            decode_ms[nb_frames] = mukham::ElapsedMs(decode_start, decode_end);
+            preprocess_ms[nb_frames] =
+                mukham::ElapsedMs(decode_end, preprocess_end);
+            nb_frames++;
+        }
+        if (nb_frames == 0) break;
+
+        // A static frame reuses the detections, IDs and landmarks of the
+        // last processed frame, which are still in the buffers
+        if (options.motion_gate && motion_gate.IsStatic(rgb_frames[0]) &&
+            frame_idx > 0) {
+            stats.decode.Add(decode_ms[0]);
+            stats.preprocess.Add(preprocess_ms[0]);
+            stats.detect.Add(0.0);
+            stats.landmark.Add(0.0);
+            stats.total.Add(decode_ms[0] + preprocess_ms[0]);
+            stats.nb_faces += batch_detections[0].faces.size();
+
+            WriteFrame(out, video, frame_idx, batch_detections[0], face_ids,
+                       landmarks);
+            frame_idx++;
+            continue;
+        }
+
+        auto detect_start = mukham::Clock::now();
+        const bool is_keyframe = !options.track || tracker.NeedsDetection();
+        if (!is_keyframe) {
+            batch_detections.resize(1);
+            tracker.PredictFaces(batch_detections[0].faces);
+            batch_detections[0].keypoints.clear();
+        } else if (options.tiles.NumTiles() > 1) {
+            batch_detections.resize(1);
+            models.DetectFaces(options.detector, rgb_frames[0], options.tiles,
+                               batch_detections[0]);
+        } else if (nb_frames == rgb_frames.size()) {
+            models.DetectFaces(options.detector, rgb_frames, batch_detections);
+        } else {
+            std::vector<cv::Mat> last_frames(rgb_frames.begin(),
+                                             rgb_frames.begin() + nb_frames);
+            models.DetectFaces(options.detector, last_frames,
+                               batch_detections);
+        }
+        // The batch runs as one inference, its time is shared by the frames
+        auto detect_ms =
+            mukham::ElapsedMs(detect_start, mukham::Clock::now()) / nb_frames;
+        if (is_keyframe) stats.detector_runs += nb_frames;
+
+        for (size_t idx = 0; idx < nb_frames; ++idx) {
+            auto& rgb_frame = rgb_frames[idx];
+            const auto& detections = batch_detections[idx];
+
+            auto landmark_start = mukham::Clock::now();
+            landmarks.clear();
+            if (options.landmarks != mukham::LandmarkModelType::None) {
+                rois.clear();
+                for (const auto& face : detections.faces) {
+                    rois.push_back(mukham::GetLandmarkRoi(
+                        face, options.roi_scale, rgb_frame.size()));
+                }
+
+                if (landmark_pool &&
+                    models.GetLandmarkBatchSize(options.landmarks) == 1) {
+                    landmark_pool->DetectLandmarks(options.landmarks,
+                                                   rgb_frame, rois, landmarks);
+                } else {
+                    models.DetectLandmarks(options.landmarks, rgb_frame, rois,
+                                           landmarks);
+                }
+            }
+            auto landmark_ms =
+                mukham::ElapsedMs(landmark_start, mukham::Clock::now());
+            if (options.track)
+                tracker.Update(landmarks, is_keyframe, rgb_frame.size());
+
+            stats.decode.Add(decode_ms[idx]);
+            stats.preprocess.Add(preprocess_ms[idx]);
+            stats.detect.Add(detect_ms);
+            stats.landmark.Add(landmark_ms);
+            stats.total.Add(decode_ms[idx] + preprocess_ms[idx] + detect_ms +
+                            landmark_ms);
+            stats.nb_faces += detections.faces.size();
+
+            face_tracker.Update(detections.faces, face_ids);
+            WriteFrame(out, video, frame_idx, detections, face_ids,
+                       landmarks);
+            frame_idx++;
+        }
+    }
+
+    if (options.motion_gate) {
+        stats.motion.frames += motion_gate.GetStats().frames;
+        stats.motion.static_frames += motion_gate.GetStats().static_frames;
+    }
+
+    spdlog::info("{}: {} frames", video, frame_idx);
+    return true;
+}
+
+// Frame N+1 is decoded, converted and submitted to the detector while frame
+// N runs, the landmarks of frame N then overlap with the inference of N+1
+bool ProcessVideoAsync(const std::string& video, const BatchOptions& options,
+                       mukham::FaceModels& models, std::ofstream& out,
+                       BatchStats& stats) {
+    cv::VideoCapture capture;
+    if (!capture.open(video)) {
+        spdlog::error("Failed to open {}", video);
+        return false;
+    }
+
+    struct SubmittedFrame {
+        cv::Mat rgb_frame;
+        double decode_ms;
+        double preprocess_ms;
+        mukham::Clock::time_point submit_time;
+    };
+    std::deque<SubmittedFrame> in_flight;
+    const size_t frames_ahead = 2;
+
+    spdlog::info("Processing {}", video);
+    int frame_idx = 0;
+    cv::Mat frame;
+    mukham::FaceDetections detections;
+    std::vector<cv::Rect2d> rois;
+    std::vector<std::vector<cv::Point2d>> landmarks;
+    mukham::FaceTracker face_tracker;
+    std::vector<int> face_ids;
+
+    bool end_of_video = false;
+    while (!end_of_video || !in_flight.empty()) {
+        if (!end_of_video) {
+            auto decode_start = mukham::Clock::now();
+            if (!capture.read(frame) || frame.empty()) {
+                end_of_video = true;
+            } else {
+                auto decode_end = mukham::Clock::now();
+                SubmittedFrame submitted;
+                cv::cvtColor(frame, submitted.rgb_frame, cv::COLOR_BGR2RGB);
+                if (options.scale != 1.0) {
+                    cv::resize(submitted.rgb_frame, submitted.rgb_frame,
+                               cv::Size(0, 0), options.scale, options.scale,
+                               cv::INTER_LINEAR);
+                }
+                submitted.submit_time = mukham::Clock::now();
+                submitted.decode_ms =
+                    mukham::ElapsedMs(decode_start, decode_end);
+                submitted.preprocess_ms =
+                    mukham::ElapsedMs(decode_end, submitted.submit_time);
+
+                if (!models.SubmitFaceDetection(options.detector,
+                                                submitted.rgb_frame)) {
+                    spdlog::error("Failed to submit frame {}",
+                                  frame_idx + in_flight.size());
+                    // Complete the frames still queued so that the detector
+                    // is idle for the next video
+                    for (size_t idx = 0; idx < in_flight.size(); ++idx)
+                        models.CompleteFaceDetection(options.detector,
+                                                     detections);
+                    return false;
+                }
+                in_flight.push_back(std::move(submitted));
+                if (in_flight.size() < frames_ahead) continue;
+            }
+        }
+        if (in_flight.empty()) break;
+
+        auto& current = in_flight.front();
+        if (!models.CompleteFaceDetection(options.detector, detections)) {
+            // The frame is written without faces rather than with the
+            // detections of the previous one
+            spdlog::warn("Failed to detect the faces of frame {}", frame_idx);
+            detections = mukham::FaceDetections();
+        }
+        // From the submission, the overlapped part included
+        auto detect_ms =
+            mukham::ElapsedMs(current.submit_time, mukham::Clock::now());
+        stats.detector_runs++;
+
+        auto landmark_start = mukham::Clock::now();
+        landmarks.clear();
+        if (options.landmarks != mukham::LandmarkModelType::None) {
+            rois.clear();
+            for (const auto& face : detections.faces) {
+                rois.push_back(mukham::GetLandmarkRoi(
+                    face, options.roi_scale, current.rgb_frame.size()));
+            }
+            models.DetectLandmarks(options.landmarks, current.rgb_frame, rois,
+                                   landmarks);
+        }
+        auto landmark_ms =
+            mukham::ElapsedMs(landmark_start, mukham::Clock::now());
+
+        stats.decode.Add(current.decode_ms);
+        stats.preprocess.Add(current.preprocess_ms);
+        stats.detect.Add(detect_ms);
+        stats.landmark.Add(landmark_ms);
+        stats.total.Add(current.decode_ms + current.preprocess_ms +
+                        detect_ms + landmark_ms);
+        stats.nb_faces += detections.faces.size();
+
+        face_tracker.Update(detections.faces, face_ids);
+        WriteFrame(out, video, frame_idx, detections, face_ids, landmarks);
+        frame_idx++;
+        in_flight.pop_front();
+    }
+
+    spdlog::info("{}: {} frames", video, frame_idx);
+    return true;
+}
+
+bool ProcessVideoPipelined(const std::string& video,
+                           const BatchOptions& options,
+                           mukham::FaceModels& models, std::ofstream& out,
+                           BatchStats& stats) {
+    mukham::FramePipeline pipeline(models, options.queue_capacity,
+                                   options.landmark_workers);
+
+    mukham::PipelineSettings settings;
+    settings.detector = options.detector;
+    settings.landmarks = options.landmarks;
+    settings.roi_scale = options.roi_scale;
+    settings.resize_factor = options.scale;
+    settings.tiles = options.tiles;
+    settings.track_faces = options.track;
+    settings.tracking = options.tracking;
+    settings.motion_gate = options.motion_gate;
+    settings.motion = options.motion;
+    pipeline.SetSettings(settings);
+    pipeline.SetBackpressurePolicy(options.policy);
+    pipeline.SetThreadOptions(options.threads);
+
+    // The models are loaded before the videos, so are the copies of the
+    // landmark workers, which only run the per-face models
+    auto landmark_workers = pipeline.GetLandmarkWorkers();
+    if (landmark_workers &&
+        models.GetLandmarkBatchSize(options.landmarks) == 1) {
+        landmark_workers->LoadModel(options.landmarks, models);
+    }
+
+    mukham::VideoSource source;
+    source.file_name = video;
+    source.realtime = options.realtime;
+    if (!pipeline.Start(source)) {
+        spdlog::error("Failed to open {}", video);
+        return false;
+    }
+
+    spdlog::info("Processing {}", video);
+    int frame_idx = 0;
+    mukham::FrameData result;
+    while (pipeline.GetResult(result)) {
+        stats.decode.Add(result.decode_ms);
+        stats.preprocess.Add(result.preprocess_ms);
+        stats.detect.Add(result.detect_ms);
+        stats.landmark.Add(result.landmark_ms);
+        // End to end, including the time spent waiting in the queues
+        stats.total.Add(
+            mukham::ElapsedMs(result.capture_time, mukham::Clock::now()));
+        stats.nb_faces += result.detections.faces.size();
+        if (result.detected) stats.detector_runs++;
+
+        WriteFrame(out, video, (int)result.index, result.detections,
+                   result.face_ids, result.landmarks);
+        frame_idx++;
+    }
+
+    stats.queues = pipeline.GetQueueStats();
+    stats.motion.frames += pipeline.GetMotionGateStats().frames;
+    stats.motion.static_frames += pipeline.GetMotionGateStats().static_frames;
+    const auto dropped = pipeline.GetDroppedFrames();
+    stats.dropped_frames += dropped;
+    pipeline.Stop();
+
+    spdlog::info("{}: {} frames, {} dropped", video, frame_idx, dropped);
+    return true;
+}
+
+bool ProcessVideosMultiStream(const BatchOptions& options,
+                              mukham::FaceModels& models, std::ofstream& out,
+                              BatchStats& stats) {
+    mukham::MultiStreamRunner runner(models, options.queue_capacity);
+
+    mukham::PipelineSettings settings;
+    settings.detector = options.detector;
+    settings.landmarks = options.landmarks;
+    settings.roi_scale = options.roi_scale;
+    settings.resize_factor = options.scale;
+    settings.tiles = options.tiles;
+    settings.track_faces = options.track;
+    settings.tracking = options.tracking;
+    settings.motion_gate = options.motion_gate;
+    settings.motion = options.motion;
+    runner.SetSettings(settings);
+    runner.SetBackpressurePolicy(options.policy);
+
+    // The landmark requests wait as long as the detector ones, up to the
+    // largest batch of the landmark model
+    auto landmark_batching = options.batching;
+    landmark_batching.max_batch_size =
+        models.GetLandmarkBatchSize(options.landmarks);
+    runner.SetBatchingOptions(options.batching, landmark_batching);
+
+    for (const auto& video : options.videos) {
+        mukham::VideoSource source;
+        source.file_name = video;
+        source.realtime = options.realtime;
+        runner.AddStream(source);
+    }
+
+    // Called on the processing threads, one frame at a time
+    auto on_result = [&](size_t stream, mukham::FrameData& result) {
+        stats.decode.Add(result.decode_ms);
+        stats.preprocess.Add(result.preprocess_ms);
+        stats.detect.Add(result.detect_ms);
+        stats.landmark.Add(result.landmark_ms);
+        stats.total.Add(
+            mukham::ElapsedMs(result.capture_time, mukham::Clock::now()));
+        stats.nb_faces += result.detections.faces.size();
+        if (result.detected) stats.detector_runs++;
+
+        WriteFrame(out, options.videos[stream], (int)result.index,
+                   result.detections, result.face_ids, result.landmarks);
+    };
+
+    spdlog::info("Processing {} videos concurrently", options.videos.size());
+    if (!runner.Start(on_result)) return false;
+    runner.Wait();
+
+    stats.streams = runner.GetStreamStats();
+    stats.detector_batches = runner.GetDetectorBatcherStats();
+    stats.landmark_batches = runner.GetLandmarkBatcherStats();
+    for (const auto& stream : stats.streams) {
+        stats.motion.frames += stream.motion.frames;
+        stats.motion.static_frames += stream.motion.static_frames;
+        stats.dropped_frames += stream.dropped_frames;
+    }
+    return true;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    BatchOptions options;
+    if (!ParseArgs(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return -1;
+    }
+
+    mukham::ConfigureProcessThreads(options.threads);
+    // Without the pipeline both models run on this thread
+    if (!options.pipeline)
+        mukham::ConfigureModelThreads(options.threads.detector);
+
+    if (options.profile_runs > 0) return ProfileOperators(options) ? 0 : -1;
+
+    // The executors are created with the models
+    if (options.activation_arena && !mukham::ActivationArena::Enable())
+        return -1;
+
+    mukham::FaceModels models;
+    models.LoadDetector(options.detector);
+    models.LoadLandmarkModel(options.landmarks);
+
+    std::ofstream out(options.output);
+    if (!out) {
+        spdlog::error("Failed to open the output file {}", options.output);
+        return -1;
+    }
+
+    std::unique_ptr<mukham::LandmarkWorkerPool> landmark_pool;
+    // Batched Facemesh runs every face in one inference, see ProcessVideo
+    if (!options.pipeline && options.landmark_workers > 0 &&
+        models.GetLandmarkBatchSize(options.landmarks) == 1) {
+        landmark_pool = std::make_unique<mukham::LandmarkWorkerPool>(
+            options.landmark_workers);
+        landmark_pool->LoadModel(options.landmarks, models);
+    }
+
+    BatchStats stats;
+    // The other videos still run when one fails, the exit code reports it
+    bool success = true;
+    auto start = mukham::Clock::now();
+    if (options.multi_stream) {
+        success = ProcessVideosMultiStream(options, models, out, stats);
+    } else {
+        for (const auto& video : options.videos) {
+            bool processed;
+            if (options.pipeline)
+                processed =
+                    ProcessVideoPipelined(video, options, models, out, stats);
+            else if (options.async_detect)
+                processed =
+                    ProcessVideoAsync(video, options, models, out, stats);
+            else
+                processed = ProcessVideo(video, options, models,
+                                         landmark_pool.get(), out, stats);
+            success = processed && success;
+        }
+    }
+    auto wall_time_ms = mukham::ElapsedMs(start, mukham::Clock::now());
+
+    const auto nb_frames = stats.total.Count();
+    fmt::print("Detector: {}, landmarks: {}\n",
+               mukham::ToString(options.detector),
+               mukham::ToString(options.landmarks));
+    fmt::print("Frames: {}, faces: {}, wall time: {:.1f} ms\n", nb_frames,
+               stats.nb_faces, wall_time_ms);
+    fmt::print("Detector runs: {}\n", stats.detector_runs);
+    if (options.motion_gate) {
+        fmt::print("Motion gate: {} static frames out of {} ({:.1f}%)\n",
+                   stats.motion.static_frames, stats.motion.frames,
+                   stats.motion.HitRate() * 100.0);
+    }
+    if (nb_frames > 0) {
+        fmt::print("Throughput: {:.2f} FPS\n",
+                   nb_frames * 1000.0 / wall_time_ms);
+        fmt::print("Latency per frame:\n");
+        PrintStats("decode", stats.decode);
+        PrintStats("preprocess", stats.preprocess);
+        PrintStats("detect", stats.detect);
+        PrintStats("landmark", stats.landmark);
+        PrintStats("total", stats.total);
+    }
+    if (!stats.streams.empty()) {
+        fmt::print("Streams:\n");
+        for (auto& stream : stats.streams) {
+            fmt::print(
+                "  {}: {} frames, {:.2f} FPS, {} dropped, latency p50 {:.3f}"
+                " ms  p99 {:.3f} ms\n",
+                stream.name, stream.frames, stream.fps, stream.dropped_frames,
+                stream.latency.Percentile(50), stream.latency.Percentile(99));
+        }
+    }
+    PrintBatcherStats("Detector", stats.detector_batches);
+    PrintBatcherStats("Landmark", stats.landmark_batches);
+    if (options.pipeline || options.multi_stream) {
+        fmt::print("Backpressure policy: {}, dropped frames: {}\n",
+                   mukham::ToString(options.policy), stats.dropped_frames);
+    }
+    if (!stats.queues.empty()) {
+        fmt::print("Pipeline queues (last video):\n");
+        for (const auto& queue : stats.queues) {
+            fmt::print("  {:<12} capacity {}  push stalls {}  pop stalls {}\n",
+                       queue.name, queue.stats.capacity,
+                       queue.stats.push_stalls, queue.stats.pop_stalls);
+        }
+    }
+    const auto memory = mukham::GetMemoryUsage();
+    fmt::print("Memory: resident {:.1f} MB, peak {:.1f} MB, TVM modules {}\n",
+               memory.ResidentMB(), memory.PeakResidentMB(),
+               mukham::TvmModel::NumLoadedModels());
+    if (options.activation_arena) {
+        const auto arena = mukham::ActivationArena::GetStats();
+        fmt::print("Activation arena: {} executors, requested {:.1f} MB,"
+                   " arena {:.1f} MB, saved {:.1f} MB\n",
+                   arena.executors, arena.requested_bytes / 1048576.0,
+                   arena.arena_bytes / 1048576.0,
+                   arena.SavedBytes() / 1048576.0);
+    }
+    fmt::print("Detections written to {}\n", options.output);
+
+    return success ? 0 : -1;
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace tvm_blazeface {
+
+struct SSDOptions {
+    int num_layers;
+    double min_scale;
+    double max_scale;
+    int input_size_height;
+    int input_size_width;
+    double anchor_offset_x;
+    double anchor_offset_y;
+    std::array<int, 4> strides;
+    double aspect_ratios;
+    bool fixed_anchor_size;
+    // An extra anchor per layer and location when positive
+    double interpolated_scale_aspect_ratio;
+};
+
+struct TensorToBoxesOptions {
+    int num_classes;
+    int num_boxes;
+    int num_coords;
+    int box_coord_offset;
+    int keypoint_coord_offset;
+    int num_keypoints;
+    int num_values_per_keypoint;
+    bool sigmoid_score;
+    double score_clipping_thresh;
+    bool reverse_output_order;
+    double x_scale;
+    double y_scale;
+    double h_scale;
+    double w_scale;
+    double min_score_thresh;
+};
+
+// Anchor centres, stored as separate arrays so that the decoder reads them
+// with unit stride
+template <size_t N>
+struct AnchorArray {
+    std::array<float, N> x_center{};
+    std::array<float, N> y_center{};
+
+    static constexpr size_t size() { return N; }
+};
+
+// Walks the SSD anchor layout of MediaPipe, calling add(x, y) for every
+// anchor. Layers sharing a stride are merged into one feature map.
+template <typename AddAnchor>
+constexpr void ForEachAnchor(const SSDOptions& options, AddAnchor&& add) {
+    const int anchors_per_layer =
+        1 + (options.interpolated_scale_aspect_ratio > 0.0 ? 1 : 0);
+
+    int layer_id = 0;
+    while (layer_id < options.num_layers) {
+        int last_same_stride_layer = layer_id;
+        int repeats = 0;
+        while (last_same_stride_layer < options.num_layers &&
+               options.strides[last_same_stride_layer] ==
+                   options.strides[layer_id]) {
+            last_same_stride_layer += 1;
+            repeats += anchors_per_layer;
+        }
+
+        const int stride = options.strides[layer_id];
+        const int feature_map_height = options.input_size_height / stride;
+        const int feature_map_width = options.input_size_width / stride;
+
+        for (int y = 0; y < feature_map_height; y++) {
+            const double y_center =
+                (y + options.anchor_offset_y) / feature_map_height;
+            for (int x = 0; x < feature_map_width; x++) {
+                const double x_center =
+                    (x + options.anchor_offset_x) / feature_map_width;
+                for (int r = 0; r < repeats; r++) {
+                    add(x_center, y_center);
+                }
+            }
+        }
+
+        layer_id = last_same_stride_layer;
+    }
+}
+
+constexpr int CountAnchors(const SSDOptions& options) {
+    int count = 0;
+    ForEachAnchor(options, [&count](double, double) { count++; });
+    return count;
+}
+
+template <size_t N>
+constexpr AnchorArray<N> MakeAnchors(const SSDOptions& options) {
+    AnchorArray<N> anchors;
+    size_t idx = 0;
+    ForEachAnchor(options, [&](double x_center, double y_center) {
+        anchors.x_center[idx] = (float)x_center;
+        anchors.y_center[idx] = (float)y_center;
+        idx++;
+    });
+    return anchors;
+}
+
+// Blazeface variants, see the descriptors below
+enum class BlazefaceModel : int {
+    Front = 0,
+    ShortRange = 1,
+    FullRange = 2,
+};
+
+// face_detection_front: 128x128 input, 896 anchors
+struct FrontModel {
+    static constexpr BlazefaceModel type = BlazefaceModel::Front;
+    static constexpr const char* file_stem = "face_detection_front";
+    static constexpr const char* input_name = "input";
+    static constexpr double min_suppression_threshold = 0.3;
+
+    static constexpr SSDOptions anchor_options = {
+        /* .num_layers = */ 4,
+        /* .min_scale = */ 0.1484375,
+        /* .max_scale = */ 0.75,
+        /* .input_size_height = */ 128,
+        /* .input_size_width = */ 128,
+        /* .anchor_offset_x = */ 0.5,
+        /* .anchor_offset_y = */ 0.5,
+        /* .strides = */ {8, 16, 16, 16},
+        /* .aspect_ratios = */ 1.0,
+        /* .fixed_anchor_size = */ true,
+        /* .interpolated_scale_aspect_ratio = */ 1.0};
+
+    static constexpr TensorToBoxesOptions box_options = {
+        /* .num_classes = */ 1,
+        /* .num_boxes = */ 896,
+        /* .num_coords = */ 16,
+        /* .box_coord_offset = */ 0,
+        /* .keypoint_coord_offset = */ 4,
+        /* .num_keypoints = */ 6,
+        /* .num_values_per_keypoint = */ 2,
+        /* .sigmoid_score = */ true,
+        /* .score_clipping_thresh = */ 80.0,
+        /* .reverse_output_order = */ true,
+        /* .x_scale = */ 128.0,
+        /* .y_scale = */ 128.0,
+        /* .h_scale = */ 128.0,
+        /* .w_scale = */ 128.0,
+        /* .min_score_thresh = */ 0.5};
+};
+
+// face_detection_short_range: the successor of the front model, same layout
+struct ShortRangeModel : FrontModel {
+    static constexpr BlazefaceModel type = BlazefaceModel::ShortRange;
+    static constexpr const char* file_stem = "face_detection_short_range";
+
+    static constexpr TensorToBoxesOptions box_options = {
+        /* .num_classes = */ 1,
+        /* .num_boxes = */ 896,
+        /* .num_coords = */ 16,
+        /* .box_coord_offset = */ 0,
+        /* .keypoint_coord_offset = */ 4,
+        /* .num_keypoints = */ 6,
+        /* .num_values_per_keypoint = */ 2,
+        /* .sigmoid_score = */ true,
+        /* .score_clipping_thresh = */ 100.0,
+        /* .reverse_output_order = */ true,
+        /* .x_scale = */ 128.0,
+        /* .y_scale = */ 128.0,
+        /* .h_scale = */ 128.0,
+        /* .w_scale = */ 128.0,
+        /* .min_score_thresh = */ 0.5};
+};
+
+// face_detection_full_range: 192x192 input, 2304 anchors, for faces up to
+// about five meters from the camera
+struct FullRangeModel {
+    static constexpr BlazefaceModel type = BlazefaceModel::FullRange;
+    static constexpr const char* file_stem = "face_detection_full_range";
+    static constexpr const char* input_name = "input";
+    static constexpr double min_suppression_threshold = 0.3;
+
+    static constexpr SSDOptions anchor_options = {
+        /* .num_layers = */ 1,
+        /* .min_scale = */ 0.1484375,
+        /* .max_scale = */ 0.75,
+        /* .input_size_height = */ 192,
+        /* .input_size_width = */ 192,
+        /* .anchor_offset_x = */ 0.5,
+        /* .anchor_offset_y = */ 0.5,
+        /* .strides = */ {4, 0, 0, 0},
+        /* .aspect_ratios = */ 1.0,
+        /* .fixed_anchor_size = */ true,
+        /* .interpolated_scale_aspect_ratio = */ 0.0};
+
+    static constexpr TensorToBoxesOptions box_options = {
+        /* .num_classes = */ 1,
+        /* .num_boxes = */ 2304,
+        /* .num_coords = */ 16,
+        /* .box_coord_offset = */ 0,
+        /* .keypoint_coord_offset = */ 4,
+        /* .num_keypoints = */ 6,
+        /* .num_values_per_keypoint = */ 2,
+        /* .sigmoid_score = */ true,
+        /* .score_clipping_thresh = */ 100.0,
+        /* .reverse_output_order = */ true,
+        /* .x_scale = */ 192.0,
+        /* .y_scale = */ 192.0,
+        /* .h_scale = */ 192.0,
+        /* .w_scale = */ 192.0,
+        /* .min_score_thresh = */ 0.6};
+};
+
+// Anchors of a model descriptor, generated at compile time
+template <typename Model>
+struct ModelAnchors {
+    static constexpr int count = CountAnchors(Model::anchor_options);
+    static_assert(count == Model::box_options.num_boxes,
+                  "The anchor layout does not match the number of boxes");
+
+    static constexpr AnchorArray<count> anchors =
+        MakeAnchors<count>(Model::anchor_options);
+};
+
+constexpr const char* GetModelFileStem(BlazefaceModel model) {
+    switch (model) {
+        case BlazefaceModel::Front:
+            return FrontModel::file_stem;
+        case BlazefaceModel::ShortRange:
+            return ShortRangeModel::file_stem;
+        case BlazefaceModel::FullRange:
+            return FullRangeModel::file_stem;
+    }
+    return FrontModel::file_stem;
+}
+}  // namespace tvm_blazeface
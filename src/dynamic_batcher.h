@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "latency_stats.h"
+
+namespace mukham {
+
+struct DynamicBatcherOptions {
+    // Largest number of requests run together, the largest compiled batch
+    // size of the model
+    size_t max_batch_size = 8;
+    // Time the first request of a batch waits for others to join it
+    double max_delay_ms = 2.0;
+};
+
+struct BatcherStats {
+    uint64_t requests = 0;
+    uint64_t batches = 0;
+    // Number of batches of each size, indexed by batch size
+    std::vector<uint64_t> batch_sizes;
+    // From Submit to the start of the batch the request is part of
+    LatencyStats queue_delay;
+
+    double MeanBatchSize() const {
+        return batches > 0 ? (double)requests / batches : 0.0;
+    }
+};
+
+/**
+ * Gathers the requests submitted by several threads into batches.
+ *
+ * A batch is run as soon as it holds max_batch_size requests, or when its
+ * oldest request has waited max_delay_ms, whichever comes first. Batches are
+ * run one at a time on the batcher's own thread, so the batch function owns
+ * its model and does not need to be thread safe. Every request gets its
+ * result through the future returned by Submit, an exception thrown by the
+ * batch function is forwarded to all the requests of the batch.
+ *
+ * The batch function receives the requests and must fill one result per
+ * request, in the same order.
+ */
+template <typename Request, typename Result>
+class DynamicBatcher {
+   public:
+    using BatchFunction = std::function<void(std::vector<Request>& requests,
+                                             std::vector<Result>& results)>;
+
+    explicit DynamicBatcher(
+        BatchFunction batch_function,
+        const DynamicBatcherOptions& options = DynamicBatcherOptions())
+        : run_batch(std::move(batch_function)), options(options) {
+        if (this->options.max_batch_size == 0)
+            this->options.max_batch_size = 1;
+        worker = std::thread(&DynamicBatcher::_batch_loop, this);
+    }
+
+    ~DynamicBatcher() { Stop(); }
+
+    DynamicBatcher(const DynamicBatcher&) = delete;
+    DynamicBatcher& operator=(const DynamicBatcher&) = delete;
+
+    std::future<Result> Submit(Request request) {
+        std::promise<Result> promise;
+        auto result = promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopped) {
+                promise.set_exception(std::make_exception_ptr(
+                    std::runtime_error("The batcher is stopped")));
+                return result;
+            }
+            pending.push_back(
+                {std::move(request), std::move(promise), Clock::now()});
+        }
+        request_added.notify_one();
+        return result;
+    }
+
+    // Runs the pending requests and joins the batcher thread
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        request_added.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    void SetOptions(const DynamicBatcherOptions& new_options) {
+        std::lock_guard<std::mutex> lock(mutex);
+        options = new_options;
+        if (options.max_batch_size == 0) options.max_batch_size = 1;
+    }
+
+    BatcherStats GetStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    void ResetStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats = BatcherStats();
+    }
+
+   private:
+    struct PendingRequest {
+        Request request;
+        std::promise<Result> promise;
+        Clock::time_point submit_time;
+    };
+
+    // Blocks until a batch is due, false once stopped and drained
+    bool _next_batch(std::vector<PendingRequest>& batch) {
+        std::unique_lock<std::mutex> lock(mutex);
+        request_added.wait(lock,
+                           [this] { return stopped || !pending.empty(); });
+        if (pending.empty()) return false;
+
+        const auto deadline =
+            pending.front().submit_time +
+            std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double, std::milli>(
+                    options.max_delay_ms));
+        request_added.wait_until(lock, deadline, [this] {
+            return stopped || pending.size() >= options.max_batch_size;
+        });
+
+        const auto now = Clock::now();
+        const size_t batch_size = (std::min)(pending.size(),
+                                             options.max_batch_size);
+        for (size_t idx = 0; idx < batch_size; ++idx) {
+            stats.queue_delay.Add(ElapsedMs(pending.front().submit_time, now));
+            batch.push_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+
+        stats.requests += batch_size;
+        stats.batches++;
+        if (stats.batch_sizes.size() <= batch_size)
+            stats.batch_sizes.resize(batch_size + 1, 0);
+        stats.batch_sizes[batch_size]++;
+        return true;
+    }
+
+    void _batch_loop() {
+        std::vector<PendingRequest> batch;
+        std::vector<Request> requests;
+        std::vector<Result> results;
+        while (_next_batch(batch)) {
+            requests.clear();
+            for (auto& item : batch) {
+                requests.push_back(std::move(item.request));
+            }
+            results.clear();
+
+            std::exception_ptr error;
+            try {
+                run_batch(requests, results);
+                if (results.size() != batch.size())
+                    throw std::runtime_error("Missing batch results");
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            for (size_t idx = 0; idx < batch.size(); ++idx) {
+                if (error)
+                    batch[idx].promise.set_exception(error);
+                else
+                    batch[idx].promise.set_value(std::move(results[idx]));
+            }
+            batch.clear();
+        }
+    }
+
+    BatchFunction run_batch;
+
+    std::mutex mutex;
+    std::condition_variable request_added;
+    DynamicBatcherOptions options;
+    std::deque<PendingRequest> pending;
+    BatcherStats stats;
+    bool stopped = false;
+
+    std::thread worker;
+};
+}  // namespace mukham
@@ -0,0 +1,512 @@
+#include "face_models.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "spdlog/spdlog.h"
+
+namespace mukham {
+
+// Compiled Facemesh batch sizes, the missing ones are skipped when loading
+static const std::vector<int> facemesh_batch_sizes = {1, 4, 8};
+
+// Compiled Blazeface batch sizes, for DetectFaces over several frames
+static const std::vector<int> blazeface_batch_sizes = {1, 4, 8};
+
+static void ToFaceDetections(const tvm_blazeface::DetectionsVec& blazeface,
+                             FaceDetections& detections) {
+    detections.faces.clear();
+    detections.keypoints.clear();
+    for (const auto& d : blazeface) {
+        detections.faces.push_back(d.bounding_box);
+        for (const auto& k : d.key_points) {
+            detections.keypoints.push_back(k);
+        }
+    }
+}
+
+static void ToFrameLandmarks(const tvm_facemesh::TVM_FacemeshResult& result,
+                             const cv::Rect2d& roi,
+                             std::vector<cv::Point2d>& landmarks) {
+    landmarks.clear();
+    if (!result.has_face) {
+        spdlog::debug("No face. face score {}", result.face_score);
+        return;
+    }
+    for (auto& point : result.mesh) {
+        landmarks.push_back(cv::Point2d(roi.x + point.x, roi.y + point.y));
+    }
+}
+
+static cv::Mat CropRoi(const cv::Mat& image, const cv::Rect2d& roi) {
+    return image(cv::Range(roi.y, roi.y + roi.height),
+                 cv::Range(roi.x, roi.x + roi.width));
+}
+
+fs::path GetFacemeshModelPath() {
+    auto cwd = fs::current_path();
+#ifdef _WIN32
+    return cwd / "models/facemesh/face_landmark.dll";
+#else
+    return cwd / fs::path(std::string("models/facemesh/face_landmark.so"));
+#endif
+}
+
+fs::path GetBlazefaceModelPath(tvm_blazeface::BlazefaceModel model) {
+    auto model_path = fs::current_path() / "models/blazeface" /
+                      tvm_blazeface::GetModelFileStem(model);
+#ifdef _WIN32
+    return model_path.replace_extension(".dll");
+#else
+    return model_path.replace_extension(".so");
+#endif
+}
+
+const char* ToString(FaceDetectorType type) {
+    switch (type) {
+        case FaceDetectorType::DlibHog:
+            return "dlib-hog";
+        case FaceDetectorType::OpenCVLBP:
+            return "opencv-lbp";
+        case FaceDetectorType::OpenCVTF:
+            return "opencv-tf";
+        case FaceDetectorType::Blazeface:
+            return "blazeface";
+        case FaceDetectorType::BlazefaceFullRange:
+            return "blazeface-full";
+    }
+    return "unknown";
+}
+
+const char* ToString(LandmarkModelType type) {
+    switch (type) {
+        case LandmarkModelType::None:
+            return "none";
+        case LandmarkModelType::Dlib:
+            return "dlib";
+        case LandmarkModelType::Facemesh:
+            return "facemesh";
+    }
+    return "unknown";
+}
+
+bool ParseFaceDetectorType(const std::string& name, FaceDetectorType& type) {
+    for (auto candidate :
+         {FaceDetectorType::DlibHog, FaceDetectorType::OpenCVLBP,
+          FaceDetectorType::OpenCVTF, FaceDetectorType::Blazeface,
+          FaceDetectorType::BlazefaceFullRange}) {
+        if (name == ToString(candidate)) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParseLandmarkModelType(const std::string& name, LandmarkModelType& type) {
+    for (auto candidate : {LandmarkModelType::None, LandmarkModelType::Dlib,
+                           LandmarkModelType::Facemesh}) {
+        if (name == ToString(candidate)) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+cv::Rect2d GetLandmarkRoi(const cv::Rect2d& face, double roi_scale,
+                          const cv::Size& frame_size) {
+    auto face_center_x = face.x + (face.width * 0.5);
+    auto face_center_y = face.y + (face.height * 0.5);
+
+    auto start_row = face_center_y - roi_scale * (face.height * 0.5);
+    start_row = (std::max)(0.0, start_row);
+
+    auto start_col = face_center_x - roi_scale * (face.width * 0.5);
+    start_col = (std::max)(0.0, start_col);
+
+    auto end_row = face_center_y + roi_scale * (face.height * 0.5);
+    end_row = (std::min)(end_row, (double)frame_size.height);
+
+    auto end_col = face_center_x + roi_scale * (face.width * 0.5);
+    end_col = (std::min)(end_col, (double)frame_size.width);
+
+    return cv::Rect2d(start_col, start_row, (end_col - start_col),
+                      (end_row - start_row));
+}
+
+void FaceModels::LoadDetector(FaceDetectorType type) {
+    if (IsDetectorLoaded(type)) return;
+
+    // Constructed before being published, a thread running the other models
+    // is not blocked by the loading
+    switch (type) {
+        case FaceDetectorType::DlibHog:
+            spdlog::info("Loading dlib model");
+            std::atomic_store(
+                &dlib_hog_face_detector,
+                std::make_shared<dlib_facedetect::DlibFaceDetectHog>());
+            break;
+        case FaceDetectorType::OpenCVLBP:
+            spdlog::info("Loading opencv model");
+            std::atomic_store(
+                &opencv_lbp_face_detector,
+                std::make_shared<opencv_facedetect::OpenCVFaceDetectLBP>());
+            break;
+        case FaceDetectorType::OpenCVTF:
+            spdlog::info("Loading opencv dnn model");
+            std::atomic_store(
+                &opencv_tf_face_detector,
+                std::make_shared<opencv_facedetect::OpenCVFaceDetectTF>());
+            break;
+        case FaceDetectorType::Blazeface: {
+            spdlog::info("Loading Blazeface model");
+            auto model_path = GetBlazefaceModelPath();
+            std::atomic_store(
+                &blazeface_face_detector,
+                std::make_shared<tvm_blazeface::TVM_Blazeface>(
+                    model_path, tvm_blazeface::BlazefaceModel::Front,
+                    blazeface_batch_sizes));
+        } break;
+        case FaceDetectorType::BlazefaceFullRange: {
+            spdlog::info("Loading Blazeface full range model");
+            const auto model = tvm_blazeface::BlazefaceModel::FullRange;
+            std::atomic_store(
+                &blazeface_full_range_detector,
+                std::make_shared<tvm_blazeface::TVM_Blazeface>(
+                    GetBlazefaceModelPath(model), model,
+                    blazeface_batch_sizes));
+        } break;
+    }
+}
+
+void FaceModels::LoadLandmarkModel(LandmarkModelType type) {
+    if (type == LandmarkModelType::None || IsLandmarkModelLoaded(type))
+        return;
+
+    switch (type) {
+        case LandmarkModelType::None:
+            break;
+        case LandmarkModelType::Dlib:
+            spdlog::info("Loading dlib landmarks model");
+            std::atomic_store(
+                &dlib_landmarks_detector,
+                std::make_shared<dlib_facedetect::DlibFaceLandmarks>());
+            break;
+        case LandmarkModelType::Facemesh:
+            spdlog::info("Loading facemesh model");
+            std::atomic_store(&face_mesh_detector,
+                              std::make_shared<tvm_facemesh::TVM_Facemesh>(
+                                  GetFacemeshModelPath(),
+                                  facemesh_batch_sizes));
+            break;
+    }
+}
+
+void FaceModels::LoadAll() {
+    LoadLandmarkModel(LandmarkModelType::Facemesh);
+    LoadDetector(FaceDetectorType::DlibHog);
+    LoadDetector(FaceDetectorType::OpenCVLBP);
+    LoadDetector(FaceDetectorType::OpenCVTF);
+    LoadDetector(FaceDetectorType::Blazeface);
+    LoadDetector(FaceDetectorType::BlazefaceFullRange);
+    LoadLandmarkModel(LandmarkModelType::Dlib);
+}
+
+template <typename Model>
+static void MoveModel(std::shared_ptr<Model>& model,
+                      std::shared_ptr<Model>& other) {
+    std::atomic_store(&model,
+                      std::atomic_exchange(&other, std::shared_ptr<Model>()));
+}
+
+template <typename Model>
+static void ResetModel(std::shared_ptr<Model>& model) {
+    std::atomic_store(&model, std::shared_ptr<Model>());
+}
+
+void FaceModels::TakeDetector(FaceDetectorType type, FaceModels& other) {
+    switch (type) {
+        case FaceDetectorType::DlibHog:
+            MoveModel(dlib_hog_face_detector, other.dlib_hog_face_detector);
+            break;
+        case FaceDetectorType::OpenCVLBP:
+            MoveModel(opencv_lbp_face_detector,
+                      other.opencv_lbp_face_detector);
+            break;
+        case FaceDetectorType::OpenCVTF:
+            MoveModel(opencv_tf_face_detector, other.opencv_tf_face_detector);
+            break;
+        case FaceDetectorType::Blazeface:
+            MoveModel(blazeface_face_detector, other.blazeface_face_detector);
+            break;
+        case FaceDetectorType::BlazefaceFullRange:
+            MoveModel(blazeface_full_range_detector,
+                      other.blazeface_full_range_detector);
+            break;
+    }
+}
+
+void FaceModels::TakeLandmarkModel(LandmarkModelType type, FaceModels& other) {
+    switch (type) {
+        case LandmarkModelType::None:
+            break;
+        case LandmarkModelType::Dlib:
+            MoveModel(dlib_landmarks_detector, other.dlib_landmarks_detector);
+            break;
+        case LandmarkModelType::Facemesh:
+            MoveModel(face_mesh_detector, other.face_mesh_detector);
+            break;
+    }
+}
+
+bool FaceModels::ShareLandmarkModel(LandmarkModelType type,
+                                    const FaceModels& other) {
+    if (!CanShareLandmarkModel(type)) return false;
+    auto model = std::atomic_load(&other.dlib_landmarks_detector);
+    if (!model) return false;
+    std::atomic_store(&dlib_landmarks_detector, model);
+    return true;
+}
+
+bool FaceModels::CanShareLandmarkModel(LandmarkModelType type) {
+    return type == LandmarkModelType::Dlib;
+}
+
+void FaceModels::UnloadDetector(FaceDetectorType type) {
+    switch (type) {
+        case FaceDetectorType::DlibHog:
+            ResetModel(dlib_hog_face_detector);
+            break;
+        case FaceDetectorType::OpenCVLBP:
+            ResetModel(opencv_lbp_face_detector);
+            break;
+        case FaceDetectorType::OpenCVTF:
+            ResetModel(opencv_tf_face_detector);
+            break;
+        case FaceDetectorType::Blazeface:
+            ResetModel(blazeface_face_detector);
+            break;
+        case FaceDetectorType::BlazefaceFullRange:
+            ResetModel(blazeface_full_range_detector);
+            break;
+    }
+}
+
+void FaceModels::UnloadLandmarkModel(LandmarkModelType type) {
+    switch (type) {
+        case LandmarkModelType::None:
+            break;
+        case LandmarkModelType::Dlib:
+            ResetModel(dlib_landmarks_detector);
+            break;
+        case LandmarkModelType::Facemesh:
+            ResetModel(face_mesh_detector);
+            break;
+    }
+}
+
+bool FaceModels::IsDetectorLoaded(FaceDetectorType type) const {
+    switch (type) {
+        case FaceDetectorType::DlibHog:
+            return std::atomic_load(&dlib_hog_face_detector) != nullptr;
+        case FaceDetectorType::OpenCVLBP:
+            return std::atomic_load(&opencv_lbp_face_detector) != nullptr;
+        case FaceDetectorType::OpenCVTF:
+            return std::atomic_load(&opencv_tf_face_detector) != nullptr;
+        case FaceDetectorType::Blazeface:
+            return std::atomic_load(&blazeface_face_detector) != nullptr;
+        case FaceDetectorType::BlazefaceFullRange:
+            return std::atomic_load(&blazeface_full_range_detector) !=
+                   nullptr;
+    }
+    return false;
+}
+
+bool FaceModels::IsLandmarkModelLoaded(LandmarkModelType type) const {
+    switch (type) {
+        case LandmarkModelType::None:
+            return false;
+        case LandmarkModelType::Dlib:
+            return std::atomic_load(&dlib_landmarks_detector) != nullptr;
+        case LandmarkModelType::Facemesh:
+            return std::atomic_load(&face_mesh_detector) != nullptr;
+    }
+    return false;
+}
+
+bool FaceModels::DetectFaces(FaceDetectorType type, cv::Mat& image,
+                             FaceDetections& detections) {
+    detections.faces.clear();
+    detections.keypoints.clear();
+
+    switch (type) {
+        case FaceDetectorType::DlibHog: {
+            auto detector = std::atomic_load(&dlib_hog_face_detector);
+            if (!detector) return false;
+            detections.faces = detector->DetectFace(image);
+        } break;
+        case FaceDetectorType::OpenCVLBP: {
+            auto detector = std::atomic_load(&opencv_lbp_face_detector);
+            if (!detector) return false;
+            detections.faces = detector->DetectFace(image);
+        } break;
+        case FaceDetectorType::OpenCVTF: {
+            auto detector = std::atomic_load(&opencv_tf_face_detector);
+            if (!detector) return false;
+            detections.faces = detector->DetectFace(image);
+        } break;
+        case FaceDetectorType::Blazeface:
+        case FaceDetectorType::BlazefaceFullRange: {
+            auto detector = _blazeface_detector(type);
+            if (!detector) return false;
+            ToFaceDetections(detector->DetectFace(image), detections);
+        } break;
+    }
+
+    return true;
+}
+
+bool FaceModels::DetectFaces(FaceDetectorType type, cv::Mat& image,
+                             const tvm_blazeface::TileOptions& tiles,
+                             FaceDetections& detections) {
+    if (tiles.NumTiles() <= 1 || (type != FaceDetectorType::Blazeface &&
+                                  type != FaceDetectorType::BlazefaceFullRange))
+        return DetectFaces(type, image, detections);
+
+    auto detector = _blazeface_detector(type);
+    if (!detector) return false;
+    ToFaceDetections(detector->DetectFaceTiled(image, tiles), detections);
+    return true;
+}
+
+bool FaceModels::DetectFaces(FaceDetectorType type,
+                             const std::vector<cv::Mat>& images,
+                             std::vector<FaceDetections>& detections) {
+    detections.resize(images.size());
+
+    if (type != FaceDetectorType::Blazeface &&
+        type != FaceDetectorType::BlazefaceFullRange) {
+        for (size_t idx = 0; idx < images.size(); ++idx) {
+            cv::Mat image = images[idx];
+            if (!DetectFaces(type, image, detections[idx])) return false;
+        }
+        return true;
+    }
+
+    auto detector = _blazeface_detector(type);
+    if (!detector) return false;
+    auto blazeface_detections = detector->DetectFaces(images);
+    for (size_t idx = 0; idx < images.size(); ++idx) {
+        ToFaceDetections(blazeface_detections[idx], detections[idx]);
+    }
+    return true;
+}
+
+bool FaceModels::SubmitFaceDetection(FaceDetectorType type,
+                                     const cv::Mat& image) {
+    auto detector = _blazeface_detector(type);
+    return detector && detector->SubmitFrame(image);
+}
+
+bool FaceModels::CompleteFaceDetection(FaceDetectorType type,
+                                       FaceDetections& detections) {
+    auto detector = _blazeface_detector(type);
+    tvm_blazeface::DetectionsVec blazeface_detections;
+    if (!detector || !detector->CompleteFrame(blazeface_detections))
+        return false;
+    ToFaceDetections(blazeface_detections, detections);
+    return true;
+}
+
+std::shared_ptr<tvm_blazeface::TVM_Blazeface> FaceModels::_blazeface_detector(
+    FaceDetectorType type) {
+    auto detector = std::atomic_load(type == FaceDetectorType::Blazeface
+                                         ? &blazeface_face_detector
+                                         : &blazeface_full_range_detector);
+    if (!detector || !detector->CanExecute()) return nullptr;
+    return detector;
+}
+
+bool FaceModels::DetectLandmarks(LandmarkModelType type, cv::Mat& image,
+                                 const cv::Rect2d& roi,
+                                 std::vector<cv::Point2d>& landmarks) {
+    landmarks.clear();
+
+    switch (type) {
+        case LandmarkModelType::None:
+            return false;
+        case LandmarkModelType::Dlib: {
+            auto detector = std::atomic_load(&dlib_landmarks_detector);
+            if (!detector) return false;
+            auto face_roi = roi;
+            landmarks = detector->DetectLandmarks(image, face_roi);
+        } break;
+        case LandmarkModelType::Facemesh: {
+            auto face_mesh = std::atomic_load(&face_mesh_detector);
+            if (!face_mesh) return false;
+
+            tvm_facemesh::TVM_FacemeshResult result;
+            if (!face_mesh->Detect(CropRoi(image, roi), result))
+                return false;
+            ToFrameLandmarks(result, roi, landmarks);
+        } break;
+    }
+
+    return true;
+}
+
+bool FaceModels::DetectLandmarks(
+    LandmarkModelType type, cv::Mat& image,
+    const std::vector<cv::Rect2d>& rois,
+    std::vector<std::vector<cv::Point2d>>& landmarks) {
+    // Headers sharing the frame, nothing is copied
+    const std::vector<cv::Mat> images(rois.size(), image);
+    return DetectLandmarks(type, images, rois, landmarks);
+}
+
+bool FaceModels::DetectLandmarks(
+    LandmarkModelType type, const std::vector<cv::Mat>& images,
+    const std::vector<cv::Rect2d>& rois,
+    std::vector<std::vector<cv::Point2d>>& landmarks) {
+    landmarks.clear();
+    landmarks.resize(rois.size());
+
+    if (type != LandmarkModelType::Facemesh) {
+        bool success = true;
+        for (size_t i = 0; i < rois.size(); ++i) {
+            cv::Mat image = images[i];
+            success &= DetectLandmarks(type, image, rois[i], landmarks[i]);
+        }
+        return success;
+    }
+
+    auto face_mesh = std::atomic_load(&face_mesh_detector);
+    if (!face_mesh) return false;
+    if (rois.empty()) return true;
+
+    std::vector<cv::Mat> face_images;
+    face_images.reserve(rois.size());
+    for (size_t i = 0; i < rois.size(); ++i) {
+        face_images.push_back(CropRoi(images[i], rois[i]));
+    }
+
+    std::vector<tvm_facemesh::TVM_FacemeshResult> results;
+    if (!face_mesh->Detect(face_images, results)) return false;
+
+    for (size_t i = 0; i < rois.size(); ++i) {
+        ToFrameLandmarks(results[i], rois[i], landmarks[i]);
+    }
+    return true;
+}
+
+int FaceModels::GetLandmarkBatchSize(LandmarkModelType type) const {
+    if (type != LandmarkModelType::Facemesh) return 1;
+    auto face_mesh = std::atomic_load(&face_mesh_detector);
+    if (!face_mesh) return 1;
+
+    auto batch_sizes = face_mesh->GetBatchSizes();
+    return batch_sizes.empty() ? 1 : batch_sizes.back();
+}
+}  // namespace mukham
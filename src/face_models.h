@@ -0,0 +1,145 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dlib_face_detection.h"
+#include "opencv2/core.hpp"
+#include "opencv_face_detection.h"
+#include "tvm_blazeface.h"
+#include "tvm_facemesh.h"
+
+namespace mukham {
+namespace fs = std::filesystem;
+
+// The values match the radio buttons of the "Face detection" panel
+enum class FaceDetectorType : int {
+    DlibHog = 0,
+    OpenCVLBP = 1,
+    OpenCVTF = 2,
+    Blazeface = 3,
+    BlazefaceFullRange = 4,
+};
+
+// The values match the radio buttons of the "Landmark detection" panel
+enum class LandmarkModelType : int {
+    None = -1,
+    Dlib = 0,
+    Facemesh = 1,
+};
+
+struct FaceDetections {
+    std::vector<cv::Rect2d> faces;
+    std::vector<cv::Point2d> keypoints;
+};
+
+fs::path GetFacemeshModelPath();
+fs::path GetBlazefaceModelPath(
+    tvm_blazeface::BlazefaceModel model = tvm_blazeface::BlazefaceModel::Front);
+
+const char* ToString(FaceDetectorType type);
+const char* ToString(LandmarkModelType type);
+bool ParseFaceDetectorType(const std::string& name, FaceDetectorType& type);
+bool ParseLandmarkModelType(const std::string& name, LandmarkModelType& type);
+
+// Region around the face, scaled by roi_scale and clipped to the frame, that
+// is handed to the landmark models
+cv::Rect2d GetLandmarkRoi(const cv::Rect2d& face, double roi_scale,
+                          const cv::Size& frame_size);
+
+/**
+ * Owns the face detection and landmark models.
+ *
+ * Models are only constructed when they are loaded, so that a caller which
+ * needs a single detector does not pay for the others. A model can be
+ * loaded, taken over or unloaded while another thread runs the models: each
+ * call works on its own reference to the model, which is destroyed once the
+ * last call using it returns. A given model is still run by one thread at a
+ * time, unless it can be shared, see ShareLandmarkModel.
+ */
+class FaceModels {
+   public:
+    void LoadDetector(FaceDetectorType type);
+    void LoadLandmarkModel(LandmarkModelType type);
+    void LoadAll();
+
+    // Moves a model loaded by other into this instance, replacing the
+    // current one, see ModelRegistry
+    void TakeDetector(FaceDetectorType type, FaceModels& other);
+    void TakeLandmarkModel(LandmarkModelType type, FaceModels& other);
+    // Runs the landmark model loaded by other instead of a copy of its own.
+    // False, without changing anything, when the model can not be shared or
+    // other has not loaded it.
+    bool ShareLandmarkModel(LandmarkModelType type, const FaceModels& other);
+    // dlib's shape_predictor can be used from several threads at once, a TVM
+    // executor runs one inference at a time
+    static bool CanShareLandmarkModel(LandmarkModelType type);
+
+    void UnloadDetector(FaceDetectorType type);
+    void UnloadLandmarkModel(LandmarkModelType type);
+
+    bool IsDetectorLoaded(FaceDetectorType type) const;
+    bool IsLandmarkModelLoaded(LandmarkModelType type) const;
+
+    bool DetectFaces(FaceDetectorType type, cv::Mat& image,
+                     FaceDetections& detections);
+
+    // Blazeface runs the tiles of the frame as one batch, the other
+    // detectors ignore the tiles and see the whole frame
+    bool DetectFaces(FaceDetectorType type, cv::Mat& image,
+                     const tvm_blazeface::TileOptions& tiles,
+                     FaceDetections& detections);
+
+    // detections[i] receives the faces of images[i]. Blazeface runs the
+    // frames as batched inferences, the other detectors one frame at a time.
+    bool DetectFaces(FaceDetectorType type, const std::vector<cv::Mat>& images,
+                     std::vector<FaceDetections>& detections);
+
+    // Asynchronous Blazeface detection, the next frame is submitted before
+    // the detections of the previous one are collected, see
+    // TVM_Blazeface::SubmitFrame. Fails for the other detectors.
+    bool SubmitFaceDetection(FaceDetectorType type, const cv::Mat& image);
+    bool CompleteFaceDetection(FaceDetectorType type,
+                               FaceDetections& detections);
+
+    // Landmarks are returned in frame coordinates. The result is empty when
+    // the model does not find a face in the ROI.
+    bool DetectLandmarks(LandmarkModelType type, cv::Mat& image,
+                         const cv::Rect2d& roi,
+                         std::vector<cv::Point2d>& landmarks);
+
+    // landmarks[i] receives the landmarks of rois[i]. Facemesh runs all the
+    // faces as one batched inference.
+    bool DetectLandmarks(LandmarkModelType type, cv::Mat& image,
+                         const std::vector<cv::Rect2d>& rois,
+                         std::vector<std::vector<cv::Point2d>>& landmarks);
+
+    // Same as above for faces of different frames, rois[i] lies in
+    // images[i], so that the faces of several streams share a batch
+    bool DetectLandmarks(LandmarkModelType type,
+                         const std::vector<cv::Mat>& images,
+                         const std::vector<cv::Rect2d>& rois,
+                         std::vector<std::vector<cv::Point2d>>& landmarks);
+
+    // Largest number of faces the model processes in a single inference
+    int GetLandmarkBatchSize(LandmarkModelType type) const;
+
+   private:
+    // Loaded and executable Blazeface detector of the given type, or nullptr
+    std::shared_ptr<tvm_blazeface::TVM_Blazeface> _blazeface_detector(
+        FaceDetectorType type);
+
+    // The models are read and replaced with std::atomic_load/atomic_store
+    std::shared_ptr<dlib_facedetect::DlibFaceDetectHog> dlib_hog_face_detector;
+    std::shared_ptr<opencv_facedetect::OpenCVFaceDetectLBP>
+        opencv_lbp_face_detector;
+    std::shared_ptr<opencv_facedetect::OpenCVFaceDetectTF>
+        opencv_tf_face_detector;
+    std::shared_ptr<tvm_blazeface::TVM_Blazeface> blazeface_face_detector;
+    std::shared_ptr<tvm_blazeface::TVM_Blazeface> blazeface_full_range_detector;
+    std::shared_ptr<dlib_facedetect::DlibFaceLandmarks> dlib_landmarks_detector;
+    std::shared_ptr<tvm_facemesh::TVM_Facemesh> face_mesh_detector;
+};
+}  // namespace mukham
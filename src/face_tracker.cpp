@@ -0,0 +1,148 @@
+#include "face_tracker.h"
+
+#include <algorithm>
+
+#include "nms.h"
+
+namespace mukham {
+
+void FaceTracker::AxisFilter::Init(double value, double variance) {
+    position = value;
+    velocity = 0.0;
+    // The velocity of a new track is unknown
+    p00 = variance;
+    p01 = 0.0;
+    p11 = 10.0 * variance;
+}
+
+void FaceTracker::AxisFilter::Predict(double noise) {
+    position += velocity;
+
+    // P = F P F' + Q, with a random acceleration over one frame
+    const double q = noise * noise;
+    p00 += 2.0 * p01 + p11 + 0.25 * q;
+    p01 += p11 + 0.5 * q;
+    p11 += q;
+}
+
+void FaceTracker::AxisFilter::Correct(double value, double noise) {
+    const double s = p00 + noise * noise;
+    const double k0 = p00 / s;
+    const double k1 = p01 / s;
+    const double innovation = value - position;
+
+    position += k0 * innovation;
+    velocity += k1 * innovation;
+
+    p11 -= k1 * p01;
+    p01 -= k0 * p01;
+    p00 -= k0 * p00;
+}
+
+cv::Rect2d FaceTracker::_filter_box(const BoxFilter& filter) {
+    const double width = (std::max)(filter[2].position, 0.0);
+    const double height = (std::max)(filter[3].position, 0.0);
+    return cv::Rect2d(filter[0].position - width / 2,
+                      filter[1].position - height / 2, width, height);
+}
+
+void FaceTracker::_start_track(const cv::Rect2d& box) {
+    const double size = (std::max)(box.width, box.height);
+    const double variance = (options.measurement_noise * size) *
+                            (options.measurement_noise * size);
+
+    BoxFilter filter;
+    filter[0].Init(box.x + box.width / 2, variance);
+    filter[1].Init(box.y + box.height / 2, variance);
+    filter[2].Init(box.width, variance);
+    filter[3].Init(box.height, variance);
+    filters.push_back(filter);
+
+    FaceTrack track;
+    track.id = next_id++;
+    track.box = box;
+    track.hits = 1;
+    tracks.push_back(track);
+}
+
+void FaceTracker::Update(const std::vector<cv::Rect2d>& detections,
+                         std::vector<int>& detection_ids) {
+    detection_ids.assign(detections.size(), -1);
+
+    // Predict the tracks into this frame
+    for (size_t t = 0; t < tracks.size(); ++t) {
+        const double size =
+            (std::max)(tracks[t].box.width, tracks[t].box.height);
+        for (auto& axis : filters[t]) {
+            axis.Predict(options.process_noise * size);
+        }
+        tracks[t].box = _filter_box(filters[t]);
+    }
+
+    candidates.clear();
+    for (size_t t = 0; t < tracks.size(); ++t) {
+        const auto& predicted = tracks[t].box;
+        for (size_t d = 0; d < detections.size(); ++d) {
+            const auto iou = OverlapSimilarity(predicted, detections[d]);
+            if (iou >= options.min_iou)
+                candidates.emplace_back(iou, (int)t, (int)d);
+        }
+    }
+    // Best overlaps first, ties in track then detection order
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto& a, const auto& b) {
+                  if (std::get<0>(a) != std::get<0>(b))
+                      return std::get<0>(a) > std::get<0>(b);
+                  return std::make_pair(std::get<1>(a), std::get<2>(a)) <
+                         std::make_pair(std::get<1>(b), std::get<2>(b));
+              });
+
+    track_matched.assign(tracks.size(), 0);
+    for (const auto& [iou, t, d] : candidates) {
+        if (track_matched[t] || detection_ids[d] >= 0) continue;
+        track_matched[t] = 1;
+        detection_ids[d] = tracks[t].id;
+
+        const auto& box = detections[d];
+        const double noise = options.measurement_noise *
+                             (std::max)(box.width, box.height);
+        auto& filter = filters[t];
+        filter[0].Correct(box.x + box.width / 2, noise);
+        filter[1].Correct(box.y + box.height / 2, noise);
+        filter[2].Correct(box.width, noise);
+        filter[3].Correct(box.height, noise);
+
+        auto& track = tracks[t];
+        track.box = _filter_box(filter);
+        track.hits++;
+        track.missed_frames = 0;
+    }
+
+    // Age the unmatched tracks and drop the stale ones, in place so that
+    // the surviving tracks keep their order
+    size_t kept = 0;
+    for (size_t t = 0; t < tracks.size(); ++t) {
+        if (!track_matched[t] &&
+            ++tracks[t].missed_frames > options.max_missed_frames)
+            continue;
+        if (kept != t) {
+            tracks[kept] = tracks[t];
+            filters[kept] = filters[t];
+        }
+        kept++;
+    }
+    tracks.resize(kept);
+    filters.resize(kept);
+
+    for (size_t d = 0; d < detections.size(); ++d) {
+        if (detection_ids[d] >= 0) continue;
+        _start_track(detections[d]);
+        detection_ids[d] = tracks.back().id;
+    }
+}
+
+void FaceTracker::Reset() {
+    tracks.clear();
+    filters.clear();
+}
+}  // namespace mukham
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <tuple>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+namespace mukham {
+
+struct FaceTrackerOptions {
+    // Minimum overlap between a predicted track and a detection to match
+    double min_iou = 0.3;
+    // A track is dropped after this many consecutive frames without a match
+    int max_missed_frames = 5;
+    // Noise of the constant velocity model and of the detections, as a
+    // fraction of the box size
+    double process_noise = 0.05;
+    double measurement_noise = 0.1;
+};
+
+struct FaceTrack {
+    // Unique for the lifetime of the tracker
+    int id = -1;
+    // Filtered box, predicted for tracks that missed the last frame
+    cv::Rect2d box;
+    // Frames in which the track was matched to a detection
+    int hits = 0;
+    // Consecutive frames without a matching detection
+    int missed_frames = 0;
+};
+
+/**
+ * Gives the faces of a video persistent identities.
+ *
+ * Every track follows the centre and size of its box with a constant
+ * velocity Kalman filter, one independent filter per coordinate. The tracks
+ * are predicted into the new frame and greedily matched to the detections
+ * by decreasing IoU, which is what the Hungarian assignment converges to
+ * when faces do not overlap much, at a fraction of the cost for many faces.
+ *
+ * Downstream stages can key per-face results on the track ID and only redo
+ * them for new tracks.
+ */
+class FaceTracker {
+   public:
+    explicit FaceTracker(const FaceTrackerOptions& options = FaceTrackerOptions())
+        : options(options) {}
+
+    void SetOptions(const FaceTrackerOptions& new_options) {
+        options = new_options;
+    }
+    const FaceTrackerOptions& GetOptions() const { return options; }
+
+    // Advances the tracks by one frame. detection_ids[i] receives the track
+    // ID of detections[i], new faces start a new track.
+    void Update(const std::vector<cv::Rect2d>& detections,
+                std::vector<int>& detection_ids);
+
+    // Live tracks, including the ones that missed the last frame
+    const std::vector<FaceTrack>& GetTracks() const { return tracks; }
+
+    void Reset();
+
+   private:
+    // Position and velocity along one coordinate, with their covariance
+    struct AxisFilter {
+        double position;
+        double velocity = 0.0;
+        double p00, p01 = 0.0, p11;
+
+        void Init(double value, double variance);
+        void Predict(double noise);
+        void Correct(double value, double noise);
+    };
+
+    // Centre x, centre y, width, height
+    using BoxFilter = std::array<AxisFilter, 4>;
+
+    void _start_track(const cv::Rect2d& box);
+
+    static cv::Rect2d _filter_box(const BoxFilter& filter);
+
+    FaceTrackerOptions options;
+
+    std::vector<FaceTrack> tracks;
+    std::vector<BoxFilter> filters;
+    int next_id = 0;
+
+    // Candidate matches as (iou, track, detection)
+    std::vector<std::tuple<double, int, int>> candidates;
+    std::vector<char> track_matched;
+};
+}  // namespace mukham
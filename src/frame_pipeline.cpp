@@ -0,0 +1,364 @@
+#include "frame_pipeline.h"
+
+#include <chrono>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "spdlog/spdlog.h"
+
+namespace mukham {
+
+FramePipeline::FramePipeline(FaceModels& models, size_t queue_capacity,
+                             size_t landmark_workers)
+    : face_models(models), capacity(queue_capacity) {
+    if (landmark_workers > 0) {
+        landmark_pool = std::make_unique<LandmarkWorkerPool>(landmark_workers);
+    }
+}
+
+FramePipeline::~FramePipeline() { Stop(); }
+
+bool FramePipeline::Start(const VideoSource& source) {
+    Stop();
+
+    video_source = source;
+    bool is_open = false;
+    if (source.file_name.empty()) {
+        spdlog::info("Opening the camera {}", source.camera_index);
+        is_open = capture.open(source.camera_index);
+        if (is_open && !source.camera_size.empty()) {
+            capture.set(cv::CAP_PROP_FRAME_HEIGHT,
+                        (double)source.camera_size.height);
+            capture.set(cv::CAP_PROP_FRAME_WIDTH,
+                        (double)source.camera_size.width);
+        }
+        frame_count = 0;
+    } else {
+        is_open = capture.open(source.file_name);
+        frame_count = is_open ? (int64_t)capture.get(cv::CAP_PROP_FRAME_COUNT)
+                              : 0;
+    }
+
+    if (!is_open) {
+        spdlog::error("Failed to open the video source");
+        return false;
+    }
+
+    // Frames queued behind a slow stage are stale by the time they are
+    // processed, so the dropping policies keep a single frame in flight
+    // between the stages
+    const auto stage_capacity =
+        policy == BackpressurePolicy::Block ? capacity : 1;
+    captured_frames =
+        std::make_unique<BackpressureQueue<FrameData>>(capacity, policy);
+    preprocessed_frames =
+        std::make_unique<SpscQueue<FrameData>>(stage_capacity);
+    detected_frames = std::make_unique<SpscQueue<FrameData>>(stage_capacity);
+    output_frames = std::make_unique<SpscQueue<FrameData>>(stage_capacity);
+
+    roi_tracker.Reset();
+    face_tracker.Reset();
+    motion_gate.Reset();
+    gated_frames = 0;
+    static_frames = 0;
+    last_results.valid = false;
+    running = true;
+    workers.emplace_back(&FramePipeline::_capture_loop, this);
+    workers.emplace_back(&FramePipeline::_preprocess_loop, this);
+    workers.emplace_back(&FramePipeline::_detect_loop, this);
+    workers.emplace_back(&FramePipeline::_landmark_loop, this);
+    return true;
+}
+
+void FramePipeline::Stop() {
+    running = false;
+    if (captured_frames) captured_frames->Close();
+    for (auto* queue : {preprocessed_frames.get(), detected_frames.get(),
+                        output_frames.get()}) {
+        if (queue) queue->Close();
+    }
+
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    workers.clear();
+    capture.release();
+}
+
+void FramePipeline::SetSettings(const PipelineSettings& settings) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    pipeline_settings = settings;
+}
+
+PipelineSettings FramePipeline::GetSettings() {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    return pipeline_settings;
+}
+
+void FramePipeline::SetBackpressurePolicy(BackpressurePolicy new_policy) {
+    policy = new_policy;
+    if (captured_frames) captured_frames->SetPolicy(new_policy);
+}
+
+void FramePipeline::SetThreadOptions(const RuntimeThreadOptions& options) {
+    thread_options = options;
+
+    // Several per-face models share the landmark cores, each one gets a
+    // single TVM thread
+    if (landmark_pool && !options.landmarks.IsDefault()) {
+        ModelThreadOptions worker_options = options.landmarks;
+        worker_options.tvm_threads = 1;
+        landmark_pool->SetThreadOptions(worker_options);
+    }
+}
+
+uint64_t FramePipeline::GetDroppedFrames() const {
+    return captured_frames ? captured_frames->Dropped() : 0;
+}
+
+MotionGateStats FramePipeline::GetMotionGateStats() const {
+    MotionGateStats stats;
+    stats.frames = gated_frames;
+    stats.static_frames = static_frames;
+    return stats;
+}
+
+bool FramePipeline::GetResult(FrameData& frame) {
+    return output_frames && output_frames->Pop(frame);
+}
+
+bool FramePipeline::TryGetResult(FrameData& frame) {
+    return output_frames && output_frames->TryPop(frame);
+}
+
+std::vector<NamedQueueStats> FramePipeline::GetQueueStats() const {
+    std::vector<NamedQueueStats> stats;
+    if (!captured_frames) return stats;
+
+    stats.push_back({"capture", captured_frames->GetStats()});
+    stats.push_back({"preprocess", preprocessed_frames->GetStats()});
+    stats.push_back({"detect", detected_frames->GetStats()});
+    stats.push_back({"landmark", output_frames->GetStats()});
+    return stats;
+}
+
+void FramePipeline::_capture_loop() {
+    int64_t index = 0;
+    int64_t position = 0;
+
+    // Pacing for the realtime playback of video files
+    const bool pace = video_source.realtime && !video_source.file_name.empty();
+    const double fps = pace ? capture.get(cv::CAP_PROP_FPS) : 0.0;
+    const auto frame_interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(fps > 0.0 ? 1.0 / fps : 0.0));
+    auto next_frame_time = Clock::now();
+
+    while (running) {
+        if (is_paused) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            next_frame_time = Clock::now();
+            continue;
+        }
+
+        if (fps > 0.0) {
+            std::this_thread::sleep_until(next_frame_time);
+            next_frame_time += frame_interval;
+            // Do not try to catch up when decoding itself is too slow
+            if (next_frame_time < Clock::now()) next_frame_time = Clock::now();
+        }
+
+        FrameData data;
+        auto start = Clock::now();
+        if (!capture.read(data.frame) || data.frame.empty()) {
+            // Rewind only when the previous pass produced frames, otherwise
+            // an unreadable file would spin here forever
+            if (video_source.loop && position > 0) {
+                capture.set(cv::CAP_PROP_POS_FRAMES, 0);
+                position = 0;
+                continue;
+            }
+            break;
+        }
+
+        data.capture_time = Clock::now();
+        data.decode_ms = ElapsedMs(start, data.capture_time);
+        data.index = index++;
+        position++;
+
+        if (!captured_frames->Push(std::move(data))) break;
+    }
+    captured_frames->Close();
+}
+
+void FramePipeline::_preprocess_loop() {
+    FrameData data;
+    while (captured_frames->Pop(data)) {
+        auto settings = GetSettings();
+        auto start = Clock::now();
+
+        cv::Mat rgb_frame;
+        cv::cvtColor(data.frame, rgb_frame, cv::COLOR_BGR2RGB);
+        if (settings.resize_factor != 1.0) {
+            cv::resize(rgb_frame, rgb_frame, cv::Size(0, 0),
+                       settings.resize_factor, settings.resize_factor,
+                       cv::INTER_LINEAR);
+        }
+        if (settings.rotate_code >= 0) {
+            cv::rotate(rgb_frame, rgb_frame, settings.rotate_code);
+        }
+
+        if (settings.alpha != 1.0 || settings.beta != 0.0) {
+            rgb_frame.convertTo(data.frame, -1, settings.alpha, settings.beta);
+        } else {
+            data.frame = rgb_frame;
+        }
+        data.preprocess_ms = ElapsedMs(start, Clock::now());
+
+        if (!preprocessed_frames->Push(std::move(data))) break;
+    }
+    preprocessed_frames->Close();
+}
+
+void FramePipeline::_detect_faces(const PipelineSettings& settings,
+                                  FrameData& data) {
+    auto start = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(detector_mutex);
+        face_models.DetectFaces(settings.detector, data.frame, settings.tiles,
+                                data.detections);
+    }
+    data.detected = true;
+    data.detect_ms = ElapsedMs(start, Clock::now());
+}
+
+void FramePipeline::_predict_faces(FrameData& data) {
+    roi_tracker.PredictFaces(data.detections.faces);
+    data.detections.keypoints.clear();
+    data.detected = false;
+    data.detect_ms = 0.0;
+}
+
+void FramePipeline::_detect_loop() {
+    ConfigureModelThreads(thread_options.detector);
+
+    FrameData data;
+    while (preprocessed_frames->Pop(data)) {
+        auto settings = GetSettings();
+        data.detected = false;
+        data.detect_ms = 0.0;
+
+        data.is_static = false;
+        if (settings.motion_gate) {
+            motion_gate.SetOptions(settings.motion);
+            data.is_static = motion_gate.IsStatic(data.frame);
+            gated_frames++;
+            if (data.is_static) static_frames++;
+        } else {
+            motion_gate.Reset();
+        }
+
+        if (!data.is_static && !_is_tracking(settings))
+            _detect_faces(settings, data);
+
+        if (!detected_frames->Push(std::move(data))) break;
+    }
+    detected_frames->Close();
+}
+
+bool FramePipeline::_reuse_results(const PipelineSettings& settings,
+                                   FrameData& data) {
+    if (!last_results.valid || last_results.detector != settings.detector ||
+        last_results.landmarks != settings.landmarks)
+        return false;
+
+    data.detections = last_results.detections;
+    data.face_ids = last_results.face_ids;
+    data.landmarks = last_results.face_landmarks;
+    data.has_landmarks = settings.landmarks != LandmarkModelType::None;
+    data.detected = false;
+    data.detect_ms = 0.0;
+    data.landmark_ms = 0.0;
+    return true;
+}
+
+void FramePipeline::_keep_results(const PipelineSettings& settings,
+                                  const FrameData& data) {
+    last_results.valid = true;
+    last_results.detector = settings.detector;
+    last_results.landmarks = settings.landmarks;
+    last_results.detections = data.detections;
+    last_results.face_ids = data.face_ids;
+    last_results.face_landmarks = data.landmarks;
+}
+
+void FramePipeline::_landmark_loop() {
+    ConfigureModelThreads(thread_options.landmarks);
+
+    FrameData data;
+    while (detected_frames->Pop(data)) {
+        auto settings = GetSettings();
+
+        // The models are skipped altogether while nothing moves
+        if (data.is_static && _reuse_results(settings, data)) {
+            if (!output_frames->Push(std::move(data))) break;
+            continue;
+        }
+        data.is_static = false;
+
+        const bool tracking = _is_tracking(settings);
+        if (tracking) {
+            roi_tracker.SetOptions(settings.tracking);
+            if (!data.detected) {
+                if (roi_tracker.NeedsDetection())
+                    _detect_faces(settings, data);
+                else
+                    _predict_faces(data);
+            }
+        } else {
+            roi_tracker.Reset();
+            // Passed through just before tracking was switched off
+            if (!data.detected) _detect_faces(settings, data);
+        }
+
+        // The frames reach this stage in order, whichever way their faces
+        // were found
+        face_tracker.Update(data.detections.faces, data.face_ids);
+
+        auto start = Clock::now();
+        data.landmarks.clear();
+        data.has_landmarks =
+            face_models.IsLandmarkModelLoaded(settings.landmarks);
+        if (data.has_landmarks) {
+            const auto& faces = data.detections.faces;
+            std::vector<cv::Rect2d> rois;
+            for (const auto& face : faces) {
+                rois.push_back(GetLandmarkRoi(face, settings.roi_scale,
+                                              data.frame.size()));
+            }
+
+            // A batched model already spreads the faces over TVM's own
+            // threads, the pool only pays off for per-face models
+            if (landmark_pool &&
+                face_models.GetLandmarkBatchSize(settings.landmarks) == 1 &&
+                landmark_pool->IsModelLoaded(settings.landmarks)) {
+                landmark_pool->DetectLandmarks(settings.landmarks, data.frame,
+                                               rois, data.landmarks);
+            } else {
+                face_models.DetectLandmarks(settings.landmarks, data.frame,
+                                            rois, data.landmarks);
+            }
+        }
+        data.landmark_ms = ElapsedMs(start, Clock::now());
+
+        if (tracking) {
+            roi_tracker.Update(data.landmarks, data.detected,
+                               data.frame.size());
+        }
+        _keep_results(settings, data);
+
+        if (!output_frames->Push(std::move(data))) break;
+    }
+    output_frames->Close();
+}
+}  // namespace mukham
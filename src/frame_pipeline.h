@@ -0,0 +1,224 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "backpressure_queue.h"
+#include "face_models.h"
+#include "face_tracker.h"
+#include "landmark_worker_pool.h"
+#include "latency_stats.h"
+#include "motion_gate.h"
+#include "opencv2/core.hpp"
+#include "opencv2/videoio.hpp"
+#include "roi_tracker.h"
+#include "runtime_threads.h"
+#include "spsc_queue.h"
+
+namespace mukham {
+
+struct VideoSource {
+    // Camera index, used when the file name is empty
+    int camera_index = 0;
+    std::string file_name;
+    // Seek back to the first frame at the end of the video
+    bool loop = false;
+    // Deliver the frames of a video file at its native frame rate, the way a
+    // live camera would
+    bool realtime = false;
+    // Requested camera resolution, ignored when empty
+    cv::Size camera_size;
+};
+
+struct PipelineSettings {
+    FaceDetectorType detector = FaceDetectorType::Blazeface;
+    LandmarkModelType landmarks = LandmarkModelType::None;
+    double roi_scale = 1.0;
+    // Resize factor applied to the captured frame
+    double resize_factor = 1.0;
+    // Brightness adjustment, output = alpha * input + beta
+    double alpha = 1.0;
+    double beta = 0.0;
+    // One of cv::RotateFlags, negative to disable the rotation
+    int rotate_code = -1;
+    // Blazeface runs on this grid of tiles, for small faces in large frames
+    tvm_blazeface::TileOptions tiles;
+    // Run the detector on keyframes only and follow the faces with their
+    // landmarks in between, needs a landmark model
+    bool track_faces = false;
+    RoiTrackerOptions tracking;
+    // Reuse the results of the last processed frame while the scene is
+    // static
+    bool motion_gate = false;
+    MotionGateOptions motion;
+};
+
+struct FrameData {
+    int64_t index = -1;
+    Clock::time_point capture_time;
+    // BGR frame from the capture, RGB frame after the preprocessing stage
+    cv::Mat frame;
+    FaceDetections detections;
+    // False when the faces were predicted by the tracker
+    bool detected = false;
+    // Persistent identity of every face, face_ids[i] belongs to faces[i]
+    std::vector<int> face_ids;
+    // Nothing moved since the last processed frame, the results are reused
+    bool is_static = false;
+    std::vector<std::vector<cv::Point2d>> landmarks;
+    bool has_landmarks = false;
+
+    double decode_ms = 0.0;
+    double preprocess_ms = 0.0;
+    double detect_ms = 0.0;
+    double landmark_ms = 0.0;
+};
+
+struct NamedQueueStats {
+    std::string name;
+    QueueStats stats;
+};
+
+/**
+ * Runs capture -> preprocess -> detect -> landmark on dedicated threads.
+ *
+ * The stages are connected by bounded SPSC queues, so that decoding frame
+ * N+2, detecting on N+1 and landmarking N overlap. The caller is the render
+ * stage and pulls the finished frames with GetResult/TryGetResult.
+ *
+ * With landmark_workers > 0 the faces of a frame are spread over a pool of
+ * landmark workers, each with its own copy of Facemesh, the dlib model
+ * being shared. The models of the workers are loaded by the owner of the
+ * models, see GetLandmarkWorkers, until then the shared model runs the
+ * faces on the landmark thread.
+ *
+ * The capture stage hands frames over according to a BackpressurePolicy.
+ * With a dropping policy the downstream queues hold a single frame, so a
+ * live source stays low-latency when the models can not keep up.
+ *
+ * With face tracking the detect stage passes the frames through and the
+ * landmark stage, which sees the frames in order, runs the detector on the
+ * keyframes only.
+ */
+class FramePipeline {
+   public:
+    explicit FramePipeline(FaceModels& models, size_t queue_capacity = 4,
+                           size_t landmark_workers = 0);
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    bool Start(const VideoSource& source);
+    void Stop();
+
+    bool IsRunning() const { return running; }
+
+    void SetSettings(const PipelineSettings& settings);
+    PipelineSettings GetSettings();
+
+    void SetPaused(bool paused) { is_paused = paused; }
+
+    // nullptr without landmark workers
+    LandmarkWorkerPool* GetLandmarkWorkers() { return landmark_pool.get(); }
+
+    // The detector runs with options.detector in the detect stage, the
+    // landmark models with options.landmarks in the landmark stage and its
+    // workers. Takes effect at the next Start.
+    void SetThreadOptions(const RuntimeThreadOptions& options);
+
+    // Takes effect immediately for the capture queue, the capacity of the
+    // downstream queues is chosen when the pipeline starts
+    void SetBackpressurePolicy(BackpressurePolicy policy);
+    BackpressurePolicy GetBackpressurePolicy() const { return policy; }
+
+    // Frames discarded by the capture stage since Start
+    uint64_t GetDroppedFrames() const;
+
+    // Number of frames in the video, 0 for a camera
+    int64_t GetFrameCount() const { return frame_count; }
+
+    // Blocks until a frame is available, returns false at the end of stream
+    bool GetResult(FrameData& frame);
+    bool TryGetResult(FrameData& frame);
+
+    std::vector<NamedQueueStats> GetQueueStats() const;
+
+    // Frames seen by the motion gate since Start, and the static ones
+    MotionGateStats GetMotionGateStats() const;
+
+   private:
+    void _capture_loop();
+    void _preprocess_loop();
+    void _detect_loop();
+    void _landmark_loop();
+
+    // Tracking needs the landmarks of the previous frame, so it runs in the
+    // landmark stage
+    bool _is_tracking(const PipelineSettings& settings) const {
+        return settings.track_faces &&
+               settings.landmarks != LandmarkModelType::None;
+    }
+
+    void _detect_faces(const PipelineSettings& settings, FrameData& data);
+    void _predict_faces(FrameData& data);
+
+    // Copies the results of the last processed frame into a static frame,
+    // false when they do not match the current settings
+    bool _reuse_results(const PipelineSettings& settings, FrameData& data);
+    void _keep_results(const PipelineSettings& settings,
+                       const FrameData& data);
+
+    FaceModels& face_models;
+    size_t capacity;
+    std::unique_ptr<LandmarkWorkerPool> landmark_pool;
+
+    cv::VideoCapture capture;
+    VideoSource video_source;
+    int64_t frame_count = 0;
+
+    std::mutex settings_mutex;
+    PipelineSettings pipeline_settings;
+
+    // The detect and landmark stages both run the detector while tracking
+    // is being switched on or off
+    std::mutex detector_mutex;
+    RoiTracker roi_tracker;
+    FaceTracker face_tracker;
+
+    // Run by the detect stage, the stats are read by the caller
+    MotionGate motion_gate;
+    std::atomic<uint64_t> gated_frames{0};
+    std::atomic<uint64_t> static_frames{0};
+
+    // Results of the last frame the models ran on, owned by the landmark
+    // stage
+    struct FrameResults {
+        bool valid = false;
+        FaceDetectorType detector;
+        LandmarkModelType landmarks;
+        FaceDetections detections;
+        std::vector<int> face_ids;
+        std::vector<std::vector<cv::Point2d>> face_landmarks;
+    };
+    FrameResults last_results;
+
+    RuntimeThreadOptions thread_options;
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> is_paused{false};
+    std::atomic<BackpressurePolicy> policy{BackpressurePolicy::Block};
+
+    std::unique_ptr<BackpressureQueue<FrameData>> captured_frames;
+    std::unique_ptr<SpscQueue<FrameData>> preprocessed_frames;
+    std::unique_ptr<SpscQueue<FrameData>> detected_frames;
+    std::unique_ptr<SpscQueue<FrameData>> output_frames;
+
+    std::vector<std::thread> workers;
+};
+}  // namespace mukham
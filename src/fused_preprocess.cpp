@@ -0,0 +1,145 @@
+#include "fused_preprocess.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace mukham {
+
+namespace {
+
+struct Tap {
+    int index;
+    float weight;
+};
+
+// Source taps of every output index along one axis. The taps of output i
+// are taps[offsets[i]] .. taps[offsets[i + 1] - 1], with indices already
+// shifted from the padded to the source image. Taps falling in the border
+// are dropped since the border is black.
+struct AxisTable {
+    std::vector<int> offsets;
+    std::vector<Tap> taps;
+};
+
+void BuildAxisTable(int src_size, int pad, int out_size, AxisTable& table) {
+    const int padded_size = src_size + 2 * pad;
+    const double scale = (double)padded_size / out_size;
+
+    table.offsets.assign(1, 0);
+    table.taps.clear();
+
+    auto add_tap = [&](int padded_idx, double weight) {
+        const int src_idx = padded_idx - pad;
+        if (weight > 0.0 && src_idx >= 0 && src_idx < src_size)
+            table.taps.push_back({src_idx, (float)weight});
+    };
+
+    for (int i = 0; i < out_size; ++i) {
+        if (scale >= 1.0) {
+            // Area average of the covered source pixels
+            const double start = i * scale;
+            const double end = (i + 1) * scale;
+            const int first = (int)std::floor(start);
+            const int last = (std::min)((int)std::ceil(end), padded_size);
+            for (int p = first; p < last; ++p) {
+                const double overlap =
+                    (std::min)(end, p + 1.0) - (std::max)(start, (double)p);
+                add_tap(p, overlap / scale);
+            }
+        } else {
+            // Linear interpolation between the two nearest source pixels
+            const double center = (i + 0.5) * scale - 0.5;
+            int p0 = (int)std::floor(center);
+            double alpha = center - p0;
+            if (p0 < 0) {
+                p0 = 0;
+                alpha = 0.0;
+            }
+            const int p1 = (std::min)(p0 + 1, padded_size - 1);
+            add_tap(p0, 1.0 - alpha);
+            add_tap(p1, alpha);
+        }
+        table.offsets.push_back((int)table.taps.size());
+    }
+}
+
+inline void Store(float value, float* output) { *output = value; }
+
+inline void Store(float value, uint8_t* output) {
+    *output = cv::saturate_cast<uint8_t>(value);
+}
+
+// Resamples the image and writes alpha * value + beta into output
+template <typename T>
+bool ResampleInto(const cv::Mat& input, const cv::Size& output_size,
+                  float alpha, float beta, bool letterbox, T* output,
+                  int& padx, int& pady) {
+    padx = 0;
+    pady = 0;
+    if (input.type() != CV_8UC3 || input.empty()) return false;
+
+    if (letterbox) {
+        padx = input.rows > input.cols ? (input.rows - input.cols) >> 1 : 0;
+        pady = input.cols > input.rows ? (input.cols - input.rows) >> 1 : 0;
+    }
+
+    AxisTable columns, rows;
+    BuildAxisTable(input.cols, padx, output_size.width, columns);
+    BuildAxisTable(input.rows, pady, output_size.height, rows);
+
+    const int src_length = input.cols * 3;
+    const int row_length = output_size.width * 3;
+
+    // The vertical pass runs over contiguous source rows, which the compiler
+    // vectorises, and shrinks the data before the strided horizontal pass
+    auto resample_rows = [&](const cv::Range& range) {
+        std::vector<float> column_sums(src_length);
+
+        for (int y = range.start; y < range.end; ++y) {
+            std::fill(column_sums.begin(), column_sums.end(), 0.0f);
+            for (int r = rows.offsets[y]; r < rows.offsets[y + 1]; ++r) {
+                const uint8_t* src = input.ptr<uint8_t>(rows.taps[r].index);
+                const float weight = rows.taps[r].weight;
+                for (int i = 0; i < src_length; ++i) {
+                    column_sums[i] += weight * src[i];
+                }
+            }
+
+            T* dst = output + (size_t)y * row_length;
+            for (int x = 0; x < output_size.width; ++x) {
+                float c0 = 0.0f, c1 = 0.0f, c2 = 0.0f;
+                for (int t = columns.offsets[x]; t < columns.offsets[x + 1];
+                     ++t) {
+                    const auto& tap = columns.taps[t];
+                    const float* pixel = &column_sums[tap.index * 3];
+                    const float weight = tap.weight;
+                    c0 += weight * pixel[0];
+                    c1 += weight * pixel[1];
+                    c2 += weight * pixel[2];
+                }
+                Store(c0 * alpha + beta, dst + x * 3);
+                Store(c1 * alpha + beta, dst + x * 3 + 1);
+                Store(c2 * alpha + beta, dst + x * 3 + 2);
+            }
+        }
+    };
+    cv::parallel_for_(cv::Range(0, output_size.height), resample_rows);
+
+    return true;
+}
+}  // namespace
+
+bool ResizeNormalizeInto(const cv::Mat& input, const cv::Size& output_size,
+                         float min_val, float max_val, bool letterbox,
+                         float* output, int& padx, int& pady) {
+    return ResampleInto(input, output_size, (max_val - min_val) / 255.0f,
+                        min_val, letterbox, output, padx, pady);
+}
+
+bool ResizeInto(const cv::Mat& input, const cv::Size& output_size,
+                bool letterbox, uint8_t* output, int& padx, int& pady) {
+    return ResampleInto(input, output_size, 1.0f, 0.0f, letterbox, output,
+                        padx, pady);
+}
+}  // namespace mukham
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include "opencv2/core.hpp"
+
+namespace mukham {
+
+/**
+ * Letterbox, resize and normalise a CV_8UC3 image in a single pass.
+ *
+ * The image is optionally padded to a square with black borders, resampled
+ * to output_size and mapped from [0, 255] to [min_val, max_val]. The result
+ * is written as interleaved float32 (NHWC) straight into output, which must
+ * hold output_size.area() * 3 floats, e.g. the data of a model input tensor.
+ *
+ * The border is never materialised: the padded rows and columns are simply
+ * left out of the sums. Downscaling averages the covered source area like
+ * cv::INTER_AREA, upscaling interpolates linearly.
+ *
+ * padx and pady receive the border added on each side, in source pixels.
+ * Returns false, without writing anything, for images that are not CV_8UC3.
+ */
+bool ResizeNormalizeInto(const cv::Mat& input, const cv::Size& output_size,
+                         float min_val, float max_val, bool letterbox,
+                         float* output, int& padx, int& pady);
+
+/**
+ * ResizeNormalizeInto for the models that take the image bytes and
+ * normalise them in their graph: the resampled values are rounded to
+ * interleaved uint8, output must hold output_size.area() * 3 bytes.
+ */
+bool ResizeInto(const cv::Mat& input, const cv::Size& output_size,
+                bool letterbox, uint8_t* output, int& padx, int& pady);
+}  // namespace mukham
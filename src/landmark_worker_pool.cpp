@@ -0,0 +1,126 @@
+#include "landmark_worker_pool.h"
+
+namespace mukham {
+
+LandmarkWorkerPool::LandmarkWorkerPool(size_t nb_workers) {
+    nb_workers = nb_workers > 0 ? nb_workers : 1;
+    for (size_t i = 0; i < nb_workers; ++i) {
+        worker_models.push_back(std::make_unique<FaceModels>());
+    }
+    for (size_t i = 0; i < nb_workers; ++i) {
+        workers.emplace_back(&LandmarkWorkerPool::_worker_loop, this, i);
+    }
+}
+
+LandmarkWorkerPool::~LandmarkWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    job_ready.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+void LandmarkWorkerPool::LoadModel(LandmarkModelType type,
+                                   const FaceModels& models) {
+    for (auto& worker : worker_models) {
+        if (!worker->ShareLandmarkModel(type, models))
+            worker->LoadLandmarkModel(type);
+    }
+}
+
+void LandmarkWorkerPool::UnloadModel(LandmarkModelType type) {
+    for (auto& models : worker_models) {
+        models->UnloadLandmarkModel(type);
+    }
+}
+
+bool LandmarkWorkerPool::IsModelLoaded(LandmarkModelType type) const {
+    for (const auto& models : worker_models) {
+        if (!models->IsLandmarkModelLoaded(type)) return false;
+    }
+    return true;
+}
+
+void LandmarkWorkerPool::SetThreadOptions(const ModelThreadOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex);
+    thread_options = options;
+    thread_options_version++;
+}
+
+void LandmarkWorkerPool::DetectLandmarks(
+    LandmarkModelType type, cv::Mat& image,
+    const std::vector<cv::Rect2d>& rois,
+    std::vector<std::vector<cv::Point2d>>& landmarks) {
+    landmarks.clear();
+    landmarks.resize(rois.size());
+    if (rois.empty()) return;
+
+    // A single face is not worth the hand-off, the workers are idle so the
+    // models of the first one can be borrowed
+    if (rois.size() == 1) {
+        worker_models.front()->DetectLandmarks(type, image, rois.front(),
+                                               landmarks.front());
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    job = {type, &image, &rois, &landmarks};
+    next_roi = 0;
+    completed = 0;
+    job_active = true;
+    generation++;
+    job_ready.notify_all();
+
+    job_done.wait(lock, [&] {
+        return completed == rois.size() && busy_workers == 0;
+    });
+    job_active = false;
+}
+
+void LandmarkWorkerPool::_worker_loop(size_t worker_idx) {
+    auto& models = *worker_models[worker_idx];
+    uint64_t seen_generation = 0;
+    uint64_t applied_thread_options = 0;
+
+    while (true) {
+        Job current_job;
+        ModelThreadOptions new_thread_options;
+        bool configure_threads = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_ready.wait(lock, [&] {
+                return stop || (job_active && generation != seen_generation);
+            });
+            if (stop) return;
+            seen_generation = generation;
+            current_job = job;
+            busy_workers++;
+            if (applied_thread_options != thread_options_version) {
+                applied_thread_options = thread_options_version;
+                new_thread_options = thread_options;
+                configure_threads = true;
+            }
+        }
+        if (configure_threads) ConfigureModelThreads(new_thread_options);
+
+        const auto& rois = *current_job.rois;
+        size_t nb_processed = 0;
+        for (size_t idx = next_roi++; idx < rois.size(); idx = next_roi++) {
+            models.DetectLandmarks(current_job.type, *current_job.image,
+                                   rois[idx], (*current_job.landmarks)[idx]);
+            nb_processed++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            completed += nb_processed;
+            busy_workers--;
+            if (completed == rois.size() && busy_workers == 0)
+                job_done.notify_one();
+        }
+    }
+}
+}  // namespace mukham
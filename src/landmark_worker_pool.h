@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "face_models.h"
+#include "opencv2/core.hpp"
+#include "runtime_threads.h"
+
+namespace mukham {
+
+/**
+ * Fans the faces of a frame out to a pool of landmark workers.
+ *
+ * A TVM graph executor runs one inference at a time, so every worker owns
+ * its own copy of Facemesh, the copies sharing their weights. dlib's
+ * shape_predictor can be used from several threads at once, the workers all
+ * run the caller's instance. Workers pull the next face from a shared counter
+ * and write the result into the slot of that face, so the output order does
+ * not depend on scheduling.
+ */
+class LandmarkWorkerPool {
+   public:
+    explicit LandmarkWorkerPool(size_t nb_workers);
+    ~LandmarkWorkerPool();
+
+    LandmarkWorkerPool(const LandmarkWorkerPool&) = delete;
+    LandmarkWorkerPool& operator=(const LandmarkWorkerPool&) = delete;
+
+    size_t Size() const { return workers.size(); }
+
+    // Loads the model in every worker, a no-op once it is loaded. The
+    // workers share the model of models when it can be shared, see
+    // FaceModels::ShareLandmarkModel. Slow, it is meant for the thread that
+    // loads the models, see ModelRegistry::SetLandmarkWorkers.
+    void LoadModel(LandmarkModelType type, const FaceModels& models);
+    // A worker running the model keeps its copy until its call returns
+    void UnloadModel(LandmarkModelType type);
+    // True once every worker has its copy
+    bool IsModelLoaded(LandmarkModelType type) const;
+
+    // Applied by every worker before its next job
+    void SetThreadOptions(const ModelThreadOptions& options);
+
+    // landmarks[i] receives the landmarks of rois[i], with the copies
+    // loaded by LoadModel: the faces get no landmarks when the model is not
+    // loaded. Must not be called concurrently from several threads.
+    void DetectLandmarks(LandmarkModelType type, cv::Mat& image,
+                         const std::vector<cv::Rect2d>& rois,
+                         std::vector<std::vector<cv::Point2d>>& landmarks);
+
+   private:
+    struct Job {
+        LandmarkModelType type;
+        cv::Mat* image;
+        const std::vector<cv::Rect2d>* rois;
+        std::vector<std::vector<cv::Point2d>>* landmarks;
+    };
+
+    void _worker_loop(size_t worker_idx);
+
+    std::vector<std::unique_ptr<FaceModels>> worker_models;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable job_done;
+    Job job;
+    uint64_t generation = 0;
+    // A job stays active until every face is done and no worker holds a
+    // pointer into it anymore
+    bool job_active = false;
+    size_t busy_workers = 0;
+    bool stop = false;
+    ModelThreadOptions thread_options;
+    uint64_t thread_options_version = 0;
+
+    std::atomic<size_t> next_roi{0};
+    size_t completed = 0;
+};
+}  // namespace mukham
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+namespace mukham {
+
+using Clock = std::chrono::steady_clock;
+
+inline double ElapsedMs(const Clock::time_point& start,
+                        const Clock::time_point& end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * Collects latency samples (in milliseconds) and reports summary statistics.
+ * All the samples are kept, which is fine for offline runs.
+ */
+class LatencyStats {
+   public:
+    void Add(double value_ms) {
+        samples.push_back(value_ms);
+        sorted = false;
+    }
+
+    void Clear() {
+        samples.clear();
+        sorted = true;
+    }
+
+    size_t Count() const { return samples.size(); }
+
+    double Total() const {
+        return std::accumulate(samples.begin(), samples.end(), 0.0);
+    }
+
+    double Mean() const {
+        return samples.empty() ? 0.0 : Total() / samples.size();
+    }
+
+    double Min() {
+        _sort();
+        return samples.empty() ? 0.0 : samples.front();
+    }
+
+    double Max() {
+        _sort();
+        return samples.empty() ? 0.0 : samples.back();
+    }
+
+    // Nearest-rank percentile, p in [0, 100]
+    double Percentile(double p) {
+        if (samples.empty()) return 0.0;
+        _sort();
+        auto rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+        rank = std::clamp<size_t>(rank, 1, samples.size());
+        return samples[rank - 1];
+    }
+
+   private:
+    void _sort() {
+        if (!sorted) {
+            std::sort(samples.begin(), samples.end());
+            sorted = true;
+        }
+    }
+
+    std::vector<double> samples;
+    bool sorted = true;
+};
+}  // namespace mukham
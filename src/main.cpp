@@ -6,7 +6,6 @@
 #include <algorithm>
 #include <chrono>
 #include <cmath>
-#include <deque>
 #include <filesystem>
 #include <limits>
 #include <memory>
@@ -18,19 +17,20 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/videoio.hpp>
 #include <string>
+#include <thread>
 #include <utility>
 
-#include "dlib_face_detection.h"
+#include "face_models.h"
+#include "frame_pipeline.h"
 #include "imgui.h"
 #include "imgui_impl_opengl2.h"
 #include "imgui_impl_sdl.h"
 #include "implot.h"
 #include "iou.hpp"
-#include "opencv_face_detection.h"
+#include "memory_usage.h"
+#include "model_registry.h"
 #include "spdlog/spdlog.h"
-#include "tvm_blazeface.h"
-#include "tvm_deeplab_segmentation.h"
-#include "tvm_facemesh.h"
+#include "tvm_model.h"
 
 const unsigned int display_image_width = 512;
 unsigned int display_image_height = 512;
@@ -140,51 +140,23 @@ int main(int argc, char **argv) {
     RollingBuffer face_detect_time(100);
     RollingBuffer bg_elimination_time(100);
 
-    // Load models
-    auto cwd = fs::current_path();
-#ifdef _WIN32
-    auto model_path = cwd / "models/facemesh/face_landmark.dll";
-    auto blazeface_model_path =
-        cwd / "models/blazeface/face_detection_front.dll";
-#else
-    auto model_path =
-        cwd / fs::path(std::string("models/facemesh/face_landmark.so"));
-    auto blazeface_model_path =
-        cwd /
-        fs::path(std::string("models/blazeface/face_detection_front.so"));
-#endif
-
-    int batch_size = 1;
-    std::vector<cv::Mat> frames;
-    std::deque<cv::Mat> render_frames;
-    std::deque<cv::Mat> face_images;
-    std::deque<cv::Mat> face_landmark_images;
-    cv::Mat last_frame;
-
     bool rotate_image = false;
     int rot_angle = 0;
     bool face_mesh = false;
     float roi_scale = 1.0;
+    bool track_faces = false;
+    int keyframe_interval = 15;
+    bool motion_gate = false;
     int landmark_model_choice = 0;
 
+    int backpressure_policy =
+        static_cast<int>(mukham::BackpressurePolicy::LatestOnly);
+    bool native_frame_rate = true;
+
     bool enable_bg_elimination = false;
     int bg_elmination_method = 0;
 
-    spdlog::info("Loading facemesh model");
-    auto face_mesh_detector =
-        tvm_facemesh::TVM_Facemesh(model_path, batch_size);
-    spdlog::info("Loading dlib model");
-    auto dlib_hog_face_detector = dlib_facedetect::DlibFaceDetectHog();
-    spdlog::info("Loading opencv model");
-    auto opencv_lbp_face_detector = opencv_facedetect::OpenCVFaceDetectLBP();
-    spdlog::info("Loading opencv dnn model");
-    auto opencv_tf_face_detector = opencv_facedetect::OpenCVFaceDetectTF();
-    spdlog::info("Loading Blazeface model");
-    auto blazeface_face_detector =
-        tvm_blazeface::TVM_Blazeface(blazeface_model_path);
-    spdlog::info("Loading dlib landmarks model");
-    auto dlib_landmarks_detector = dlib_facedetect::DlibFaceLandmarks();
-    auto deeplab_model = mukham::DeeplabSegmentationModel();
+    mukham::FaceModels face_models;
 
     // Setup window
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
@@ -237,14 +209,26 @@ int main(int argc, char **argv) {
     bool play_video = false;
     bool is_camera_open = false;
     int face_detect_model = 3;
+    int detection_tiles = 1;
     int video_src = 1;
     int prev_video_src = 0;
-    unsigned int nb_frames = 0;
+    int64_t nb_frames = 0;
+    int64_t counter = 0;
     float alpha = 1.2;
     float beta = 5;
 
-    cv::VideoCapture camera;
-    cv::Rect2d prev_bbox;
+    // capture -> preprocess -> detect -> landmark run on worker threads,
+    // this loop is the render stage. The faces of a frame are spread over
+    // the landmark workers.
+    const size_t landmark_workers =
+        (std::max)(2u, std::thread::hardware_concurrency() / 2);
+    mukham::FramePipeline pipeline(face_models, 4, landmark_workers);
+
+    // The models are loaded in the background the first time they are
+    // selected, so the window shows up right away. Declared after the
+    // pipeline, its thread is stopped before the landmark workers go away.
+    mukham::ModelRegistry model_registry(face_models);
+    model_registry.SetLandmarkWorkers(pipeline.GetLandmarkWorkers());
 
     // Main loop
     bool done = false;
@@ -264,9 +248,6 @@ int main(int argc, char **argv) {
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
         {
-            static float f = 0.0f;
-            static int counter = 0;
-
             ImGui::Begin("Mukham");
 
             ImGui::RadioButton("Camera", &video_src, 0);
@@ -274,7 +255,7 @@ int main(int argc, char **argv) {
             ImGui::RadioButton("Test Video 2", &video_src, 2);
 
             if (video_src != prev_video_src) {
-                camera.release();
+                pipeline.Stop();
                 prev_video_src = video_src;
                 spdlog::info("Camera released\n");
                 is_camera_open = false;
@@ -282,12 +263,15 @@ int main(int argc, char **argv) {
 
             if (video_src == 0) {
                 if (!is_camera_open) {
-                    spdlog::info("Opening the camera\n\n");
-                    is_camera_open = camera.open(0);
-                    camera.set(cv::CAP_PROP_FRAME_HEIGHT,
-                               (double)display_image_height);
-                    camera.set(cv::CAP_PROP_FRAME_WIDTH,
-                               (double)display_image_width);
+                    mukham::VideoSource source;
+                    source.camera_index = 0;
+                    source.camera_size =
+                        cv::Size(display_image_width, display_image_height);
+                    pipeline.SetPaused(!record_video);
+                    pipeline.SetBackpressurePolicy(
+                        static_cast<mukham::BackpressurePolicy>(
+                            backpressure_policy));
+                    is_camera_open = pipeline.Start(source);
                 }
                 // If the video src is camera then show the start video
                 // and stop video buttons
@@ -303,8 +287,16 @@ int main(int argc, char **argv) {
                 const cv::String test_video_fname{video_file_name};
 
                 if (!is_camera_open) {
-                    is_camera_open = camera.open(test_video_fname);
-                    nb_frames = camera.get(cv::CAP_PROP_FRAME_COUNT);
+                    mukham::VideoSource source;
+                    source.file_name = test_video_fname;
+                    source.loop = video_src == 1;
+                    source.realtime = native_frame_rate;
+                    pipeline.SetPaused(!record_video);
+                    pipeline.SetBackpressurePolicy(
+                        static_cast<mukham::BackpressurePolicy>(
+                            backpressure_policy));
+                    is_camera_open = pipeline.Start(source);
+                    nb_frames = pipeline.GetFrameCount();
                 }
                 // Show the play and pause button
                 if (ImGui::Button(play_btn_txt.c_str())) {
@@ -318,10 +310,35 @@ int main(int argc, char **argv) {
                     "https://github.com/intel-iot-devkit/sample-videos");
             }
 
-            ImGui::Text("Frames = %d", counter);
+            ImGui::Text("Frames = %d", (int)counter);
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                         1000.0f / ImGui::GetIO().Framerate,
                         ImGui::GetIO().Framerate);
+            ImGui::Text("Dropped frames = %llu",
+                        (unsigned long long)pipeline.GetDroppedFrames());
+            ImGui::Checkbox("Skip static frames", &motion_gate);
+            if (motion_gate) {
+                const auto gate_stats = pipeline.GetMotionGateStats();
+                ImGui::Text("Static frames = %llu (%.1f%%)",
+                            (unsigned long long)gate_stats.static_frames,
+                            gate_stats.HitRate() * 100.0);
+            }
+            if (ImGui::CollapsingHeader("Memory")) {
+                const auto memory = mukham::GetMemoryUsage();
+                ImGui::Text("Resident %.1f MB, peak %.1f MB",
+                            memory.ResidentMB(), memory.PeakResidentMB());
+                ImGui::Text("TVM modules loaded = %zu",
+                            mukham::TvmModel::NumLoadedModels());
+            }
+            if (ImGui::CollapsingHeader("Pipeline queues")) {
+                for (const auto &queue : pipeline.GetQueueStats()) {
+                    ImGui::Text("%-10s depth %zu/%zu  stalls push %llu pop %llu",
+                                queue.name.c_str(), queue.stats.depth,
+                                queue.stats.capacity,
+                                (unsigned long long)queue.stats.push_stalls,
+                                (unsigned long long)queue.stats.pop_stalls);
+                }
+            }
             ImGui::End();
 
             ImGui::Begin("Landmark detection time");
@@ -378,6 +395,19 @@ int main(int argc, char **argv) {
                 }
             }
 
+            if (ImGui::CollapsingHeader("Frame dropping")) {
+                // The pipeline is restarted for the queue sizes and the
+                // pacing to change
+                if (ImGui::RadioButton("Block", &backpressure_policy, 0))
+                    is_camera_open = false;
+                if (ImGui::RadioButton("Drop oldest", &backpressure_policy, 1))
+                    is_camera_open = false;
+                if (ImGui::RadioButton("Latest frame", &backpressure_policy, 2))
+                    is_camera_open = false;
+                if (ImGui::Checkbox("Native frame rate", &native_frame_rate))
+                    is_camera_open = false;
+            }
+
             if (ImGui::CollapsingHeader("Face detection")) {
                 ImGui::RadioButton("Dlib HOG Face detection",
                                    &face_detect_model, 0);
@@ -386,7 +416,11 @@ int main(int argc, char **argv) {
                 ImGui::RadioButton("OpenCV TF Face detection",
                                    &face_detect_model, 2);
                 ImGui::RadioButton("BlazeFace Model", &face_detect_model, 3);
+                ImGui::RadioButton("BlazeFace full range", &face_detect_model,
+                                   4);
                 ImGui::Separator();
+                ImGui::SliderInt("BlazeFace tiles per side", &detection_tiles,
+                                 1, 4);
             }
 
             if (ImGui::CollapsingHeader("Landmark detection")) {
@@ -396,10 +430,18 @@ int main(int argc, char **argv) {
                 ImGui::RadioButton("Facemeh model", &landmark_model_choice, 1);
                 ImGui::Separator();
                 ImGui::SliderFloat("ROI scale", &roi_scale, 1.0, 3.0, "%.1f");
+                ImGui::Checkbox("Track faces between keyframes", &track_faces);
+                ImGui::SliderInt("Keyframe interval", &keyframe_interval, 1,
+                                 60);
             }
 
             if (ImGui::CollapsingHeader("Background Elimination")) {
                 ImGui::Checkbox("Enable", &enable_bg_elimination);
+                if (enable_bg_elimination) {
+                    ImGui::Text("Deeplab v3: %s",
+                                mukham::ToString(
+                                    model_registry.GetSegmentationState()));
+                }
                 ImGui::Separator();
                 ImGui::RadioButton("Deeplab v3", &bg_elmination_method, 0);
                 ImGui::RadioButton("HRNet", &bg_elmination_method, 1);
@@ -409,178 +451,90 @@ int main(int argc, char **argv) {
 
             ImGui::End();
 
+            // Hand the GUI parameters over to the pipeline stages
+            auto get_rotate_code = [](int x) -> int {
+                switch (x) {
+                    case 0:
+                        return cv::ROTATE_90_CLOCKWISE;
+                    case 1:
+                        return cv::ROTATE_180;
+                    case 2:
+                        return cv::ROTATE_90_COUNTERCLOCKWISE;
+                    default:
+                        return cv::ROTATE_90_CLOCKWISE;
+                }
+            };
+
+            mukham::PipelineSettings settings;
+            settings.detector =
+                static_cast<mukham::FaceDetectorType>(face_detect_model);
+            settings.landmarks =
+                face_mesh ? static_cast<mukham::LandmarkModelType>(
+                                landmark_model_choice)
+                          : mukham::LandmarkModelType::None;
+            settings.roi_scale = roi_scale;
+            settings.resize_factor = 0.5;
+            settings.alpha = alpha;
+            settings.beta = beta;
+            settings.rotate_code =
+                rotate_image ? get_rotate_code(rot_angle) : -1;
+            settings.tiles.rows = detection_tiles;
+            settings.tiles.cols = detection_tiles;
+            settings.track_faces = track_faces;
+            settings.tracking.keyframe_interval = keyframe_interval;
+            settings.motion_gate = motion_gate;
+            pipeline.SetSettings(settings);
+            pipeline.SetPaused(!record_video);
+
+            // Until they are ready the frames are shown without detections
+            const bool models_ready =
+                model_registry.Use(settings.detector, settings.landmarks);
+            if (enable_bg_elimination) model_registry.UseSegmentation();
+
             ImGui::Begin("Video");
+            if (!models_ready) {
+                const auto detector_state =
+                    model_registry.GetState(settings.detector);
+                const auto landmark_state =
+                    model_registry.GetState(settings.landmarks);
+                ImGui::Text("Detector: %s, landmarks: %s",
+                            mukham::ToString(detector_state),
+                            mukham::ToString(landmark_state));
+            }
             if (record_video) {
-                // Get the video frame
-
-                cv::Mat frame;
-                auto retval = camera.read(frame);
-                if (retval) {
-                    // Convert the frame to RGB
-                    cv::cvtColor(frame, frame, cv::COLOR_BGR2RGB);
-                    counter++;
-
-                    // Reset the video
-                    if (video_src == 1 && counter == nb_frames) {
-                        camera.set(cv::CAP_PROP_POS_FRAMES, 0);
-                        counter = 0;
-                    }
-
-                    cv::Mat small_frame;
-                    cv::resize(frame, small_frame, cv::Size(0, 0), 0.5, 0.5,
-                               cv::INTER_LINEAR);
-                    if (rotate_image) {
-                        auto get_rotate_code = [](int x) -> int {
-                            switch (x) {
-                                case 0:
-                                    return cv::ROTATE_90_CLOCKWISE;
-                                case 1:
-                                    return cv::ROTATE_180;
-                                case 2:
-                                    return cv::ROTATE_90_COUNTERCLOCKWISE;
-                                default:
-                                    return cv::ROTATE_90_CLOCKWISE;
-                            }
-                        };
-                        auto rotate_code = get_rotate_code(rot_angle);
-                        cv::rotate(small_frame, small_frame, rotate_code);
-                    }
-                    cv::Mat adjusted_frame;
-
-                    // preprocessing
-                    // increase the brightness
-                    small_frame.convertTo(adjusted_frame, -1, alpha, beta);
-
-                    auto start = std::chrono::steady_clock::now();
-                    std::vector<cv::Rect2d> faces;
-                    std::vector<cv::Point2d> keypoints;
-
-                    cv::Mat bgr_frame;
-                    switch (face_detect_model) {
-                        case 0:
-                            faces = dlib_hog_face_detector.DetectFace(
-                                adjusted_frame);
-                            break;
-                        case 1:
-                            faces = opencv_lbp_face_detector.DetectFace(
-                                adjusted_frame);
-                            break;
-                        case 2:
-                            faces = opencv_tf_face_detector.DetectFace(adjusted_frame);
-                            break;
-                        case 3:
-                            auto detections =
-                                blazeface_face_detector.DetectFace(
-                                    adjusted_frame);
-                            for (const auto &d : detections) {
-                                faces.push_back(d.bounding_box);
-                                for (const auto &k : d.key_points) {
-                                    keypoints.push_back(k);
-                                }
-                            }
-                            break;
-                    }
-                    auto end = std::chrono::steady_clock::now();
-
-                    auto face_detect_duration =
-                        std::chrono::duration_cast<std::chrono::milliseconds>(
-                            end - start)
-                            .count();
-                    face_detect_time.AddPoint(face_detect_duration);
-
-                    for (const auto &face : faces) {
-                        // Render the bounding box
-                        cv::rectangle(adjusted_frame, face,
+                mukham::FrameData result;
+                if (pipeline.TryGetResult(result)) {
+                    counter = nb_frames > 0 ? result.index % nb_frames
+                                            : result.index;
+                    face_detect_time.AddPoint(result.detect_ms);
+                    if (result.has_landmarks)
+                        landmark_detect_time.AddPoint(result.landmark_ms);
+
+                    auto &adjusted_frame = result.frame;
+                    const auto &faces = result.detections.faces;
+                    for (size_t i = 0; i < faces.size(); ++i) {
+                        // Render the bounding box and the track ID
+                        cv::rectangle(adjusted_frame, faces[i],
                                       cv::Scalar(255, 0, 0), 2);
+                        if (i < result.face_ids.size()) {
+                            cv::putText(adjusted_frame,
+                                        std::to_string(result.face_ids[i]),
+                                        faces[i].tl(), cv::FONT_HERSHEY_SIMPLEX,
+                                        0.6, cv::Scalar(255, 255, 0), 2);
+                        }
                     }
-                    for (const auto &k : keypoints) {
+                    for (const auto &k : result.detections.keypoints) {
                         cv::circle(adjusted_frame, k, 2, cv::Scalar(0, 0, 255),
                                    -1);
                     }
-
-                    if (face_mesh) {
-                        start = std::chrono::steady_clock::now();
-                        for (cv::Rect2d &face : faces) {
-                            auto face_center_x = face.x + (face.width * 0.5);
-                            auto face_center_y = face.y + (face.height * 0.5);
-
-                            auto start_row =
-                                face_center_y - roi_scale * (face.height * 0.5);
-                            start_row = (std::max)(0.0, start_row);
-
-                            auto start_col =
-                                face_center_x - roi_scale * (face.width * 0.5);
-                            start_col = (std::max)(0.0, start_col);
-
-                            auto end_row =
-                                face_center_y + roi_scale * (face.height * 0.5);
-                            end_row = (std::min)(end_row,
-                                                 (double)adjusted_frame.rows);
-
-                            auto end_col =
-                                face_center_x + roi_scale * (face.width * 0.5);
-                            end_col = (std::min)(end_col,
-                                                 (double)adjusted_frame.cols);
-
-                            const auto face_image =
-                                adjusted_frame(cv::Range(start_row, end_row),
-                                               cv::Range(start_col, end_col));
-
-                            switch (landmark_model_choice) {
-                                case 0: {
-                                    // dlib landmarks
-                                    auto face_roi =
-                                        cv::Rect2d(start_col, start_row,
-                                                   (end_col - start_col),
-                                                   (end_row - start_row));
-
-                                    auto dlib_landmarks =
-                                        dlib_landmarks_detector.DetectLandmarks(
-                                            adjusted_frame, face_roi);
-
-                                    for (auto &point : dlib_landmarks) {
-                                        cv::circle(
-                                            adjusted_frame,
-                                            cv::Point2d(point.x, point.y), 1,
-                                            cv::Scalar(0, 255, 0), -1);
-                                    }
-                                } break;
-                                case 1: {
-                                    // facemesh landmarks
-                                    tvm_facemesh::TVM_FacemeshResult result;
-                                    face_mesh_detector.Detect(face_image,
-                                                              result);
-
-                                    if (result.has_face) {
-                                        for (auto &point : result.mesh) {
-                                            auto adjusted_point = cv::Point2d(
-                                                start_col + point.x,
-                                                start_row + point.y);
-                                            cv::circle(
-                                                adjusted_frame, adjusted_point,
-                                                0, cv::Scalar(0, 255, 0), -1);
-                                        }
-                                    } else {
-                                        spdlog::info("No face. face score {}",
-                                                     result.face_score);
-                                    }
-                                } break;
-                            }
+                    for (const auto &landmarks : result.landmarks) {
+                        for (const auto &point : landmarks) {
+                            cv::circle(adjusted_frame, point, 1,
+                                       cv::Scalar(0, 255, 0), -1);
                         }
-                        end = std::chrono::steady_clock::now();
-                        auto landmark_detect_duration =
-                            std::chrono::duration_cast<
-                                std::chrono::milliseconds>(end - start)
-                                .count();
-                        landmark_detect_time.AddPoint(landmark_detect_duration);
                     }
 
-                    render_frames.push_back(adjusted_frame);
-                }
-
-                if (!render_frames.empty()) {
-                    img_renderer.UpdateAndRender(render_frames.front());
-                    render_frames.pop_front();
+                    img_renderer.UpdateAndRender(adjusted_frame);
                 }
                 GLuint texture_id = img_renderer.GetTextureId();
                 ImGui::Image((void *)(intptr_t)(texture_id),
@@ -601,6 +555,7 @@ int main(int argc, char **argv) {
     }
 
     // Cleanup
+    pipeline.Stop();
     ImGui_ImplOpenGL2_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImPlot::DestroyContext();
@@ -0,0 +1,31 @@
+#include "memory_usage.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace mukham {
+
+MemoryUsage GetMemoryUsage() {
+    MemoryUsage usage;
+#if defined(__linux__)
+    // "VmRSS:    123456 kB"
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        size_t* value = nullptr;
+        if (line.rfind("VmRSS:", 0) == 0)
+            value = &usage.resident_bytes;
+        else if (line.rfind("VmHWM:", 0) == 0)
+            value = &usage.peak_resident_bytes;
+        if (!value) continue;
+
+        std::istringstream fields(line.substr(6));
+        size_t kilobytes = 0;
+        fields >> kilobytes;
+        *value = kilobytes * 1024;
+    }
+#endif
+    return usage;
+}
+}  // namespace mukham
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+namespace mukham {
+
+struct MemoryUsage {
+    // Resident set size of the process and its high water mark, 0 when the
+    // platform does not report them
+    size_t resident_bytes = 0;
+    size_t peak_resident_bytes = 0;
+
+    double ResidentMB() const { return resident_bytes / (1024.0 * 1024.0); }
+    double PeakResidentMB() const {
+        return peak_resident_bytes / (1024.0 * 1024.0);
+    }
+};
+
+MemoryUsage GetMemoryUsage();
+}  // namespace mukham
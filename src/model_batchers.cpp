@@ -0,0 +1,90 @@
+#include "model_batchers.h"
+
+namespace mukham {
+
+ModelBatchers::ModelBatchers(FaceModels& models,
+                             const DynamicBatcherOptions& detector_options,
+                             const DynamicBatcherOptions& landmark_options)
+    : face_models(models),
+      detector_batcher(
+          [this](auto& requests, auto& results) {
+              _detect_batch(requests, results);
+          },
+          detector_options),
+      landmark_batcher(
+          [this](auto& requests, auto& results) {
+              _landmark_batch(requests, results);
+          },
+          landmark_options) {}
+
+void ModelBatchers::_detect_batch(std::vector<DetectionRequest>& requests,
+                                  std::vector<FaceDetections>& results) {
+    results.resize(requests.size());
+
+    // A settings change can mix detectors in one batch, the requests of each
+    // detector run together
+    std::vector<char> done(requests.size(), 0);
+    std::vector<size_t> group;
+    std::vector<cv::Mat> images;
+    std::vector<FaceDetections> detections;
+    for (size_t first = 0; first < requests.size(); ++first) {
+        if (done[first]) continue;
+        const auto detector = requests[first].detector;
+
+        group.clear();
+        images.clear();
+        for (size_t idx = first; idx < requests.size(); ++idx) {
+            auto& request = requests[idx];
+            if (done[idx] || request.detector != detector) continue;
+            done[idx] = 1;
+
+            // The tiles of a frame are already a batch of their own
+            if (request.tiles.NumTiles() > 1) {
+                face_models.DetectFaces(detector, request.image,
+                                        request.tiles, results[idx]);
+                continue;
+            }
+            group.push_back(idx);
+            images.push_back(request.image);
+        }
+
+        if (images.empty()) continue;
+        face_models.DetectFaces(detector, images, detections);
+        for (size_t item = 0; item < group.size(); ++item) {
+            results[group[item]] = std::move(detections[item]);
+        }
+    }
+}
+
+void ModelBatchers::_landmark_batch(
+    std::vector<LandmarkRequest>& requests,
+    std::vector<std::vector<cv::Point2d>>& results) {
+    results.resize(requests.size());
+
+    std::vector<char> done(requests.size(), 0);
+    std::vector<size_t> group;
+    std::vector<cv::Mat> images;
+    std::vector<cv::Rect2d> rois;
+    std::vector<std::vector<cv::Point2d>> landmarks;
+    for (size_t first = 0; first < requests.size(); ++first) {
+        if (done[first]) continue;
+        const auto model = requests[first].model;
+
+        group.clear();
+        images.clear();
+        rois.clear();
+        for (size_t idx = first; idx < requests.size(); ++idx) {
+            if (done[idx] || requests[idx].model != model) continue;
+            done[idx] = 1;
+            group.push_back(idx);
+            images.push_back(requests[idx].image);
+            rois.push_back(requests[idx].roi);
+        }
+
+        face_models.DetectLandmarks(model, images, rois, landmarks);
+        for (size_t item = 0; item < group.size(); ++item) {
+            results[group[item]] = std::move(landmarks[item]);
+        }
+    }
+}
+}  // namespace mukham
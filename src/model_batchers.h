@@ -0,0 +1,64 @@
+#pragma once
+
+#include <future>
+#include <vector>
+
+#include "dynamic_batcher.h"
+#include "face_models.h"
+#include "opencv2/core.hpp"
+#include "tvm_blazeface.h"
+
+namespace mukham {
+
+struct DetectionRequest {
+    FaceDetectorType detector;
+    cv::Mat image;
+    tvm_blazeface::TileOptions tiles;
+};
+
+struct LandmarkRequest {
+    LandmarkModelType model;
+    cv::Mat image;
+    cv::Rect2d roi;
+};
+
+/**
+ * Dynamic batchers in front of the face detector and the landmark model.
+ *
+ * Threads processing different streams submit their frames and faces here
+ * and wait on the futures, the batchers run them through the batched
+ * Blazeface and Facemesh inferences. Each model is only run by the thread of
+ * its batcher, so the two models run concurrently but never reentrantly.
+ *
+ * A request whose model is not loaded gets an empty result.
+ */
+class ModelBatchers {
+   public:
+    ModelBatchers(FaceModels& models,
+                  const DynamicBatcherOptions& detector_options,
+                  const DynamicBatcherOptions& landmark_options);
+
+    std::future<FaceDetections> DetectFaces(DetectionRequest request) {
+        return detector_batcher.Submit(std::move(request));
+    }
+
+    std::future<std::vector<cv::Point2d>> DetectLandmarks(
+        LandmarkRequest request) {
+        return landmark_batcher.Submit(std::move(request));
+    }
+
+    BatcherStats GetDetectorStats() { return detector_batcher.GetStats(); }
+    BatcherStats GetLandmarkStats() { return landmark_batcher.GetStats(); }
+
+   private:
+    void _detect_batch(std::vector<DetectionRequest>& requests,
+                       std::vector<FaceDetections>& results);
+    void _landmark_batch(std::vector<LandmarkRequest>& requests,
+                         std::vector<std::vector<cv::Point2d>>& results);
+
+    FaceModels& face_models;
+    DynamicBatcher<DetectionRequest, FaceDetections> detector_batcher;
+    DynamicBatcher<LandmarkRequest, std::vector<cv::Point2d>>
+        landmark_batcher;
+};
+}  // namespace mukham
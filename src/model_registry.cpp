@@ -0,0 +1,331 @@
+#include "model_registry.h"
+
+#include <exception>
+#include <utility>
+#include <vector>
+
+#include "landmark_worker_pool.h"
+#include "spdlog/spdlog.h"
+#include "tvm_deeplab_segmentation.h"
+
+namespace mukham {
+
+const char* ToString(ModelState state) {
+    switch (state) {
+        case ModelState::Unloaded:
+            return "unloaded";
+        case ModelState::Loading:
+            return "loading";
+        case ModelState::Ready:
+            return "ready";
+        case ModelState::Failed:
+            return "failed";
+    }
+    return "unknown";
+}
+
+ModelRegistry::ModelRegistry(FaceModels& models,
+                             const ModelRegistryOptions& options)
+    : face_models(models), options(options) {
+    loader = std::thread(&ModelRegistry::_loader_loop, this);
+}
+
+ModelRegistry::~ModelRegistry() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    model_requested.notify_one();
+    if (loader.joinable()) loader.join();
+}
+
+void ModelRegistry::SetLandmarkWorkers(LandmarkWorkerPool* workers) {
+    std::lock_guard<std::mutex> lock(mutex);
+    landmark_workers = workers;
+}
+
+bool ModelRegistry::Use(FaceDetectorType detector,
+                        LandmarkModelType landmark_model) {
+    const auto now = Clock::now();
+    bool queued = false;
+    auto use = [&](Entry& entry) {
+        entry.last_used = now;
+        if (entry.state == ModelState::Unloaded) {
+            entry.state = ModelState::Loading;
+            queued = true;
+        }
+        return entry.state == ModelState::Ready;
+    };
+
+    bool ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready = use(detectors[detector]);
+        if (landmark_model != LandmarkModelType::None)
+            ready = use(landmark_models[landmark_model]) && ready;
+    }
+    if (queued) model_requested.notify_one();
+    return ready;
+}
+
+ModelState ModelRegistry::GetState(FaceDetectorType type) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = detectors.find(type);
+    return entry != detectors.end() ? entry->second.state
+                                    : ModelState::Unloaded;
+}
+
+ModelState ModelRegistry::GetState(LandmarkModelType type) {
+    if (type == LandmarkModelType::None) return ModelState::Ready;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = landmark_models.find(type);
+    return entry != landmark_models.end() ? entry->second.state
+                                          : ModelState::Unloaded;
+}
+
+bool ModelRegistry::UseSegmentation() {
+    bool queued = false;
+    bool ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        segmentation.last_used = Clock::now();
+        if (segmentation.state == ModelState::Unloaded) {
+            segmentation.state = ModelState::Loading;
+            queued = true;
+        }
+        ready = segmentation.state == ModelState::Ready;
+    }
+    if (queued) model_requested.notify_one();
+    return ready;
+}
+
+ModelState ModelRegistry::GetSegmentationState() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return segmentation.state;
+}
+
+std::shared_ptr<DeeplabSegmentationModel> ModelRegistry::GetSegmentationModel()
+    const {
+    return std::atomic_load(&segmentation_model);
+}
+
+void ModelRegistry::WaitUntilLoaded() {
+    auto is_loading = [](const auto& entries) {
+        for (const auto& entry : entries) {
+            if (entry.second.state == ModelState::Loading) return true;
+        }
+        return false;
+    };
+
+    std::unique_lock<std::mutex> lock(mutex);
+    model_loaded.wait(lock, [&] {
+        return stop ||
+               (!is_loading(detectors) && !is_loading(landmark_models) &&
+                segmentation.state != ModelState::Loading);
+    });
+}
+
+void ModelRegistry::_loader_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stop) {
+        // The detectors go first, nothing is drawn without them
+        bool loaded_one = false;
+        for (auto& [type, entry] : detectors) {
+            if (entry.state != ModelState::Loading) continue;
+            lock.unlock();
+            const bool ready = _load_detector(type);
+            lock.lock();
+            entry.state = ready ? ModelState::Ready : ModelState::Failed;
+            loaded_one = true;
+            break;
+        }
+        if (!loaded_one) {
+            for (auto& [type, entry] : landmark_models) {
+                if (entry.state != ModelState::Loading) continue;
+                lock.unlock();
+                const bool ready = _load_landmark_model(type);
+                lock.lock();
+                entry.state = ready ? ModelState::Ready : ModelState::Failed;
+                loaded_one = true;
+                break;
+            }
+        }
+        if (!loaded_one && segmentation.state == ModelState::Loading) {
+            lock.unlock();
+            const bool ready = _load_segmentation_model();
+            lock.lock();
+            segmentation.state = ready ? ModelState::Ready : ModelState::Failed;
+            loaded_one = true;
+        }
+        if (loaded_one) {
+            model_loaded.notify_all();
+            continue;
+        }
+
+        lock.unlock();
+        _unload_idle();
+        lock.lock();
+        if (stop) break;
+        model_requested.wait_for(lock, std::chrono::seconds(1));
+    }
+    model_loaded.notify_all();
+}
+
+bool ModelRegistry::_load_detector(FaceDetectorType type) {
+    if (face_models.IsDetectorLoaded(type)) return true;
+
+    const auto start = Clock::now();
+    FaceModels staging;
+    try {
+        staging.LoadDetector(type);
+        cv::Mat frame(options.warmup_frame_size, CV_8UC3, cv::Scalar::all(0));
+        FaceDetections detections;
+        for (int run = 0; run < options.warmup_runs; ++run) {
+            if (!staging.DetectFaces(type, frame, detections)) {
+                spdlog::error("{} failed its warm-up inference",
+                              ToString(type));
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("Failed to load {}: {}", ToString(type), e.what());
+        return false;
+    }
+
+    face_models.TakeDetector(type, staging);
+    spdlog::info("{} ready in {:.1f} ms", ToString(type),
+                 ElapsedMs(start, Clock::now()));
+    return true;
+}
+
+bool ModelRegistry::_load_landmark_model(LandmarkModelType type) {
+    // Loaded by the caller, the workers may still miss their copies
+    if (face_models.IsLandmarkModelLoaded(type)) {
+        _load_worker_copies(type, face_models);
+        return true;
+    }
+
+    const auto start = Clock::now();
+    FaceModels staging;
+    try {
+        staging.LoadLandmarkModel(type);
+        cv::Mat frame(options.warmup_frame_size, CV_8UC3, cv::Scalar::all(0));
+        const cv::Rect2d roi(frame.cols / 4, frame.rows / 4, frame.cols / 2,
+                             frame.rows / 2);
+        std::vector<cv::Point2d> landmarks;
+        for (int run = 0; run < options.warmup_runs; ++run) {
+            if (!staging.DetectLandmarks(type, frame, roi, landmarks)) {
+                spdlog::error("{} failed its warm-up inference",
+                              ToString(type));
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("Failed to load {}: {}", ToString(type), e.what());
+        return false;
+    }
+
+    // The workers are not used before the shared model is handed over, so
+    // their copies are ready by then
+    _load_worker_copies(type, staging);
+    face_models.TakeLandmarkModel(type, staging);
+    spdlog::info("{} ready in {:.1f} ms", ToString(type),
+                 ElapsedMs(start, Clock::now()));
+    return true;
+}
+
+bool ModelRegistry::_load_segmentation_model() {
+    if (std::atomic_load(&segmentation_model)) return true;
+
+    const auto start = Clock::now();
+    std::shared_ptr<DeeplabSegmentationModel> model;
+    try {
+        model = std::make_shared<DeeplabSegmentationModel>();
+        if (!model->CanExecute()) {
+            spdlog::error("Failed to load the Deeplab model");
+            return false;
+        }
+        cv::Mat frame(options.warmup_frame_size, CV_8UC3, cv::Scalar::all(0));
+        cv::Mat segmentation;
+        for (int run = 0; run < options.warmup_runs; ++run) {
+            model->Segment(frame, segmentation);
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("Failed to load the Deeplab model: {}", e.what());
+        return false;
+    }
+
+    std::atomic_store(&segmentation_model, model);
+    spdlog::info("Deeplab ready in {:.1f} ms", ElapsedMs(start, Clock::now()));
+    return true;
+}
+
+void ModelRegistry::_load_worker_copies(LandmarkModelType type,
+                                        const FaceModels& models) {
+    LandmarkWorkerPool* workers;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        workers = landmark_workers;
+    }
+    // The pool only runs the per-face models, see FramePipeline
+    if (!workers || models.GetLandmarkBatchSize(type) != 1) return;
+
+    // Without their copies the faces run on the shared model
+    try {
+        workers->LoadModel(type, models);
+    } catch (const std::exception& e) {
+        spdlog::error("Failed to load {} in the landmark workers: {}",
+                      ToString(type), e.what());
+    }
+}
+
+void ModelRegistry::_unload_idle() {
+    if (options.idle_unload_s <= 0.0) return;
+
+    std::vector<FaceDetectorType> idle_detectors;
+    std::vector<LandmarkModelType> idle_landmark_models;
+    LandmarkWorkerPool* workers;
+    bool idle_segmentation = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        workers = landmark_workers;
+        const auto now = Clock::now();
+        auto is_idle = [&](const Entry& entry) {
+            return entry.state == ModelState::Ready &&
+                   ElapsedMs(entry.last_used, now) >
+                       options.idle_unload_s * 1000.0;
+        };
+        for (auto& [type, entry] : detectors) {
+            if (!is_idle(entry)) continue;
+            entry.state = ModelState::Unloaded;
+            idle_detectors.push_back(type);
+        }
+        for (auto& [type, entry] : landmark_models) {
+            if (!is_idle(entry)) continue;
+            entry.state = ModelState::Unloaded;
+            idle_landmark_models.push_back(type);
+        }
+        if (is_idle(segmentation)) {
+            segmentation.state = ModelState::Unloaded;
+            idle_segmentation = true;
+        }
+    }
+
+    // Destroyed here, or by the last call still running them
+    for (auto type : idle_detectors) {
+        spdlog::info("Unloading the idle {}", ToString(type));
+        face_models.UnloadDetector(type);
+    }
+    for (auto type : idle_landmark_models) {
+        spdlog::info("Unloading the idle {}", ToString(type));
+        face_models.UnloadLandmarkModel(type);
+        if (workers) workers->UnloadModel(type);
+    }
+    if (idle_segmentation) {
+        spdlog::info("Unloading the idle Deeplab model");
+        std::atomic_store(&segmentation_model,
+                          std::shared_ptr<DeeplabSegmentationModel>());
+    }
+}
+}  // namespace mukham
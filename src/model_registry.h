@@ -0,0 +1,116 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "face_models.h"
+#include "latency_stats.h"
+#include "opencv2/core.hpp"
+
+namespace mukham {
+
+class DeeplabSegmentationModel;
+class LandmarkWorkerPool;
+
+enum class ModelState {
+    Unloaded,
+    // Queued or being loaded and warmed up
+    Loading,
+    Ready,
+    // The model could not be loaded or failed its warm-up inference
+    Failed,
+};
+
+const char* ToString(ModelState state);
+
+struct ModelRegistryOptions {
+    // Inferences run on a blank frame once a model is loaded, so that the
+    // first real frame does not pay for page faults, lazy allocations and
+    // cold caches
+    int warmup_runs = 3;
+    cv::Size warmup_frame_size = cv::Size(640, 480);
+    // Models not used for that long are unloaded, 0 keeps them loaded
+    double idle_unload_s = 120.0;
+};
+
+/**
+ * Loads the models of a FaceModels on demand.
+ *
+ * A model is loaded on the registry's thread the first time it is used, and
+ * warmed up before it is handed over to the FaceModels, so the threads
+ * running the models never wait for a load: until the model is ready, its
+ * calls fail and the frames go through without detections. Models that have
+ * not been used for idle_unload_s are unloaded to give their memory back.
+ *
+ * The copies of the landmark models that the landmark workers run are
+ * loaded and unloaded on the registry's thread too, along with the shared
+ * model. So is the Deeplab segmentation model, which lives outside the
+ * FaceModels.
+ */
+class ModelRegistry {
+   public:
+    explicit ModelRegistry(
+        FaceModels& models,
+        const ModelRegistryOptions& options = ModelRegistryOptions());
+    ~ModelRegistry();
+
+    ModelRegistry(const ModelRegistry&) = delete;
+    ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+    // The workers get their copy of a landmark model before the shared one
+    // is handed over. The pool must outlive the registry.
+    void SetLandmarkWorkers(LandmarkWorkerPool* workers);
+
+    // Marks the models as used and queues the loading of the ones that are
+    // not loaded. Meant to be called for every frame, true when both models
+    // are ready. LandmarkModelType::None is always ready.
+    bool Use(FaceDetectorType detector, LandmarkModelType landmark_model);
+
+    ModelState GetState(FaceDetectorType type);
+    ModelState GetState(LandmarkModelType type);
+
+    // Same as Use for the segmentation model, true when it is ready
+    bool UseSegmentation();
+    ModelState GetSegmentationState();
+    // nullptr until the model is ready. Run by one thread at a time.
+    std::shared_ptr<DeeplabSegmentationModel> GetSegmentationModel() const;
+
+    // Blocks until no model is loading
+    void WaitUntilLoaded();
+
+   private:
+    struct Entry {
+        ModelState state = ModelState::Unloaded;
+        Clock::time_point last_used;
+    };
+
+    void _loader_loop();
+    // Loads and warms up the model in a FaceModels of its own, false when
+    // it is not usable
+    bool _load_detector(FaceDetectorType type);
+    bool _load_landmark_model(LandmarkModelType type);
+    bool _load_segmentation_model();
+    void _load_worker_copies(LandmarkModelType type,
+                             const FaceModels& models);
+    void _unload_idle();
+
+    FaceModels& face_models;
+    ModelRegistryOptions options;
+    LandmarkWorkerPool* landmark_workers = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable model_requested;
+    std::condition_variable model_loaded;
+    std::map<FaceDetectorType, Entry> detectors;
+    std::map<LandmarkModelType, Entry> landmark_models;
+    Entry segmentation;
+    // Read and replaced with std::atomic_load/atomic_store
+    std::shared_ptr<DeeplabSegmentationModel> segmentation_model;
+    bool stop = false;
+
+    std::thread loader;
+};
+}  // namespace mukham
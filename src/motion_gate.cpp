@@ -0,0 +1,50 @@
+#include "motion_gate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+#include <utility>
+
+namespace mukham {
+
+bool MotionGate::IsStatic(const cv::Mat& frame) {
+    stats.frames++;
+    if (frame.empty()) return false;
+
+    const int width = std::clamp(options.width, 1, frame.cols);
+    const int height =
+        (std::max)(1, (int)std::lround((double)frame.rows * width / frame.cols));
+    cv::resize(frame, small_frame, cv::Size(width, height), 0, 0,
+               cv::INTER_AREA);
+    if (small_frame.channels() == 3) {
+        cv::cvtColor(small_frame, gray_frame, cv::COLOR_RGB2GRAY);
+    } else {
+        small_frame.copyTo(gray_frame);
+    }
+
+    bool is_static = false;
+    if (!reference.empty() && reference.size() == gray_frame.size() &&
+        skipped_frames < options.max_skipped_frames) {
+        cv::absdiff(gray_frame, reference, difference);
+        cv::threshold(difference, difference, options.pixel_threshold, 255,
+                      cv::THRESH_BINARY);
+        const auto changed = cv::countNonZero(difference);
+        is_static = changed <= options.changed_fraction * difference.total();
+    }
+
+    if (is_static) {
+        stats.static_frames++;
+        skipped_frames++;
+    } else {
+        std::swap(reference, gray_frame);
+        skipped_frames = 0;
+    }
+    return is_static;
+}
+
+void MotionGate::Reset() {
+    reference.release();
+    skipped_frames = 0;
+    stats = MotionGateStats();
+}
+}  // namespace mukham
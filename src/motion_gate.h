@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+#include "opencv2/core.hpp"
+
+namespace mukham {
+
+struct MotionGateOptions {
+    // Width of the downsampled frame the difference is computed on
+    int width = 64;
+    // Difference of a downsampled pixel, in gray levels, that counts as
+    // motion. Averaging over the block already removes most sensor noise.
+    double pixel_threshold = 12.0;
+    // Fraction of moving pixels above which the frame is not static
+    double changed_fraction = 0.002;
+    // The models run at least once every max_skipped_frames + 1 frames, so
+    // slow changes such as lighting are eventually picked up
+    int max_skipped_frames = 30;
+};
+
+struct MotionGateStats {
+    uint64_t frames = 0;
+    // Frames found static, whose inference was skipped
+    uint64_t static_frames = 0;
+
+    double HitRate() const {
+        return frames > 0 ? (double)static_frames / frames : 0.0;
+    }
+};
+
+/**
+ * Cheap test for frames in which nothing moved.
+ *
+ * Each frame is reduced to a small gray image and compared with the last
+ * frame the models ran on, rather than with the previous frame, so slow
+ * motion still adds up to a difference. Static frames can reuse the results
+ * of that frame.
+ *
+ * Not thread safe.
+ */
+class MotionGate {
+   public:
+    explicit MotionGate(const MotionGateOptions& options = MotionGateOptions())
+        : options(options) {}
+
+    void SetOptions(const MotionGateOptions& new_options) {
+        options = new_options;
+    }
+    const MotionGateOptions& GetOptions() const { return options; }
+
+    // True when the frame does not differ from the reference frame. A frame
+    // that is not static becomes the new reference.
+    bool IsStatic(const cv::Mat& frame);
+
+    // The next frame becomes the reference
+    void Reset();
+
+    const MotionGateStats& GetStats() const { return stats; }
+
+   private:
+    MotionGateOptions options;
+    MotionGateStats stats;
+    int skipped_frames = 0;
+
+    cv::Mat small_frame;
+    cv::Mat gray_frame;
+    cv::Mat reference;
+    cv::Mat difference;
+};
+}  // namespace mukham
@@ -0,0 +1,308 @@
+#include "multi_stream_runner.h"
+
+#include <chrono>
+#include <future>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "spdlog/spdlog.h"
+
+namespace mukham {
+
+MultiStreamRunner::MultiStreamRunner(FaceModels& models, size_t queue_capacity)
+    : face_models(models), capacity((std::max)(queue_capacity, (size_t)1)) {}
+
+MultiStreamRunner::~MultiStreamRunner() { Stop(); }
+
+size_t MultiStreamRunner::AddStream(const VideoSource& source) {
+    auto stream = std::make_unique<Stream>();
+    stream->source = source;
+    stream->stats.name = source.file_name.empty()
+                             ? fmt::format("camera {}", source.camera_index)
+                             : source.file_name;
+    streams.push_back(std::move(stream));
+    return streams.size() - 1;
+}
+
+void MultiStreamRunner::SetSettings(const PipelineSettings& settings) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    pipeline_settings = settings;
+}
+
+PipelineSettings MultiStreamRunner::GetSettings() {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    return pipeline_settings;
+}
+
+void MultiStreamRunner::SetBatchingOptions(
+    const DynamicBatcherOptions& detector_options,
+    const DynamicBatcherOptions& landmark_options) {
+    detector_batching = detector_options;
+    landmark_batching = landmark_options;
+    landmark_batching_set = true;
+}
+
+bool MultiStreamRunner::Start(ResultCallback callback) {
+    Stop();
+    if (streams.empty()) {
+        spdlog::error("No stream to run");
+        return false;
+    }
+
+    for (auto& stream : streams) {
+        const auto& source = stream->source;
+        bool is_open = false;
+        if (source.file_name.empty()) {
+            is_open = stream->capture.open(source.camera_index);
+            if (is_open && !source.camera_size.empty()) {
+                stream->capture.set(cv::CAP_PROP_FRAME_HEIGHT,
+                                    (double)source.camera_size.height);
+                stream->capture.set(cv::CAP_PROP_FRAME_WIDTH,
+                                    (double)source.camera_size.width);
+            }
+        } else {
+            is_open = stream->capture.open(source.file_name);
+        }
+        if (!is_open) {
+            spdlog::error("Failed to open the video source {}",
+                          stream->stats.name);
+            for (auto& opened : streams) opened->capture.release();
+            return false;
+        }
+
+        stream->frames =
+            std::make_unique<BackpressureQueue<FrameData>>(capacity, policy);
+        stream->roi_tracker.Reset();
+        stream->face_tracker.Reset();
+        stream->motion_gate.Reset();
+        stream->last_results.valid = false;
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stream->stats = StreamStats{stream->stats.name};
+    }
+
+    auto landmark_options = landmark_batching;
+    if (!landmark_batching_set) {
+        landmark_options.max_batch_size =
+            face_models.GetLandmarkBatchSize(GetSettings().landmarks);
+    }
+    batchers = std::make_unique<ModelBatchers>(face_models, detector_batching,
+                                               landmark_options);
+
+    result_callback = std::move(callback);
+    running = true;
+    for (size_t idx = 0; idx < streams.size(); ++idx) {
+        workers.emplace_back(&MultiStreamRunner::_capture_loop, this,
+                             std::ref(*streams[idx]));
+        workers.emplace_back(&MultiStreamRunner::_process_loop, this, idx);
+    }
+    return true;
+}
+
+void MultiStreamRunner::Wait() {
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    Stop();
+}
+
+void MultiStreamRunner::Stop() {
+    running = false;
+    for (auto& stream : streams) {
+        if (stream->frames) stream->frames->Close();
+    }
+
+    // The batchers outlive the processing threads waiting on them
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    workers.clear();
+    for (auto& stream : streams) stream->capture.release();
+}
+
+std::vector<StreamStats> MultiStreamRunner::GetStreamStats() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    std::vector<StreamStats> stats;
+    for (auto& stream : streams) {
+        stats.push_back(stream->stats);
+        if (stream->frames)
+            stats.back().dropped_frames = stream->frames->Dropped();
+    }
+    return stats;
+}
+
+BatcherStats MultiStreamRunner::GetDetectorBatcherStats() {
+    return batchers ? batchers->GetDetectorStats() : BatcherStats();
+}
+
+BatcherStats MultiStreamRunner::GetLandmarkBatcherStats() {
+    return batchers ? batchers->GetLandmarkStats() : BatcherStats();
+}
+
+void MultiStreamRunner::_capture_loop(Stream& stream) {
+    int64_t index = 0;
+    int64_t position = 0;
+
+    const auto& source = stream.source;
+    const bool pace = source.realtime && !source.file_name.empty();
+    const double fps = pace ? stream.capture.get(cv::CAP_PROP_FPS) : 0.0;
+    const auto frame_interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(fps > 0.0 ? 1.0 / fps : 0.0));
+    auto next_frame_time = Clock::now();
+
+    cv::Mat bgr_frame;
+    while (running) {
+        if (fps > 0.0) {
+            std::this_thread::sleep_until(next_frame_time);
+            next_frame_time += frame_interval;
+            if (next_frame_time < Clock::now()) next_frame_time = Clock::now();
+        }
+
+        auto start = Clock::now();
+        if (!stream.capture.read(bgr_frame) || bgr_frame.empty()) {
+            if (source.loop && position > 0) {
+                stream.capture.set(cv::CAP_PROP_POS_FRAMES, 0);
+                position = 0;
+                continue;
+            }
+            break;
+        }
+
+        FrameData data;
+        data.capture_time = Clock::now();
+        data.decode_ms = ElapsedMs(start, data.capture_time);
+        data.index = index++;
+        position++;
+
+        // Preprocessed here, the processing thread only runs the models
+        auto settings = GetSettings();
+        start = Clock::now();
+        cv::cvtColor(bgr_frame, data.frame, cv::COLOR_BGR2RGB);
+        if (settings.resize_factor != 1.0) {
+            cv::resize(data.frame, data.frame, cv::Size(0, 0),
+                       settings.resize_factor, settings.resize_factor,
+                       cv::INTER_LINEAR);
+        }
+        if (settings.rotate_code >= 0) {
+            cv::rotate(data.frame, data.frame, settings.rotate_code);
+        }
+        if (settings.alpha != 1.0 || settings.beta != 0.0) {
+            data.frame.convertTo(data.frame, -1, settings.alpha,
+                                 settings.beta);
+        }
+        data.preprocess_ms = ElapsedMs(start, Clock::now());
+
+        if (!stream.frames->Push(std::move(data))) break;
+    }
+    stream.frames->Close();
+}
+
+void MultiStreamRunner::_process_frame(const PipelineSettings& settings,
+                                       Stream& stream, FrameData& data) {
+    data.detected = false;
+    data.detect_ms = 0.0;
+
+    data.is_static = false;
+    if (settings.motion_gate) {
+        stream.motion_gate.SetOptions(settings.motion);
+        data.is_static = stream.motion_gate.IsStatic(data.frame);
+    } else {
+        stream.motion_gate.Reset();
+    }
+
+    auto& last = stream.last_results;
+    if (data.is_static && last.valid && last.detector == settings.detector &&
+        last.landmark_model == settings.landmarks) {
+        data.detections = last.detections;
+        data.face_ids = last.face_ids;
+        data.landmarks = last.landmarks;
+        data.has_landmarks = settings.landmarks != LandmarkModelType::None;
+        data.landmark_ms = 0.0;
+        return;
+    }
+    data.is_static = false;
+
+    const bool tracking = settings.track_faces &&
+                          settings.landmarks != LandmarkModelType::None;
+    bool needs_detection = true;
+    if (tracking) {
+        stream.roi_tracker.SetOptions(settings.tracking);
+        needs_detection = stream.roi_tracker.NeedsDetection();
+    } else {
+        stream.roi_tracker.Reset();
+    }
+
+    auto start = Clock::now();
+    if (needs_detection) {
+        data.detections =
+            batchers
+                ->DetectFaces({settings.detector, data.frame, settings.tiles})
+                .get();
+        data.detected = true;
+        data.detect_ms = ElapsedMs(start, Clock::now());
+    } else {
+        stream.roi_tracker.PredictFaces(data.detections.faces);
+        data.detections.keypoints.clear();
+    }
+
+    stream.face_tracker.Update(data.detections.faces, data.face_ids);
+
+    start = Clock::now();
+    data.landmarks.clear();
+    data.has_landmarks = settings.landmarks != LandmarkModelType::None;
+    if (data.has_landmarks) {
+        // All the faces are queued before waiting, so that they can share a
+        // batch with each other and with the faces of the other streams
+        std::vector<std::future<std::vector<cv::Point2d>>> face_landmarks;
+        for (const auto& face : data.detections.faces) {
+            const auto roi =
+                GetLandmarkRoi(face, settings.roi_scale, data.frame.size());
+            face_landmarks.push_back(batchers->DetectLandmarks(
+                {settings.landmarks, data.frame, roi}));
+        }
+        for (auto& landmarks : face_landmarks) {
+            data.landmarks.push_back(landmarks.get());
+        }
+    }
+    data.landmark_ms = ElapsedMs(start, Clock::now());
+
+    if (tracking) {
+        stream.roi_tracker.Update(data.landmarks, data.detected,
+                                  data.frame.size());
+    }
+
+    last.valid = true;
+    last.detector = settings.detector;
+    last.landmark_model = settings.landmarks;
+    last.detections = data.detections;
+    last.face_ids = data.face_ids;
+    last.landmarks = data.landmarks;
+}
+
+void MultiStreamRunner::_process_loop(size_t stream_idx) {
+    auto& stream = *streams[stream_idx];
+    FrameData data;
+    while (stream.frames->Pop(data)) {
+        _process_frame(GetSettings(), stream, data);
+
+        const auto now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            auto& stats = stream.stats;
+            if (stats.frames == 0) stream.first_frame_time = data.capture_time;
+            stats.frames++;
+            stats.latency.Add(ElapsedMs(data.capture_time, now));
+            const double elapsed_ms = ElapsedMs(stream.first_frame_time, now);
+            stats.fps =
+                elapsed_ms > 0.0 ? stats.frames * 1000.0 / elapsed_ms : 0.0;
+            stats.motion = stream.motion_gate.GetStats();
+        }
+
+        if (result_callback) {
+            std::lock_guard<std::mutex> lock(callback_mutex);
+            result_callback(stream_idx, data);
+        }
+    }
+}
+}  // namespace mukham
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "backpressure_queue.h"
+#include "dynamic_batcher.h"
+#include "face_models.h"
+#include "face_tracker.h"
+#include "frame_pipeline.h"
+#include "latency_stats.h"
+#include "model_batchers.h"
+#include "motion_gate.h"
+#include "opencv2/core.hpp"
+#include "opencv2/videoio.hpp"
+#include "roi_tracker.h"
+
+namespace mukham {
+
+struct StreamStats {
+    std::string name;
+    uint64_t frames = 0;
+    uint64_t dropped_frames = 0;
+    // Processed frames per second since the first frame of the stream
+    double fps = 0.0;
+    // From the capture of a frame to the end of its processing
+    LatencyStats latency;
+    MotionGateStats motion;
+};
+
+/**
+ * Runs the face models over several video sources in one process.
+ *
+ * Every stream has its own capture and processing threads, tracker, motion
+ * gate and stats, while the models of the FaceModels are loaded once and
+ * shared. The processing threads submit their frames and faces to dynamic
+ * batchers, which run the requests of all the streams as batched
+ * inferences, see ModelBatchers.
+ *
+ * The results are handed to a callback on the processing thread of their
+ * stream, in order within each stream. Calls are serialised, the callback
+ * does not need to be thread safe.
+ */
+class MultiStreamRunner {
+   public:
+    using ResultCallback = std::function<void(size_t stream, FrameData&)>;
+
+    explicit MultiStreamRunner(FaceModels& models, size_t queue_capacity = 2);
+    ~MultiStreamRunner();
+
+    MultiStreamRunner(const MultiStreamRunner&) = delete;
+    MultiStreamRunner& operator=(const MultiStreamRunner&) = delete;
+
+    // Streams are added before Start, the index identifies the stream in
+    // the callback and the stats
+    size_t AddStream(const VideoSource& source);
+
+    void SetSettings(const PipelineSettings& settings);
+    PipelineSettings GetSettings();
+
+    // Capture threads hand frames over to the processing threads with this
+    // policy, a dropping policy keeps live sources real-time when the box
+    // is overloaded
+    void SetBackpressurePolicy(BackpressurePolicy new_policy) {
+        policy = new_policy;
+    }
+
+    // Used by the batchers created in Start, the landmark batch size
+    // defaults to the largest batch of the landmark model
+    void SetBatchingOptions(const DynamicBatcherOptions& detector_options,
+                            const DynamicBatcherOptions& landmark_options);
+
+    bool Start(ResultCallback callback);
+
+    // Blocks until every stream reached its end
+    void Wait();
+    void Stop();
+
+    bool IsRunning() const { return running; }
+
+    std::vector<StreamStats> GetStreamStats();
+
+    // Batch sizes and queueing delays since Start
+    BatcherStats GetDetectorBatcherStats();
+    BatcherStats GetLandmarkBatcherStats();
+
+   private:
+    // Results of the last frame the models ran on, for the static frames
+    struct FrameResults {
+        bool valid = false;
+        FaceDetectorType detector;
+        LandmarkModelType landmark_model;
+        FaceDetections detections;
+        std::vector<int> face_ids;
+        std::vector<std::vector<cv::Point2d>> landmarks;
+    };
+
+    struct Stream {
+        VideoSource source;
+        cv::VideoCapture capture;
+        std::unique_ptr<BackpressureQueue<FrameData>> frames;
+
+        // Owned by the processing thread of the stream
+        RoiTracker roi_tracker;
+        FaceTracker face_tracker;
+        MotionGate motion_gate;
+        FrameResults last_results;
+
+        // Guarded by stats_mutex
+        StreamStats stats;
+        Clock::time_point first_frame_time;
+    };
+
+    void _capture_loop(Stream& stream);
+    void _process_loop(size_t stream_idx);
+
+    // Motion gate, tracking and models for one frame
+    void _process_frame(const PipelineSettings& settings, Stream& stream,
+                        FrameData& data);
+
+    FaceModels& face_models;
+    size_t capacity;
+    std::atomic<BackpressurePolicy> policy{BackpressurePolicy::Block};
+
+    std::vector<std::unique_ptr<Stream>> streams;
+    ResultCallback result_callback;
+    std::mutex callback_mutex;
+
+    DynamicBatcherOptions detector_batching;
+    DynamicBatcherOptions landmark_batching;
+    bool landmark_batching_set = false;
+    std::unique_ptr<ModelBatchers> batchers;
+
+    std::mutex settings_mutex;
+    PipelineSettings pipeline_settings;
+    std::mutex stats_mutex;
+
+    std::atomic<bool> running{false};
+    std::vector<std::thread> workers;
+};
+}  // namespace mukham
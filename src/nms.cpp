@@ -0,0 +1,243 @@
+#include "nms.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mukham {
+
+namespace {
+
+// Branch free so that the loops over the packed boxes vectorise
+inline double Overlap(double ax1, double ay1, double ax2, double ay2,
+                      double a_area, double bx1, double by1, double bx2,
+                      double by2, double b_area) {
+    const double xmin = (std::max)(ax1, bx1);
+    const double ymin = (std::max)(ay1, by1);
+    const double xmax = (std::min)(ax2, bx2);
+    const double ymax = (std::min)(ay2, by2);
+
+    const bool intersects = (xmin < xmax) && (ymin < ymax);
+    const double intersection = intersects ? (xmax - xmin) * (ymax - ymin) : 0;
+    const double denominator = a_area + b_area - intersection;
+    return (intersects && denominator > 0) ? intersection / denominator : 0.0;
+}
+}  // namespace
+
+double OverlapSimilarity(const cv::Rect2d& box1, const cv::Rect2d& box2) {
+    const auto xmin = (std::max)(box1.x, box2.x);
+    const auto ymin = (std::max)(box1.y, box2.y);
+    const auto xmax = (std::min)(box1.x + box1.width, box2.x + box2.width);
+    const auto ymax = (std::min)(box1.y + box1.height, box2.y + box2.height);
+    if (!((xmin < xmax) && (ymin < ymax))) return 0.0;
+
+    const auto intersection = (xmax - xmin) * (ymax - ymin);
+    const auto denominator = box1.area() + box2.area() - intersection;
+    if (denominator <= 0) return 0.0;
+    return intersection / denominator;
+}
+
+void NmsEngine::_pack(const cv::Rect2d& box) {
+    x1.push_back(box.x);
+    y1.push_back(box.y);
+    x2.push_back(box.x + box.width);
+    y2.push_back(box.y + box.height);
+    areas.push_back(box.area());
+}
+
+double NmsEngine::_overlap(size_t a, size_t b) const {
+    return Overlap(x1[a], y1[a], x2[a], y2[a], areas[a], x1[b], y1[b], x2[b],
+                   y2[b], areas[b]);
+}
+
+void NmsEngine::_cell_range(double min_val, double max_val, double origin,
+                            double inv_cell_size, int& first,
+                            int& last) const {
+    auto to_cell = [&](double value) {
+        const double cell = std::floor((value - origin) * inv_cell_size);
+        return (int)std::clamp(cell, 0.0, (double)(grid_size - 1));
+    };
+    first = to_cell(min_val);
+    last = to_cell(max_val);
+}
+
+bool NmsEngine::_build_grid() {
+    const size_t nb_boxes = x1.size();
+    const double min_x = *std::min_element(x1.begin(), x1.end());
+    const double min_y = *std::min_element(y1.begin(), y1.end());
+    const double width = *std::max_element(x2.begin(), x2.end()) - min_x;
+    const double height = *std::max_element(y2.begin(), y2.end()) - min_y;
+    if (!std::isfinite(width) || !std::isfinite(height)) return false;
+
+    // About four boxes per cell for boxes of similar sizes
+    grid_size = std::clamp((int)std::sqrt(nb_boxes / 4.0), 1, 64);
+    grid_x = min_x;
+    grid_y = min_y;
+    inv_cell_width = width > 0 ? grid_size / width : 0.0;
+    inv_cell_height = height > 0 ? grid_size / height : 0.0;
+
+    const size_t nb_cells = (size_t)grid_size * grid_size;
+    cell_offsets.assign(nb_cells + 1, 0);
+    int first_x, last_x, first_y, last_y;
+    for (size_t rank = 0; rank < nb_boxes; ++rank) {
+        _cell_range(x1[rank], x2[rank], grid_x, inv_cell_width, first_x,
+                    last_x);
+        _cell_range(y1[rank], y2[rank], grid_y, inv_cell_height, first_y,
+                    last_y);
+        for (int cy = first_y; cy <= last_y; ++cy) {
+            for (int cx = first_x; cx <= last_x; ++cx) {
+                cell_offsets[cy * grid_size + cx + 1]++;
+            }
+        }
+    }
+    for (size_t cell = 0; cell < nb_cells; ++cell) {
+        cell_offsets[cell + 1] += cell_offsets[cell];
+    }
+
+    // Filled in rank order, cursors start at the cell offsets
+    cell_items.resize(cell_offsets.back());
+    cell_cursors.assign(cell_offsets.begin(), cell_offsets.end() - 1);
+    for (size_t rank = 0; rank < nb_boxes; ++rank) {
+        _cell_range(x1[rank], x2[rank], grid_x, inv_cell_width, first_x,
+                    last_x);
+        _cell_range(y1[rank], y2[rank], grid_y, inv_cell_height, first_y,
+                    last_y);
+        for (int cy = first_y; cy <= last_y; ++cy) {
+            for (int cx = first_x; cx <= last_x; ++cx) {
+                cell_items[cell_cursors[cy * grid_size + cx]++] = rank;
+            }
+        }
+    }
+    visit_stamps.assign(nb_boxes, 0);
+    stamp = 0;
+    return true;
+}
+
+void NmsEngine::_find_cluster(size_t rank, bool use_grid) {
+    cluster.clear();
+    const size_t nb_boxes = x1.size();
+
+    if (!use_grid) {
+        // Boxes ranked before this one are all suppressed already
+        for (size_t other = rank; other < nb_boxes; ++other) {
+            const double overlap =
+                Overlap(x1[rank], y1[rank], x2[rank], y2[rank], areas[rank],
+                        x1[other], y1[other], x2[other], y2[other],
+                        areas[other]);
+            if (overlap > options.iou_threshold && !suppressed[other])
+                cluster.push_back(other);
+        }
+        return;
+    }
+
+    // Overlapping boxes share at least one cell
+    stamp++;
+    int first_x, last_x, first_y, last_y;
+    _cell_range(x1[rank], x2[rank], grid_x, inv_cell_width, first_x, last_x);
+    _cell_range(y1[rank], y2[rank], grid_y, inv_cell_height, first_y, last_y);
+    for (int cy = first_y; cy <= last_y; ++cy) {
+        for (int cx = first_x; cx <= last_x; ++cx) {
+            const size_t cell = cy * grid_size + cx;
+            for (size_t item = cell_offsets[cell];
+                 item < cell_offsets[cell + 1]; ++item) {
+                const size_t other = cell_items[item];
+                if (visit_stamps[other] == stamp || suppressed[other])
+                    continue;
+                visit_stamps[other] = stamp;
+                if (_overlap(rank, other) > options.iou_threshold)
+                    cluster.push_back(other);
+            }
+        }
+    }
+    // The weighted average sums the cluster in score order
+    std::sort(cluster.begin(), cluster.end());
+}
+
+void NmsEngine::WeightedNms(const std::vector<cv::Rect2d>& boxes,
+                            const std::vector<double>& scores,
+                            std::vector<WeightedBox>& output) {
+    output.clear();
+    const size_t nb_boxes = boxes.size();
+
+    indexed_scores.clear();
+    for (size_t idx = 0; idx < nb_boxes; ++idx) {
+        indexed_scores.push_back(std::make_pair((int)idx, scores[idx]));
+    }
+    std::sort(indexed_scores.begin(), indexed_scores.end(),
+              [](auto a, auto b) { return a.second > b.second; });
+
+    for (auto* values : {&x1, &y1, &x2, &y2, &areas}) values->clear();
+    for (const auto& indexed_score : indexed_scores) {
+        _pack(boxes[indexed_score.first]);
+    }
+    suppressed.assign(nb_boxes, 0);
+
+    // The grid only finds overlapping boxes, which are all the candidates
+    // as long as the threshold is not negative
+    const bool use_grid = nb_boxes >= options.grid_min_boxes &&
+                          options.iou_threshold >= 0.0 && _build_grid();
+
+    for (size_t rank = 0; rank < nb_boxes; ++rank) {
+        if (suppressed[rank]) continue;
+
+        const auto [index, score] = indexed_scores[rank];
+        if (score < options.min_score) break;
+
+        _find_cluster(rank, use_grid);
+
+        WeightedBox weighted{index, boxes[index]};
+        double wxmin = 0.0;
+        double wxmax = 0.0;
+        double wymin = 0.0;
+        double wymax = 0.0;
+        double total_score = 0.0;
+        for (auto member : cluster) {
+            const auto& [member_index, member_score] = indexed_scores[member];
+            const auto& bbox = boxes[member_index];
+            total_score += member_score;
+            wxmin += (bbox.x * member_score);
+            wymin += (bbox.y * member_score);
+            wxmax += ((bbox.width + bbox.x) * member_score);
+            wymax += ((bbox.height + bbox.y) * member_score);
+            suppressed[member] = 1;
+        }
+        if (!cluster.empty() && total_score > 0) {
+            weighted.box.x = wxmin / total_score;
+            weighted.box.y = wymin / total_score;
+            weighted.box.width = (wxmax / total_score) - weighted.box.x;
+            weighted.box.height = (wymax / total_score) - weighted.box.y;
+        }
+        output.push_back(weighted);
+
+        // A box that does not even overlap itself is degenerate, nothing
+        // after it can be suppressed either
+        if (cluster.empty()) break;
+    }
+}
+
+void NmsEngine::Nms(const std::vector<cv::Rect2d>& boxes,
+                    const std::vector<double>& scores,
+                    std::vector<int>& kept) {
+    kept.clear();
+    for (auto* values : {&x1, &y1, &x2, &y2, &areas}) values->clear();
+
+    for (size_t idx = 0; idx < boxes.size(); ++idx) {
+        if (scores[idx] < options.min_score) break;
+
+        // The packed arrays hold the kept boxes, followed by this one
+        _pack(boxes[idx]);
+        const size_t candidate = x1.size() - 1;
+        bool is_suppressed = false;
+        for (size_t other = 0; other < candidate && !is_suppressed; ++other) {
+            is_suppressed = _overlap(other, candidate) > options.iou_threshold;
+        }
+
+        if (is_suppressed) {
+            for (auto* values : {&x1, &y1, &x2, &y2, &areas}) {
+                values->pop_back();
+            }
+        } else {
+            kept.push_back((int)idx);
+        }
+    }
+}
+}  // namespace mukham
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+namespace mukham {
+
+// Intersection over union, 0 for boxes that do not overlap
+double OverlapSimilarity(const cv::Rect2d& box1, const cv::Rect2d& box2);
+
+struct NmsOptions {
+    double iou_threshold = 0.3;
+    double min_score = 0.5;
+    // Number of boxes from which the overlaps are only searched among the
+    // boxes sharing a cell of a uniform grid
+    size_t grid_min_boxes = 256;
+};
+
+struct WeightedBox {
+    // Best scoring detection of the cluster
+    int index;
+    // Score weighted average of the boxes of the cluster
+    cv::Rect2d box;
+};
+
+/**
+ * Non-maximum suppression shared by the detectors.
+ *
+ * The boxes are copied once per call into arrays sorted by score, so that
+ * the overlaps of a box with all the remaining ones are computed in a single
+ * pass over contiguous memory. Suppressed boxes are flagged instead of being
+ * moved between vectors, and the buffers are kept across calls, so a call
+ * does not allocate once the engine has seen its largest input. The
+ * overlaps are computed in double precision, exactly like
+ * OverlapSimilarity, so the kept boxes do not depend on the search path.
+ */
+class NmsEngine {
+   public:
+    explicit NmsEngine(const NmsOptions& options = NmsOptions())
+        : options(options) {}
+
+    void SetOptions(const NmsOptions& new_options) { options = new_options; }
+    const NmsOptions& GetOptions() const { return options; }
+
+    // Visits the boxes by decreasing score and replaces the cluster of boxes
+    // overlapping the best remaining one by their score weighted average.
+    // Stops at the first box scoring below min_score.
+    void WeightedNms(const std::vector<cv::Rect2d>& boxes,
+                     const std::vector<double>& scores,
+                     std::vector<WeightedBox>& output);
+
+    // Greedy suppression in input order, the boxes are expected to be sorted
+    // by decreasing score. Stops at the first box scoring below min_score.
+    void Nms(const std::vector<cv::Rect2d>& boxes,
+             const std::vector<double>& scores, std::vector<int>& kept);
+
+   private:
+    // Appends box to the packed arrays
+    void _pack(const cv::Rect2d& box);
+
+    // Overlap of packed boxes a and b, same arithmetic as OverlapSimilarity
+    double _overlap(size_t a, size_t b) const;
+
+    // Buckets the packed boxes into a uniform grid, false when the extent of
+    // the boxes cannot be gridded
+    bool _build_grid();
+
+    // Ranks of the boxes that are not suppressed yet and overlap the box of
+    // the given rank, in increasing rank order
+    void _find_cluster(size_t rank, bool use_grid);
+
+    void _cell_range(double min_val, double max_val, double origin,
+                     double inv_cell_size, int& first, int& last) const;
+
+    NmsOptions options;
+
+    // Packed boxes, in score order for WeightedNms and in kept order for Nms
+    std::vector<double> x1, y1, x2, y2, areas;
+
+    std::vector<std::pair<int, double>> indexed_scores;
+    std::vector<char> suppressed;
+    std::vector<size_t> cluster;
+
+    // Grid in compressed rows: the ranks in cell c are
+    // cell_items[cell_offsets[c]] .. cell_items[cell_offsets[c + 1] - 1]
+    int grid_size = 0;
+    double grid_x = 0.0, grid_y = 0.0;
+    double inv_cell_width = 0.0, inv_cell_height = 0.0;
+    std::vector<size_t> cell_offsets;
+    std::vector<size_t> cell_items;
+    std::vector<size_t> cell_cursors;
+    std::vector<size_t> visit_stamps;
+    size_t stamp = 0;
+};
+}  // namespace mukham
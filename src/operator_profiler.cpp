@@ -0,0 +1,216 @@
+#include "operator_profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <set>
+
+#include "latency_stats.h"
+#include "spdlog/fmt/fmt.h"
+#include "spdlog/spdlog.h"
+#include "tvm/runtime/container/map.h"
+#include "tvm/runtime/module.h"
+#include "tvm/runtime/ndarray.h"
+#include "tvm/runtime/packed_func.h"
+#include "tvm/runtime/profiling.h"
+
+namespace mukham {
+namespace tr = tvm::runtime;
+
+static std::string EscapeJson(const std::string& value) {
+    std::string escaped;
+    for (auto c : value) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+// The graph executor counts the weights among its inputs, they keep the
+// values the factory loaded
+static void ZeroInputs(tr::Module& factory, tr::Module& executor) {
+    std::set<int> param_indices;
+    auto get_params = factory.GetFunction("get_graph_params");
+    if (get_params != nullptr) {
+        tr::Map<tr::String, tr::NDArray> params = get_params();
+        auto get_input_index = executor.GetFunction("get_input_index");
+        for (const auto& param : params) {
+            const int idx = get_input_index(param.first);
+            if (idx >= 0) param_indices.insert(idx);
+        }
+    }
+
+    const int nb_inputs = executor.GetFunction("get_num_inputs")();
+    auto get_input = executor.GetFunction("get_input");
+    for (int idx = 0; idx < nb_inputs; ++idx) {
+        if (param_indices.count(idx)) continue;
+        tr::NDArray input = get_input(idx);
+        std::memset(input->data, 0, tr::GetDataSize(*input.operator->()));
+    }
+}
+
+// The timed calls of one run, in node order
+static std::vector<OperatorCall> GetCalls(
+    const tr::profiling::Report& report) {
+    std::vector<OperatorCall> calls;
+    for (const auto& call : report->calls) {
+        const auto* duration =
+            call.at("Duration (us)").as<tr::profiling::DurationNode>();
+        if (!duration) continue;
+        calls.push_back({tr::Downcast<tr::String>(call.at("Name")),
+                         duration->microseconds});
+    }
+    return calls;
+}
+
+double OperatorProfile::MeanUs() const {
+    if (durations_us.empty()) return 0.0;
+    return std::accumulate(durations_us.begin(), durations_us.end(), 0.0) /
+           durations_us.size();
+}
+
+double ModelProfile::MeanRunUs() const {
+    double total = 0.0;
+    for (const auto& op : operators) total += op.MeanUs();
+    return total;
+}
+
+bool ModelProfile::AddRun(const std::vector<OperatorCall>& calls) {
+    // The nodes are matched by position, their names are not unique
+    if (runs == 0) {
+        for (const auto& call : calls) operators.push_back({call.name, {}});
+    } else {
+        if (calls.size() != operators.size()) return false;
+        for (size_t idx = 0; idx < calls.size(); ++idx) {
+            if (calls[idx].name != operators[idx].name) return false;
+        }
+    }
+    for (size_t idx = 0; idx < calls.size(); ++idx) {
+        operators[idx].durations_us.push_back(calls[idx].duration_us);
+    }
+    runs++;
+    return true;
+}
+
+bool OperatorProfiler::Profile(const fs::path& module_path, int runs,
+                               ModelProfile& profile, DLDevice device) {
+    profile = ModelProfile();
+    profile.module_path = module_path;
+
+    tr::Module factory;
+    tr::Module executor;
+    try {
+        factory = tr::Module::LoadFromFile(module_path.string());
+        if (std::string(factory->type_key()) != "GraphExecutorFactory") {
+            spdlog::error("{} is not a graph executor module, only those"
+                          " can be profiled",
+                          module_path.string());
+            return false;
+        }
+        executor = factory.GetFunction("debug_create")("default", device);
+    } catch (...) {
+        spdlog::error("Failed to create the debug executor of {}, the TVM"
+                      " runtime needs -DTVM_PROFILER=ON",
+                      module_path.string());
+        return false;
+    }
+
+    try {
+        ZeroInputs(factory, executor);
+        executor.GetFunction("run")();
+
+        // Each call runs the graph once more, timing the operators
+        auto run_profiled = executor.GetFunction("profile");
+        for (int run = 0; run < runs; ++run) {
+            tr::profiling::Report report =
+                run_profiled(tr::Array<tr::profiling::MetricCollector>());
+            if (!profile.AddRun(GetCalls(report))) {
+                spdlog::error("{}: the graph nodes changed between runs",
+                              module_path.string());
+                return false;
+            }
+        }
+    } catch (...) {
+        spdlog::error("Failed to profile {}", module_path.string());
+        return false;
+    }
+    return true;
+}
+
+std::string OperatorProfiler::FormatReport(const ModelProfile& profile,
+                                           size_t max_operators) {
+    std::vector<const OperatorProfile*> operators;
+    for (const auto& op : profile.operators) operators.push_back(&op);
+    // Nodes with the same time stay in execution order
+    std::stable_sort(operators.begin(), operators.end(),
+                     [](const OperatorProfile* a, const OperatorProfile* b) {
+                         return a->MeanUs() > b->MeanUs();
+                     });
+    if (max_operators > 0 && operators.size() > max_operators)
+        operators.resize(max_operators);
+
+    const double run_us = profile.MeanRunUs();
+    std::string report = fmt::format(
+        "{}: {} operators, {} runs, {:.1f} us per run\n",
+        profile.module_path.filename().string(), profile.operators.size(),
+        profile.runs, run_us);
+    report += fmt::format("  {:>10} {:>10} {:>10} {:>7} {:>7}  {}\n",
+                          "mean us", "p50 us", "max us", "share", "cumul",
+                          "operator");
+    double cumulative = 0.0;
+    for (const auto* op : operators) {
+        LatencyStats stats;
+        for (auto duration : op->durations_us) stats.Add(duration);
+        const double share = run_us > 0.0 ? op->MeanUs() / run_us : 0.0;
+        cumulative += share;
+        report += fmt::format(
+            "  {:10.1f} {:10.1f} {:10.1f} {:6.1f}% {:6.1f}%  {}\n",
+            op->MeanUs(), stats.Percentile(50), stats.Max(), share * 100.0,
+            cumulative * 100.0, op->name);
+    }
+    return report;
+}
+
+bool OperatorProfiler::WriteChromeTrace(
+    const std::vector<ModelProfile>& profiles, const fs::path& trace_path) {
+    std::ofstream out(trace_path);
+    if (!out) {
+        spdlog::error("Failed to open the trace file {}",
+                      trace_path.string());
+        return false;
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto write_event = [&](const std::string& event) {
+        out << (first ? "\n" : ",\n") << event;
+        first = false;
+    };
+    for (size_t pid = 0; pid < profiles.size(); ++pid) {
+        const auto& profile = profiles[pid];
+        write_event(fmt::format(
+            "{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},"
+            "\"args\":{{\"name\":\"{}\"}}}}",
+            pid, EscapeJson(profile.module_path.filename().string())));
+
+        // The debug executor does not report start times, the operators
+        // of a run follow each other and the runs follow each other
+        double ts = 0.0;
+        for (size_t run = 0; run < profile.runs; ++run) {
+            for (const auto& op : profile.operators) {
+                if (run >= op.durations_us.size()) continue;
+                const double duration = op.durations_us[run];
+                write_event(fmt::format(
+                    "{{\"name\":\"{}\",\"cat\":\"operator\",\"ph\":\"X\","
+                    "\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":0,"
+                    "\"args\":{{\"run\":{}}}}}",
+                    EscapeJson(op.name), ts, duration, pid, run));
+                ts += duration;
+            }
+        }
+    }
+    out << "\n]}\n";
+    return out.good();
+}
+}  // namespace mukham
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "dlpack/dlpack.h"
+
+namespace mukham {
+namespace fs = std::filesystem;
+
+struct OperatorProfile {
+    std::string name;
+    // Time of the operator in each run, in microseconds
+    std::vector<double> durations_us;
+
+    double MeanUs() const;
+};
+
+struct OperatorCall {
+    std::string name;
+    double duration_us;
+};
+
+struct ModelProfile {
+    fs::path module_path;
+    size_t runs = 0;
+    // A profile per graph node, in execution order. Nodes running the same
+    // fused kernel share its name, e.g. all the no-op reshapes are __nop
+    std::vector<OperatorProfile> operators;
+
+    // Sum of the operator means, the time of a run without the executor
+    double MeanRunUs() const;
+
+    // Adds the calls of one run, a call per node in execution order. False,
+    // without adding anything, when they do not match the previous runs
+    bool AddRun(const std::vector<OperatorCall>& calls);
+};
+
+/**
+ * Per operator timings of a compiled TVM module.
+ *
+ * The module is loaded on its own and run through the graph executor's
+ * debug counterpart, which times every fused operator of the graph. The
+ * inputs are zeros, the models have no data dependent control flow.
+ *
+ * The debug executor is not part of the TVM runtime by default, the runtime
+ * is built with it when CMake is configured with -DTVM_PROFILER=ON.
+ */
+class OperatorProfiler {
+   public:
+    // False when the module can not be loaded or the runtime has no debug
+    // executor
+    static bool Profile(const fs::path& module_path, int runs,
+                        ModelProfile& profile,
+                        DLDevice device = {kDLCPU, 0});
+
+    // The max_operators slowest operators, all of them for 0, with their
+    // mean, p50 and max time and their share of a run
+    static std::string FormatReport(const ModelProfile& profile,
+                                    size_t max_operators = 0);
+
+    // Chrome trace event format, for chrome://tracing or Perfetto: one
+    // process per model with the operators of its runs laid back to back
+    static bool WriteChromeTrace(const std::vector<ModelProfile>& profiles,
+                                 const fs::path& trace_path);
+};
+}  // namespace mukham
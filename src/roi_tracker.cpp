@@ -0,0 +1,65 @@
+#include "roi_tracker.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace mukham {
+
+bool RoiTracker::NeedsDetection() const {
+    if (!has_keyframe || tracked_faces.empty()) return true;
+    if (lost_face && options.redetect_on_lost_face) return true;
+    return frames_since_keyframe + 1 >= options.keyframe_interval;
+}
+
+void RoiTracker::PredictFaces(std::vector<cv::Rect2d>& faces) const {
+    faces = tracked_faces;
+}
+
+void RoiTracker::Update(
+    const std::vector<std::vector<cv::Point2d>>& landmarks, bool is_keyframe,
+    const cv::Size& frame_size) {
+    if (is_keyframe) {
+        has_keyframe = true;
+        frames_since_keyframe = 0;
+    } else {
+        frames_since_keyframe++;
+    }
+
+    tracked_faces.clear();
+    lost_face = false;
+    const cv::Rect2d frame(0, 0, frame_size.width, frame_size.height);
+    for (const auto& face_landmarks : landmarks) {
+        if (face_landmarks.empty()) {
+            lost_face = true;
+            continue;
+        }
+
+        double min_x = std::numeric_limits<double>::max();
+        double min_y = std::numeric_limits<double>::max();
+        double max_x = std::numeric_limits<double>::lowest();
+        double max_y = std::numeric_limits<double>::lowest();
+        for (const auto& point : face_landmarks) {
+            min_x = (std::min)(min_x, point.x);
+            min_y = (std::min)(min_y, point.y);
+            max_x = (std::max)(max_x, point.x);
+            max_y = (std::max)(max_y, point.y);
+        }
+
+        const auto face =
+            cv::Rect2d(min_x, min_y, max_x - min_x, max_y - min_y) & frame;
+        if (face.width < options.min_face_size ||
+            face.height < options.min_face_size) {
+            lost_face = true;
+            continue;
+        }
+        tracked_faces.push_back(face);
+    }
+}
+
+void RoiTracker::Reset() {
+    tracked_faces.clear();
+    frames_since_keyframe = 0;
+    has_keyframe = false;
+    lost_face = false;
+}
+}  // namespace mukham
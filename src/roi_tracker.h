@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+namespace mukham {
+
+struct RoiTrackerOptions {
+    // The detector runs at least once every keyframe_interval frames
+    int keyframe_interval = 15;
+    // Run the detector as soon as the landmark model loses a tracked face,
+    // otherwise the face is dropped until the next keyframe
+    bool redetect_on_lost_face = true;
+    // Faces whose landmarks span less than this, in pixels, are lost
+    double min_face_size = 16.0;
+};
+
+/**
+ * Tracks the faces between keyframes with the landmark models.
+ *
+ * The detector only runs on keyframes. On the other frames the face boxes
+ * are the bounds of the landmarks found in the previous frame, which the
+ * landmark models turn into their ROI as usual, so a face that moves less
+ * than the ROI margin per frame stays tracked without running the detector.
+ *
+ * A face is lost when the landmark model no longer finds it in its ROI,
+ * which for Facemesh means a face score below the has_face threshold.
+ *
+ * Not thread safe, the tracker belongs to the stage that runs the landmark
+ * models.
+ */
+class RoiTracker {
+   public:
+    explicit RoiTracker(const RoiTrackerOptions& options = RoiTrackerOptions())
+        : options(options) {}
+
+    void SetOptions(const RoiTrackerOptions& new_options) {
+        options = new_options;
+    }
+    const RoiTrackerOptions& GetOptions() const { return options; }
+
+    // True when the detector has to run on the next frame
+    bool NeedsDetection() const;
+
+    // Faces of the next frame, predicted from the last landmarks
+    void PredictFaces(std::vector<cv::Rect2d>& faces) const;
+
+    // Records the landmarks found in a frame, landmarks[i] is empty when the
+    // model did not find face i. is_keyframe tells whether the faces of the
+    // frame came from the detector.
+    void Update(const std::vector<std::vector<cv::Point2d>>& landmarks,
+                bool is_keyframe, const cv::Size& frame_size);
+
+    // Forgets the tracked faces, the next frame is a keyframe
+    void Reset();
+
+   private:
+    RoiTrackerOptions options;
+
+    std::vector<cv::Rect2d> tracked_faces;
+    int frames_since_keyframe = 0;
+    bool has_keyframe = false;
+    bool lost_face = false;
+};
+}  // namespace mukham
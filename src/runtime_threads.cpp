@@ -0,0 +1,119 @@
+#include "runtime_threads.h"
+
+#include <cstdio>
+#include <opencv2/core.hpp>
+#include <sstream>
+
+#include "spdlog/spdlog.h"
+#include "tvm/runtime/container/array.h"
+#include "tvm/runtime/container/string.h"
+#include "tvm/runtime/registry.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace mukham {
+namespace tr = tvm::runtime;
+
+// threading::ThreadGroup::AffinityMode of the TVM runtime
+static constexpr int tvm_affinity_big_cores = 1;
+static constexpr int tvm_affinity_share_cores = -3;
+
+static bool PinCurrentThread(const std::vector<int>& cores) {
+#if defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (auto core : cores) {
+        if (core < CPU_SETSIZE) CPU_SET(core, &cpu_set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set),
+                                  &cpu_set) == 0;
+#else
+    return false;
+#endif
+}
+
+void ConfigureProcessThreads(const RuntimeThreadOptions& options) {
+    if (options.opencv_threads >= 0) {
+        cv::setNumThreads(options.opencv_threads);
+        spdlog::info("OpenCV threads: {}", cv::getNumThreads());
+    }
+}
+
+bool ConfigureModelThreads(const ModelThreadOptions& options) {
+    if (options.IsDefault()) return true;
+
+    bool success = true;
+    if (!options.cores.empty() && !PinCurrentThread(options.cores)) {
+        spdlog::warn("Failed to pin the thread to the cores {}",
+                     FormatCoreList(options.cores));
+        success = false;
+    }
+
+    // Only configures the pool of the calling thread
+    const auto* config_threadpool =
+        tr::Registry::Get("runtime.config_threadpool");
+    if (!config_threadpool) {
+        spdlog::warn("The TVM runtime can not configure its thread pool");
+        return false;
+    }
+    try {
+        if (options.cores.empty()) {
+            (*config_threadpool)(tvm_affinity_big_cores, options.tvm_threads);
+        } else {
+            // The workers float over the given cores
+            tr::Array<tr::String> cpus;
+            for (auto core : options.cores) {
+                cpus.push_back(std::to_string(core));
+            }
+            const int nb_threads = options.tvm_threads > 0
+                                       ? options.tvm_threads
+                                       : (int)options.cores.size();
+            (*config_threadpool)(tvm_affinity_share_cores, nb_threads, cpus);
+        }
+    } catch (...) {
+        spdlog::warn("Failed to configure the TVM thread pool");
+        return false;
+    }
+    return success;
+}
+
+bool ParseCoreList(const std::string& text, std::vector<int>& cores) {
+    cores.clear();
+    // getline does not return the empty item after a trailing comma
+    if (!text.empty() && text.back() == ',') return false;
+
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item.empty()) return false;
+        int first = 0;
+        int last = 0;
+        char extra = 0;
+        const int nb_values =
+            std::sscanf(item.c_str(), "%d-%d%c", &first, &last, &extra);
+        if (nb_values == 1 &&
+            std::sscanf(item.c_str(), "%d%c", &first, &extra) == 1) {
+            last = first;
+        } else if (nb_values != 2) {
+            return false;
+        }
+        if (first < 0 || last < first) return false;
+        for (int core = first; core <= last; ++core) {
+            cores.push_back(core);
+        }
+    }
+    return !cores.empty();
+}
+
+std::string FormatCoreList(const std::vector<int>& cores) {
+    std::string text;
+    for (size_t i = 0; i < cores.size(); ++i) {
+        if (i > 0) text += ",";
+        text += std::to_string(cores[i]);
+    }
+    return text;
+}
+}  // namespace mukham
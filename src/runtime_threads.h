@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace mukham {
+
+// Threads of one model: the thread that runs it and its TVM workers
+struct ModelThreadOptions {
+    // TVM workers of the calling thread, 0 keeps TVM's default, one per
+    // core or one per given core
+    int tvm_threads = 0;
+    // Cores the calling thread and its TVM workers run on, empty for any
+    std::vector<int> cores;
+
+    bool IsDefault() const { return tvm_threads == 0 && cores.empty(); }
+};
+
+/**
+ * Thread counts of the libraries the models run on.
+ *
+ * TVM keeps a thread pool per calling thread, so a model that runs on a
+ * thread of its own, like the stages of the FramePipeline, gets its own
+ * worker count and core set: on a 4 core board the detector can be given
+ * one core and the landmark model the other three without contending.
+ * dlib's HOG detector and shape predictor are single threaded, they scale
+ * with the landmark workers and run on the landmark cores.
+ */
+struct RuntimeThreadOptions {
+    // cv::setNumThreads for cv::resize and cv::dnn, 0 runs them on the
+    // calling thread, negative keeps OpenCV's default
+    int opencv_threads = -1;
+    ModelThreadOptions detector;
+    ModelThreadOptions landmarks;
+};
+
+// Process wide settings, applied before the models run
+void ConfigureProcessThreads(const RuntimeThreadOptions& options);
+
+// Pins the calling thread and sizes its TVM thread pool, false when the
+// runtime or the platform does not support it
+bool ConfigureModelThreads(const ModelThreadOptions& options);
+
+// "0,2-3" gives {0, 2, 3}
+bool ParseCoreList(const std::string& text, std::vector<int>& cores);
+std::string FormatCoreList(const std::vector<int>& cores);
+}  // namespace mukham
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mukham {
+
+struct QueueStats {
+    size_t depth;
+    size_t capacity;
+    uint64_t pushed;
+    uint64_t popped;
+    // Number of times the producer found the queue full
+    uint64_t push_stalls;
+    // Number of times the consumer found the queue empty
+    uint64_t pop_stalls;
+    // Items discarded by the backpressure policy
+    uint64_t dropped;
+};
+
+/**
+ * Bounded single-producer/single-consumer ring buffer.
+ *
+ * Exactly one thread may push and exactly one thread may pop. The blocking
+ * Push/Pop spin briefly and then back off to short sleeps, which keeps the
+ * hand-off cheap when the pipeline is balanced without burning a core when a
+ * stage is idle. Close() wakes both sides up: Push fails immediately and Pop
+ * fails once the remaining items have been drained.
+ */
+template <typename T>
+class SpscQueue {
+   public:
+    explicit SpscQueue(size_t capacity)
+        : slots(capacity > 0 ? capacity : 1) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool TryPush(T&& item) {
+        const auto tail = tail_idx.load(std::memory_order_relaxed);
+        const auto head = head_idx.load(std::memory_order_acquire);
+        if (tail - head == slots.size()) return false;
+
+        slots[tail % slots.size()] = std::move(item);
+        tail_idx.store(tail + 1, std::memory_order_release);
+        pushed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool Push(T&& item) {
+        if (closed.load(std::memory_order_acquire)) return false;
+        if (TryPush(std::move(item))) return true;
+
+        push_stalls.fetch_add(1, std::memory_order_relaxed);
+        for (int attempt = 0;; ++attempt) {
+            if (closed.load(std::memory_order_acquire)) return false;
+            if (TryPush(std::move(item))) return true;
+            _backoff(attempt);
+        }
+    }
+
+    bool TryPop(T& item) {
+        const auto head = head_idx.load(std::memory_order_relaxed);
+        const auto tail = tail_idx.load(std::memory_order_acquire);
+        if (head == tail) return false;
+
+        item = std::move(slots[head % slots.size()]);
+        slots[head % slots.size()] = T();
+        head_idx.store(head + 1, std::memory_order_release);
+        popped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool Pop(T& item) {
+        if (TryPop(item)) return true;
+
+        pop_stalls.fetch_add(1, std::memory_order_relaxed);
+        for (int attempt = 0;; ++attempt) {
+            if (TryPop(item)) return true;
+            if (closed.load(std::memory_order_acquire)) {
+                // The producer may have pushed right before closing
+                return TryPop(item);
+            }
+            _backoff(attempt);
+        }
+    }
+
+    void Close() { closed.store(true, std::memory_order_release); }
+
+    bool IsClosed() const { return closed.load(std::memory_order_acquire); }
+
+    size_t Size() const {
+        const auto tail = tail_idx.load(std::memory_order_acquire);
+        const auto head = head_idx.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    size_t Capacity() const { return slots.size(); }
+
+    QueueStats GetStats() const {
+        return {Size(),
+                Capacity(),
+                pushed.load(std::memory_order_relaxed),
+                popped.load(std::memory_order_relaxed),
+                push_stalls.load(std::memory_order_relaxed),
+                pop_stalls.load(std::memory_order_relaxed),
+                0};
+    }
+
+   private:
+    static void _backoff(int attempt) {
+        if (attempt < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    std::vector<T> slots;
+
+    // Producer and consumer indices live on separate cache lines
+    alignas(64) std::atomic<size_t> head_idx{0};
+    alignas(64) std::atomic<size_t> tail_idx{0};
+    alignas(64) std::atomic<bool> closed{false};
+
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> popped{0};
+    std::atomic<uint64_t> push_stalls{0};
+    std::atomic<uint64_t> pop_stalls{0};
+};
+}  // namespace mukham
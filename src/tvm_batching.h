@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace mukham {
+namespace fs = std::filesystem;
+
+// Path of the module compiled for the given batch size. Batch size 1 uses
+// the model path itself, the others <stem>_b<N><extension> next to it.
+inline fs::path GetBatchModelPath(const fs::path& model_path, int batch_size) {
+    if (batch_size == 1) return model_path;
+
+    auto file_name = model_path.stem().string() + "_b" +
+                     std::to_string(batch_size) +
+                     model_path.extension().string();
+    return model_path.parent_path() / file_name;
+}
+
+// Smallest compiled batch that holds nb_items, or the largest one. The
+// executors are sorted by batch size and not empty.
+template <typename Executor>
+Executor& SelectExecutor(std::vector<Executor>& executors, size_t nb_items) {
+    for (auto& executor : executors) {
+        if ((size_t)executor.batch_size >= nb_items) return executor;
+    }
+    return executors.back();
+}
+}  // namespace mukham
@@ -1,6 +1,7 @@
 #include "tvm_blazeface.h"
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <opencv2/core.hpp>
@@ -9,6 +10,8 @@
 #include <opencv2/imgproc.hpp>
 #include <utility>
 
+#include "fused_preprocess.h"
+#include "nms.h"
 #include "spdlog/spdlog.h"
 
 namespace tvm_blazeface {
@@ -33,107 +36,416 @@ void PreprocessImage(const cv::Mat& input_image, const cv::Size& output_size,
                            min_val);
 }
 
-std::vector<Detection> TVM_Blazeface::DetectFace(const cv::Mat& input_image) {
-    // preprocessing
+// Letterboxes the image into its slot of the batch, normalised to [-1, 1]
+static void FillSlot(const cv::Mat& image, const cv::Size& input_size,
+                     float* slot_data, int& padx, int& pady) {
+    if (mukham::ResizeNormalizeInto(image, input_size, -1.0f, 1.0f, true,
+                                    slot_data, padx, pady))
+        return;
+
+    cv::Mat preprocessed_image;
+    PreprocessImage(image, input_size, -1.0, 1.0, preprocessed_image, padx,
+                    pady);
+    std::memcpy(slot_data, preprocessed_image.data,
+                input_size.area() * 3 * sizeof(float));
+}
+
+// Same for the models that normalise the bytes in their graph
+static void FillSlot(const cv::Mat& image, const cv::Size& input_size,
+                     uint8_t* slot_data, int& padx, int& pady) {
+    if (mukham::ResizeInto(image, input_size, true, slot_data, padx, pady))
+        return;
+
     cv::Mat preprocessed_image;
+    PreprocessImage(image, input_size, 0.0, 255.0, preprocessed_image, padx,
+                    pady);
+    cv::Mat slot_image(input_size, CV_8UC3, slot_data);
+    preprocessed_image.convertTo(slot_image, CV_8UC3);
+}
+
+TVM_Blazeface::~TVM_Blazeface() {
+    {
+        std::lock_guard<std::mutex> lock(async_mutex);
+        stop_async = true;
+    }
+    async_cond.notify_all();
+    if (async_runner.joinable()) async_runner.join();
+}
+
+bool TVM_Blazeface::_prepare_executor(int batch_size,
+                                      mukham::TvmExecutor& executor,
+                                      CallState& state) {
+    state.batch_size = batch_size;
+    state.nms.engine.SetOptions(nms_options);
+    try {
+        // The executor's own input storage, which the preprocessing writes
+        // into instead of going through set_input
+        state.input_tensor = executor.GetInput(input_name);
+        state.uint8_input = mukham::HasUint8Elements(state.input_tensor);
+    } catch (...) {
+        spdlog::error("Blazeface model has no input {}", input_name);
+        return false;
+    }
+    return true;
+}
+
+bool TVM_Blazeface::_load_executor(const fs::path& module_path,
+                                   int batch_size) {
+    if (batch_size < 1 || !module_path.has_filename() ||
+        !module_path.has_extension())
+        return false;
+    // The batched modules are optional, most setups only compile the batch
+    // size 1
+    if (batch_size > 1 && !fs::exists(module_path)) {
+        spdlog::debug("No Blazeface module for batch size {}: {}", batch_size,
+                      module_path.string());
+        return false;
+    }
+
+    //@todo: Add option to choose the device type
+    auto model = mukham::TvmModel::Load(module_path);
+    BatchExecutors batch{batch_size, nullptr};
+    if (model) {
+        batch.pool = std::make_unique<ExecutorPool>(
+            model, [this, batch_size](mukham::TvmExecutor& executor,
+                                      CallState& state) {
+                return _prepare_executor(batch_size, executor, state);
+            });
+    }
+    // The first executor is created up front, it stays in the pool for the
+    // first call
+    if (!batch.pool || !batch.pool->Acquire()) {
+        spdlog::error("Failed to load Blazeface model {}",
+                      module_path.string());
+        return false;
+    }
+
+    auto position = std::find_if(
+        executors.begin(), executors.end(),
+        [&](const BatchExecutors& e) { return e.batch_size >= batch_size; });
+    executors.insert(position, std::move(batch));
+    return true;
+}
+
+std::vector<int> TVM_Blazeface::GetBatchSizes() const {
+    std::vector<int> batch_sizes;
+    for (const auto& executor : executors) {
+        batch_sizes.push_back(executor.batch_size);
+    }
+    return batch_sizes;
+}
+
+void TVM_Blazeface::_run_batch(Slot& slot, const cv::Mat* images,
+                               size_t nb_images, DetectionsVec* detections) {
+    auto& state = slot.state;
+    state.frame_pads.resize(nb_images);
+    state.frame_sizes.resize(nb_images);
+    for (size_t idx = 0; idx < nb_images; ++idx) {
+        state.frame_sizes[idx] = images[idx].size();
+    }
+
+    _fill_batch(state, images, nb_images, state.frame_pads.data());
+    slot.executor.Run();
+    _decode_batch(slot.executor, state, state.frame_sizes.data(),
+                  state.frame_pads.data(), nb_images, detections);
+}
+
+void TVM_Blazeface::_fill_batch(CallState& state, const cv::Mat* images,
+                                size_t nb_images, cv::Point* pads) {
+    // A uint8 input takes the letterboxed bytes, a quarter of the float data
+    if (state.uint8_input)
+        _fill_slots(state, images, nb_images, pads, state.host_input_bytes);
+    else
+        _fill_slots(state, images, nb_images, pads, state.host_input);
+}
+
+template <typename T>
+void TVM_Blazeface::_fill_slots(CallState& state, const cv::Mat* images,
+                                size_t nb_images, cv::Point* pads,
+                                std::vector<T>& host_buffer) {
     auto expected_input_size = cv::Size(anchor_options.input_size_width,
                                         anchor_options.input_size_height);
+    const size_t slot_size = expected_input_size.area() * 3;
+    const size_t input_size = state.batch_size * slot_size;
+
+    // The letterboxed frames are written straight into the executor's
+    // input, or into a host buffer that is uploaded for other devices
+    auto input_data = mukham::HostData<T>(state.input_tensor);
+    if (!input_data) {
+        host_buffer.resize(input_size);
+        input_data = host_buffer.data();
+    }
 
-    int padx, pady;
-    PreprocessImage(input_image, expected_input_size, -1.0, 1.0,
-                    preprocessed_image, padx, pady);
+    for (size_t idx = 0; idx < nb_images; ++idx) {
+        int padx, pady;
+        FillSlot(images[idx], expected_input_size,
+                 input_data + idx * slot_size, padx, pady);
+        pads[idx] = cv::Point(padx, pady);
+    }
 
-    // Set the input
-    auto single_image_size =
-        preprocessed_image.total() * preprocessed_image.elemSize();
-    input_tensor.CopyFromBytes(preprocessed_image.data, single_image_size);
-    set_input("input", input_tensor);
+    // Zero the padding of a partial batch so it does not carry stale faces
+    const size_t nb_padding = state.batch_size - nb_images;
+    if (nb_padding > 0) {
+        std::memset(input_data + nb_images * slot_size, 0,
+                    nb_padding * slot_size * sizeof(T));
+    }
+    if (input_data == host_buffer.data()) {
+        state.input_tensor.CopyFromBytes(input_data, input_size * sizeof(T));
+    }
+}
 
-    // Execute the model
-    run();
+void TVM_Blazeface::_decode_batch(const mukham::TvmExecutor& executor,
+                                  CallState& state,
+                                  const cv::Size* frame_sizes,
+                                  const cv::Point* pads, size_t nb_images,
+                                  DetectionsVec* detections) {
+    // The outputs are read in place from the executor's storage, the host
+    // buffers are only filled for tensors that live on another device
+    tr::NDArray box_tensor = executor.GetOutput(0);
+    tr::NDArray score_tensor = executor.GetOutput(1);
+    mukham::TensorView<float> raw_boxes(box_tensor, state.host_boxes);
+    mukham::TensorView<float> raw_scores(score_tensor, state.host_scores);
+
+    const size_t boxes_stride = box_options.num_boxes * box_options.num_coords;
+    const size_t scores_stride = box_options.num_boxes;
+    for (size_t idx = 0; idx < nb_images; ++idx) {
+        // Convert to boxes
+        auto& frame_detections = detections[idx];
+        frame_detections.clear();
+        _decode_boxes(state.nms, raw_boxes.data() + idx * boxes_stride,
+                      raw_scores.data() + idx * scores_stride,
+                      frame_detections);
+
+        const auto& frame_size = frame_sizes[idx];
+        const auto padx = pads[idx].x;
+        const auto pady = pads[idx].y;
+        auto scale_factor = (std::max)(frame_size.height, frame_size.width);
+        for (auto& d : frame_detections) {
+            auto& box = d.bounding_box;
+            box.x = (box.x * scale_factor) - padx;
+            box.y = (box.y * scale_factor) - pady;
+            box.width *= scale_factor;
+            box.height *= scale_factor;
+
+            for (auto& kp : d.key_points) {
+                kp.x = (kp.x * scale_factor) - padx;
+                kp.y = (kp.y * scale_factor) - pady;
+            }
+        }
+    }
+}
 
-    // Get the output tensors
-    get_output(0, output_tensor_1);
-    get_output(1, output_tensor_2);
+std::vector<Detection> TVM_Blazeface::DetectFace(const cv::Mat& input_image) {
+    std::vector<Detection> detections;
+    if (!can_execute) return detections;
 
-    // Get the raw boxes
-    auto output_tensor_1_size =
-        box_options.num_boxes * box_options.num_coords * batch_size;
+    auto lease = mukham::SelectExecutor(executors, 1).pool->Acquire();
+    if (!lease) return detections;
+    _run_batch(*lease, &input_image, 1, &detections);
+    return detections;
+}
 
-    auto raw_boxes = std::make_unique<float[]>(output_tensor_1_size);
+bool TVM_Blazeface::EnableAsync(size_t nb_buffers) {
+    if (!async_buffers.empty()) return true;
+    if (nb_buffers < 1) return false;
+
+    auto single = std::find_if(
+        executors.begin(), executors.end(),
+        [](const BatchExecutors& e) { return e.batch_size == 1; });
+    if (single == executors.end()) return false;
+
+    // Separate executors, so that a buffer can be filled or decoded while
+    // the other ones run. They are leased from the batch 1 pool until the
+    // detector is destroyed.
+    std::vector<AsyncBuffer> buffers(nb_buffers);
+    for (auto& buffer : buffers) {
+        buffer.lease = single->pool->Acquire();
+        if (!buffer.lease) return false;
+    }
 
-    output_tensor_1.CopyToBytes(
-        raw_boxes.get(),
-        output_tensor_1_size * output_tensor_1.DataType().bytes());
+    async_buffers = std::move(buffers);
+    async_runner = std::thread(&TVM_Blazeface::_async_loop, this);
+    return true;
+}
 
-    // Get the raw scores
-    auto output_tensor_2_size = box_options.num_boxes * batch_size;
+bool TVM_Blazeface::SubmitFrame(const cv::Mat& input_image) {
+    if (!can_execute || !EnableAsync()) return false;
+    if (frames_in_flight == async_buffers.size()) return false;
 
-    auto raw_scores = std::make_unique<float[]>(output_tensor_2_size);
+    // Not in flight, the runner thread does not touch it
+    auto& buffer = async_buffers[next_submit];
+    buffer.frame_size = input_image.size();
+    buffer.done = false;
+    buffer.failed = false;
+    _fill_batch(buffer.lease->state, &input_image, 1, &buffer.pad);
 
-    output_tensor_2.CopyToBytes(
-        raw_scores.get(),
-        output_tensor_2_size * output_tensor_2.DataType().bytes());
+    {
+        std::lock_guard<std::mutex> lock(async_mutex);
+        queued_buffers.push_back(next_submit);
+    }
+    async_cond.notify_all();
 
-    // Convert to boxes
-    std::vector<Detection> detections;
-    _decode_boxes(std::move(raw_boxes), std::move(raw_scores), detections);
-
-    auto scale_factor = (std::max)(input_image.rows, input_image.cols);
-    for (auto& d : detections) {
-        auto& box = d.bounding_box;
-        box.x = (box.x * scale_factor) - padx;
-        box.y = (box.y * scale_factor) - pady;
-        box.width *= scale_factor;
-        box.height *= scale_factor;
-
-        for (auto& kp : d.key_points) {
-            kp.x = (kp.x * scale_factor) - padx;
-            kp.y = (kp.y * scale_factor) - pady;
+    next_submit = (next_submit + 1) % async_buffers.size();
+    frames_in_flight++;
+    return true;
+}
+
+bool TVM_Blazeface::CompleteFrame(std::vector<Detection>& detections) {
+    detections.clear();
+    if (frames_in_flight == 0) return false;
+
+    auto& buffer = async_buffers[next_complete];
+    {
+        std::unique_lock<std::mutex> lock(async_mutex);
+        async_cond.wait(lock, [&buffer] { return buffer.done; });
+    }
+    next_complete = (next_complete + 1) % async_buffers.size();
+    frames_in_flight--;
+
+    if (buffer.failed) return false;
+    _decode_batch(buffer.lease->executor, buffer.lease->state,
+                  &buffer.frame_size, &buffer.pad, 1, &detections);
+    return true;
+}
+
+void TVM_Blazeface::_async_loop() {
+    while (true) {
+        size_t buffer_idx;
+        {
+            std::unique_lock<std::mutex> lock(async_mutex);
+            async_cond.wait(lock, [this] {
+                return stop_async || !queued_buffers.empty();
+            });
+            if (stop_async) return;
+            buffer_idx = queued_buffers.front();
+            queued_buffers.pop_front();
+        }
+
+        auto& buffer = async_buffers[buffer_idx];
+        bool failed = false;
+        try {
+            buffer.lease->executor.Run();
+        } catch (...) {
+            spdlog::error("Blazeface inference failed");
+            failed = true;
         }
+
+        {
+            std::lock_guard<std::mutex> lock(async_mutex);
+            buffer.failed = failed;
+            buffer.done = true;
+        }
+        async_cond.notify_all();
+    }
+}
+
+std::vector<DetectionsVec> TVM_Blazeface::DetectFaces(
+    const std::vector<cv::Mat>& input_images) {
+    std::vector<DetectionsVec> detections(input_images.size());
+    if (!can_execute) return detections;
+
+    // Inputs larger than the biggest compiled batch run in several chunks,
+    // each on the smallest batch that holds it
+    size_t start = 0;
+    while (start < input_images.size()) {
+        auto& batch =
+            mukham::SelectExecutor(executors, input_images.size() - start);
+        auto lease = batch.pool->Acquire();
+        if (!lease) break;
+        auto nb_images = (std::min)((size_t)batch.batch_size,
+                                    input_images.size() - start);
+        _run_batch(*lease, &input_images[start], nb_images,
+                   &detections[start]);
+        start += nb_images;
     }
 
     return detections;
 }
 
-void TVM_Blazeface::_get_anchor_boxes() {
-    int layer_id = 0, last_same_stride_layer = 0, repeats = 0;
-
-    while (layer_id < anchor_options.num_layers) {
-        last_same_stride_layer = layer_id;
-        repeats = 0;
-        while (last_same_stride_layer < anchor_options.num_layers &&
-               anchor_options.strides[last_same_stride_layer] ==
-                   anchor_options.strides[layer_id]) {
-            last_same_stride_layer += 1;
-            repeats += 2;
-        }
+std::vector<Detection> TVM_Blazeface::DetectFaceTiled(
+    const cv::Mat& input_image, const TileOptions& options) {
+    if (options.NumTiles() <= 1) return DetectFace(input_image);
 
-        auto stride = anchor_options.strides[layer_id];
-        int feature_map_height = anchor_options.input_size_height / stride;
-        int feature_map_width = anchor_options.input_size_width / stride;
-
-        for (int y = 0; y < feature_map_height; y++) {
-            double y_center =
-                (y + anchor_options.anchor_offset_y) / feature_map_height;
-            for (int x = 0; x < feature_map_width; x++) {
-                double x_center =
-                    (x + anchor_options.anchor_offset_x) / feature_map_width;
-                for (int r = 0; r < repeats; r++) {
-                    anchors.push_back(std::make_pair(x_center, y_center));
-                }
+    std::vector<Detection> detections;
+    if (!can_execute || input_image.empty()) return detections;
+
+    // The tiles are views into the frame, nothing is copied before the
+    // letterboxing writes them into the batch
+    const auto tiles = MakeTiles(input_image.size(), options);
+    std::vector<cv::Mat> tile_images;
+    for (const auto& tile : tiles) {
+        tile_images.push_back(input_image(tile));
+    }
+    auto per_tile = DetectFaces(tile_images);
+
+    DetectionsVec tile_detections;
+    for (size_t idx = 0; idx < tiles.size(); ++idx) {
+        const auto& tile = tiles[idx];
+        for (auto& d : per_tile[idx]) {
+            d.bounding_box.x += tile.x;
+            d.bounding_box.y += tile.y;
+            for (auto& kp : d.key_points) {
+                kp.x += tile.x;
+                kp.y += tile.y;
             }
+            tile_detections.push_back(d);
         }
+    }
 
-        layer_id = last_same_stride_layer;
+    // Faces in the overlap are found by both tiles, the weighted NMS
+    // averages them into one box like the overlapping anchors of a tile
+    NmsScratch nms;
+    nms.engine.SetOptions(nms_options);
+    _weighted_nms(nms, tile_detections, detections);
+    return detections;
+}
+
+std::vector<cv::Rect> MakeTiles(const cv::Size& frame_size,
+                                const TileOptions& options) {
+    std::vector<cv::Rect> tiles;
+    auto axis_tiles = [&](int size, int nb_tiles,
+                          std::vector<cv::Range>& ranges) {
+        nb_tiles = std::clamp(nb_tiles, 1, (std::max)(size, 1));
+        const double overlap = std::clamp(options.overlap, 0.0, 0.9);
+        // nb_tiles tiles of length l overlapping by overlap * l span size
+        const int length = (int)std::ceil(
+            size / (nb_tiles - (nb_tiles - 1) * overlap));
+        const double stride =
+            nb_tiles > 1 ? (double)(size - length) / (nb_tiles - 1) : 0.0;
+        for (int i = 0; i < nb_tiles; ++i) {
+            const int start = (int)std::lround(i * stride);
+            ranges.push_back(
+                cv::Range(start, (std::min)(start + length, size)));
+        }
+    };
+
+    std::vector<cv::Range> columns, rows;
+    axis_tiles(frame_size.width, options.cols, columns);
+    axis_tiles(frame_size.height, options.rows, rows);
+    for (const auto& row : rows) {
+        for (const auto& column : columns) {
+            tiles.push_back(cv::Rect(column.start, row.start, column.size(),
+                                     row.size()));
+        }
     }
+    return tiles;
 }
 
-void TVM_Blazeface::_decode_boxes(std::unique_ptr<float[]> raw_boxes,
-                                  std::unique_ptr<float[]> raw_scores,
-                                  std::vector<Detection>& detections) {
-    DetectionsVec all_detections;
-    for (int i = 0; i < num_boxes; ++i) {
+void GenerateAnchors(const SSDOptions& options, AnchorTable& anchors) {
+    anchors.x_center.clear();
+    anchors.y_center.clear();
+    ForEachAnchor(options, [&](double x_center, double y_center) {
+        anchors.x_center.push_back((float)x_center);
+        anchors.y_center.push_back((float)y_center);
+    });
+}
+
+void DecodeBoxesReference(const float* raw_boxes, const float* raw_scores,
+                          const TensorToBoxesOptions& box_options,
+                          const AnchorTable& anchors,
+                          DetectionsVec& detections) {
+    detections.clear();
+    for (int i = 0; i < box_options.num_boxes; ++i) {
         auto score = raw_scores[i];
         if (box_options.sigmoid_score) {
             score =
@@ -155,8 +467,8 @@ void TVM_Blazeface::_decode_boxes(std::unique_ptr<float[]> raw_boxes,
             std::swap(h, w);
         }
 
-        x_center = (x_center / box_options.x_scale) + anchors[i].first;
-        y_center = (y_center / box_options.y_scale) + anchors[i].second;
+        x_center = (x_center / box_options.x_scale) + anchors.x_center[i];
+        y_center = (y_center / box_options.y_scale) + anchors.y_center[i];
         w = w / box_options.x_scale;
         h = h / box_options.y_scale;
 
@@ -172,8 +484,8 @@ void TVM_Blazeface::_decode_boxes(std::unique_ptr<float[]> raw_boxes,
             }
 
             key_points[kidx] = cv::Point2d(
-                keypoint_x / box_options.x_scale + anchors[i].first,
-                keypoint_y / box_options.y_scale + anchors[i].second);
+                keypoint_x / box_options.x_scale + anchors.x_center[i],
+                keypoint_y / box_options.y_scale + anchors.y_center[i]);
         }
 
         if (h < 0 || w < 0) continue;
@@ -181,32 +493,82 @@ void TVM_Blazeface::_decode_boxes(std::unique_ptr<float[]> raw_boxes,
         const float left = x_center - w / 2.f;
         const float top = y_center - h / 2.f;
 #ifdef WIN32
-        all_detections.push_back({/* .score = */ score,
+        detections.push_back({/* .score = */ score,
                                   /* .bounding_box = */ cv::Rect2d(left, top, w, h),
                                   /* .key_points = */ std::move(key_points)});
 #else
-        all_detections.push_back({ .score = score,
+        detections.push_back({ .score = score,
                                   .bounding_box = cv::Rect2d(left, top, w, h),
                                   .key_points = std::move(key_points) });
 #endif
     }
+}
 
-    _weighted_nms(all_detections, detections);
+void TVM_Blazeface::_decode_boxes(NmsScratch& nms, const float* raw_boxes,
+                                  const float* raw_scores,
+                                  std::vector<Detection>& detections) {
+    DetectionsVec all_detections;
+    switch (model_type) {
+        case BlazefaceModel::Front:
+            DecodeBoxes<FrontModel>(raw_boxes, raw_scores, all_detections);
+            break;
+        case BlazefaceModel::ShortRange:
+            DecodeBoxes<ShortRangeModel>(raw_boxes, raw_scores,
+                                         all_detections);
+            break;
+        case BlazefaceModel::FullRange:
+            DecodeBoxes<FullRangeModel>(raw_boxes, raw_scores, all_detections);
+            break;
+    }
+    _weighted_nms(nms, all_detections, detections);
 }
 
-void TVM_Blazeface::_make_indexed_scores(const DetectionsVec& detections,
-                                         IndexedScoresVec& idx_scores) {
-    int index = 0;
+void TVM_Blazeface::_weighted_nms(NmsScratch& nms,
+                                  const DetectionsVec& detections,
+                                  DetectionsVec& output) {
+    nms.boxes.clear();
+    nms.scores.clear();
     for (const auto& detection : detections) {
-        idx_scores.push_back(std::make_pair(index, (double)(detection.score)));
-        index++;
+        nms.boxes.push_back(detection.bounding_box);
+        nms.scores.push_back(detection.score);
+    }
+
+    nms.engine.WeightedNms(nms.boxes, nms.scores, nms.weighted_boxes);
+    for (const auto& weighted : nms.weighted_boxes) {
+        output.push_back(detections[weighted.index]);
+        output.back().bounding_box = weighted.box;
     }
 }
 
-void TVM_Blazeface::_weighted_nms(const std::vector<Detection> detections,
-                                  std::vector<Detection>& output) {
-    std::vector<IndexedScore> indexed_scores;
-    _make_indexed_scores(detections, indexed_scores);
+void TVM_Blazeface::_nms(
+    NmsScratch& nms,
+    const std::vector<std::pair<double, cv::Rect2d>>& detections,
+    std::vector<cv::Rect2d>& output) {
+    nms.boxes.clear();
+    nms.scores.clear();
+    for (const auto& [score, box] : detections) {
+        nms.boxes.push_back(box);
+        nms.scores.push_back(score);
+    }
+
+    std::vector<int> kept;
+    nms.engine.Nms(nms.boxes, nms.scores, kept);
+    for (auto idx : kept) {
+        output.push_back(nms.boxes[idx]);
+    }
+}
+
+void WeightedNmsReference(const DetectionsVec& detections,
+                          double min_score_thresh,
+                          double min_supression_threshold,
+                          DetectionsVec& output) {
+    IndexedScoresVec indexed_scores;
+    int index = 0;
+    for (const auto& detection : detections) {
+        indexed_scores.push_back(
+            std::make_pair(index, (double)(detection.score)));
+        index++;
+    }
 
     // sort the index scores
     std::sort(indexed_scores.begin(), indexed_scores.end(),
@@ -214,13 +576,12 @@ void TVM_Blazeface::_weighted_nms(const std::vector<Detection> detections,
 
     IndexedScoresVec remaining;
     IndexedScoresVec candidates;
-    const double min_supression_threshold = 0.3;
 
     while (!indexed_scores.empty()) {
         const int original_indexed_scores_size = indexed_scores.size();
         const Detection detection = detections[indexed_scores.front().first];
 
-        if (detection.score < box_options.min_score_thresh) break;
+        if (detection.score < min_score_thresh) break;
 
         remaining.clear();
         candidates.clear();
@@ -228,7 +589,7 @@ void TVM_Blazeface::_weighted_nms(const std::vector<Detection> detections,
         auto detection_box = detection.bounding_box;
         for (const auto& idx_score : indexed_scores) {
             auto other_bbox = detections[idx_score.first].bounding_box;
-            auto similarity = _overlap_similarity(detection_box, other_bbox);
+            auto similarity = mukham::OverlapSimilarity(detection_box, other_bbox);
 
             if (similarity > min_supression_threshold)
                 candidates.push_back(idx_score);
@@ -272,67 +633,4 @@ void TVM_Blazeface::_weighted_nms(const std::vector<Detection> detections,
     }
 }
 
-void TVM_Blazeface::_nms(
-    const std::vector<std::pair<double, cv::Rect2d>> detections,
-    std::vector<cv::Rect2d>& output) {
-    const double min_supression_threshold = 0.3;
-
-    std::vector<cv::Rect2d> kept_boxes;
-    bool supressed = false;
-
-    for (const auto& [score, box] : detections) {
-        if (score < box_options.min_score_thresh) {
-            break;
-        }
-
-        supressed = false;
-        for (const auto& kept : kept_boxes) {
-            auto similarity = _overlap_similarity(kept, box);
-            if (similarity > min_supression_threshold) {
-                supressed = true;
-                break;
-            }
-        }
-
-        if (!supressed) {
-            kept_boxes.push_back(box);
-            output.push_back(box);
-        }
-    }
-}
-
-double TVM_Blazeface::_overlap_similarity(const cv::Rect2d& box1,
-                                          const cv::Rect2d& box2) {
-    auto intersection = _get_intesection(box1, box2);
-    if (intersection.empty()) return 0.0;
-
-    auto numerator = intersection.area();
-    auto denominator = box1.area() + box2.area() - intersection.area();
-    if (denominator <= 0) return 0.0;
-    return numerator / denominator;
-}
-
-cv::Rect2d TVM_Blazeface::_get_intesection(const cv::Rect2d& box1,
-                                           const cv::Rect2d& box2) {
-    const auto xmin1 = box1.x;
-    const auto ymin1 = box1.y;
-    const auto xmax1 = box1.x + box1.width;
-    const auto ymax1 = box1.y + box1.height;
-
-    const auto xmin2 = box2.x;
-    const auto ymin2 = box2.y;
-    const auto xmax2 = box2.x + box2.width;
-    const auto ymax2 = box2.y + box2.height;
-
-    auto xmin = (std::max)(xmin1, xmin2);
-    auto ymin = (std::max)(ymin1, ymin2);
-    auto xmax = (std::min)(xmax1, xmax2);
-    auto ymax = (std::min)(ymax1, ymax2);
-
-    if ((xmin < xmax) && (ymin < ymax)) {
-        return cv::Rect2d(xmin, ymin, (xmax - xmin), (ymax - ymin));
-    }
-
-    return cv::Rect2d();
-}
 }  // namespace tvm_blazeface
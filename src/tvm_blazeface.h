@@ -1,12 +1,27 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+#include "blazeface_models.h"
 #include "dlpack/dlpack.h"
+#include "nms.h"
 #include "opencv2/core.hpp"
 #include "tvm/runtime/module.h"
 #include "tvm/runtime/ndarray.h"
 #include "tvm/runtime/packed_func.h"
+#include "tvm_batching.h"
+#include "tvm_model.h"
+#include "tvm_tensor_view.h"
 
 namespace tvm_blazeface {
 namespace tr = tvm::runtime;
@@ -18,186 +33,356 @@ struct Detection {
     std::array<cv::Point2d, 6> key_points;
 };
 
-struct SSDOptions {
-    int num_layers;
-    double min_scale;
-    double max_scale;
-    int input_size_height;
-    int input_size_width;
-    double anchor_offset_x;
-    double anchor_offset_y;
-    std::array<int, 4> strides;
-    double aspect_ratios;
-    bool fixed_anchor_size;
+// Anchors generated at runtime, for options that are not known at compile
+// time
+struct AnchorTable {
+    std::vector<float> x_center;
+    std::vector<float> y_center;
+
+    size_t size() const { return x_center.size(); }
 };
 
-struct TensorToBoxesOptions {
-    int num_classes;
-    int num_boxes;
-    int num_coords;
-    int box_coord_offset;
-    int keypoint_coord_offset;
-    int num_keypoints;
-    int num_values_per_keypoint;
-    bool sigmoid_score;
-    double score_clipping_thresh;
-    bool reverse_output_order;
-    double x_scale;
-    double y_scale;
-    double h_scale;
-    double w_scale;
-    double min_score_thresh;
+// Grid of overlapping tiles covering a frame, so that small faces keep
+// enough pixels once a tile is scaled down to the model input
+struct TileOptions {
+    int rows = 1;
+    int cols = 1;
+    // Fraction of a tile shared with its neighbour, faces cut by a seam are
+    // whole in one of the two tiles as long as they fit in the overlap
+    double overlap = 0.25;
+
+    int NumTiles() const { return rows * cols; }
 };
 
-void PreprocessImage(const cv::Mat& input_image, const cv::Size& output_size,
-                     double min_val, double max_val, cv::Mat& output_image,
-                     int& padx, int& pady);
+// Tiles of the grid in row major order, they all have the same size
+std::vector<cv::Rect> MakeTiles(const cv::Size& frame_size,
+                                const TileOptions& options);
 
 using IndexedScore = std::pair<int, double>;
 using DetectionsVec = std::vector<Detection>;
 using IndexedScoresVec = std::vector<IndexedScore>;
 
+void GenerateAnchors(const SSDOptions& options, AnchorTable& anchors);
+
+void PreprocessImage(const cv::Mat& input_image, const cv::Size& output_size,
+                     double min_val, double max_val, cv::Mat& output_image,
+                     int& padx, int& pady);
+
+// Decodes the boxes scoring above min_score_thresh, in anchor order, with
+// coordinates relative to the model input. The threshold is applied to the
+// raw logits, so only the surviving boxes go through the sigmoid.
+template <typename Anchors>
+void DecodeBoxes(const float* raw_boxes, const float* raw_scores,
+                 const TensorToBoxesOptions& box_options,
+                 const Anchors& anchors, DetectionsVec& detections) {
+    detections.clear();
+    const int num_boxes = box_options.num_boxes;
+
+    // The sigmoid is monotonic, so the score threshold can be moved to the
+    // logits once instead of taking the exponential of every score
+    double threshold = box_options.min_score_thresh;
+    if (box_options.sigmoid_score) {
+        const double clip = box_options.score_clipping_thresh;
+        if (threshold <= 0.0) {
+            threshold = -std::numeric_limits<double>::infinity();
+        } else if (threshold >= 1.0) {
+            threshold = std::numeric_limits<double>::infinity();
+        } else {
+            threshold = std::log(threshold / (1.0 - threshold));
+        }
+        // Clipped scores saturate: a logit above the clip keeps nothing and
+        // one below it keeps everything
+        if (threshold > clip) return;
+        if (threshold < -clip)
+            threshold = -std::numeric_limits<double>::infinity();
+    }
+    const float logit_threshold = (float)threshold;
+
+    // Most anchors are background, so blocks without a candidate are
+    // rejected with a compare loop the compiler vectorises
+    constexpr int block_size = 16;
+    int candidates[block_size];
+    for (int block = 0; block < num_boxes; block += block_size) {
+        const int block_end = (std::min)(block + block_size, num_boxes);
+
+        int nb_candidates = 0;
+        for (int i = block; i < block_end; ++i) {
+            nb_candidates += raw_scores[i] >= logit_threshold;
+        }
+        if (nb_candidates == 0) continue;
+
+        nb_candidates = 0;
+        for (int i = block; i < block_end; ++i) {
+            candidates[nb_candidates] = i;
+            nb_candidates += raw_scores[i] >= logit_threshold;
+        }
+
+        for (int c = 0; c < nb_candidates; ++c) {
+            const int i = candidates[c];
+            const float* box = raw_boxes + i * box_options.num_coords;
+
+            float y_center = box[box_options.box_coord_offset];
+            float x_center = box[box_options.box_coord_offset + 1];
+            float h = box[box_options.box_coord_offset + 2];
+            float w = box[box_options.box_coord_offset + 3];
+            if (box_options.reverse_output_order) {
+                std::swap(x_center, y_center);
+                std::swap(h, w);
+            }
+            w = w / box_options.x_scale;
+            h = h / box_options.y_scale;
+            if (h < 0 || w < 0) continue;
+
+            const float anchor_x = anchors.x_center[i];
+            const float anchor_y = anchors.y_center[i];
+            x_center = (x_center / box_options.x_scale) + anchor_x;
+            y_center = (y_center / box_options.y_scale) + anchor_y;
+
+            double score = raw_scores[i];
+            if (box_options.sigmoid_score) {
+                score = std::clamp<double>(
+                    score, -box_options.score_clipping_thresh,
+                    box_options.score_clipping_thresh);
+                score = 1 / (1 + std::exp(-score));
+            }
+
+            Detection detection;
+            detection.score = score;
+            detection.bounding_box =
+                cv::Rect2d(x_center - w / 2.f, y_center - h / 2.f, w, h);
+            for (int kidx = 0; kidx < box_options.num_keypoints; kidx++) {
+                const float* keypoint =
+                    box + box_options.keypoint_coord_offset +
+                    kidx * box_options.num_values_per_keypoint;
+                float keypoint_y = keypoint[0];
+                float keypoint_x = keypoint[1];
+                if (box_options.reverse_output_order) {
+                    std::swap(keypoint_y, keypoint_x);
+                }
+                detection.key_points[kidx] =
+                    cv::Point2d(keypoint_x / box_options.x_scale + anchor_x,
+                                keypoint_y / box_options.y_scale + anchor_y);
+            }
+            detections.push_back(std::move(detection));
+        }
+    }
+}
+
+// Decoder specialised on a model descriptor, the options and anchors are
+// compile time constants
+template <typename Model>
+void DecodeBoxes(const float* raw_boxes, const float* raw_scores,
+                 DetectionsVec& detections) {
+    DecodeBoxes(raw_boxes, raw_scores, Model::box_options,
+                ModelAnchors<Model>::anchors, detections);
+}
+
+// Straightforward per-anchor decoder, the reference for DecodeBoxes
+void DecodeBoxesReference(const float* raw_boxes, const float* raw_scores,
+                          const TensorToBoxesOptions& options,
+                          const AnchorTable& anchors,
+                          DetectionsVec& detections);
+
+// Weighted NMS repartitioning the remaining boxes on every pass, the
+// reference for mukham::NmsEngine::WeightedNms
+void WeightedNmsReference(const DetectionsVec& detections,
+                          double min_score_thresh,
+                          double min_supression_threshold,
+                          DetectionsVec& output);
+
 class TVM_Blazeface final {
    public:
-    explicit TVM_Blazeface(fs::path& model_path, int batch_size = 1) {
-        can_execute = true;
-
-#ifdef WIN32
-        anchor_options = { /* .num_layers = */ 4,
-                           /* .min_scale = */ 0.1484375,
-                           /* .max_scale = */ 0.75,
-                           /* .input_size_height = */ 128,
-                           /* .input_size_width = */ 128,
-                           /* .anchor_offset_x = */ 0.5,
-                           /* .anchor_offset_y = */ 0.5,
-                           /* .strides = */ {8, 16, 16, 16},
-                           /* .aspect_ratios = */ 1.0,
-                           /* .fixed_anchor_size = */ true };
-
-        box_options = { /* .num_classes = */ 1,
-                        /* .num_boxes = */ 896,
-                        /* .num_coords = */ 16,
-                        /* .box_coord_offset = */ 0,
-                        /* .keypoint_coord_offset = */ 4,
-                        /* .num_keypoints = */ 6,
-                        /* .num_values_per_keypoint = */ 2,
-                        /* .sigmoid_score = */ true,
-                        /* .score_clipping_thresh = */ 80.0,
-                        /* .reverse_output_order = */ true,
-                        /* .x_scale = */ 128.0,
-                        /* .y_scale = */ 128.0,
-                        /* .h_scale = */ 128.0,
-                        /* .w_scale = */ 128.0,
-                        /* .min_score_thresh = */ 0.5 };
-#else
-        anchor_options = {.num_layers = 4,
-                          .min_scale = 0.1484375,
-                          .max_scale = 0.75,
-                          .input_size_height = 128,
-                          .input_size_width = 128,
-                          .anchor_offset_x = 0.5,
-                          .anchor_offset_y = 0.5,
-                          .strides = {8, 16, 16, 16},
-                          .aspect_ratios = 1.0,
-                          .fixed_anchor_size = true};
-
-        box_options = {.num_classes = 1,
-                       .num_boxes = 896,
-                       .num_coords = 16,
-                       .box_coord_offset = 0,
-                       .keypoint_coord_offset = 4,
-                       .num_keypoints = 6,
-                       .num_values_per_keypoint = 2,
-                       .sigmoid_score = true,
-                       .score_clipping_thresh = 80.0,
-                       .reverse_output_order = true,
-                       .x_scale = 128.0,
-                       .y_scale = 128.0,
-                       .h_scale = 128.0,
-                       .w_scale = 128.0,
-                       .min_score_thresh = 0.5};
-#endif
-        auto file_exists = fs::exists(model_path);
-        auto has_file_name = model_path.has_filename();
-        auto has_extension = model_path.has_extension();
-        if (file_exists && has_file_name && has_extension) {
-            try {
-                tr::Module mod_factory =
-                    tr::Module::LoadFromFile(model_path.string());
-                DLDevice dev{kDLCPU,
-                             0};  //@todo: Add option to choose the device type
-                gmod = mod_factory.GetFunction("default")(dev);
-                set_input = gmod.GetFunction("set_input");
-                get_output = gmod.GetFunction("get_output");
-                run = gmod.GetFunction("run");
-
-                input_tensor = tr::NDArray::Empty(
-                    {batch_size, anchor_options.input_size_width,
-                     anchor_options.input_size_height, 3},
-                    DLDataType{kDLFloat, 32, 1}, dev);
-
-                output_tensor_1 = tr::NDArray::Empty(
-                    {batch_size, box_options.num_boxes, box_options.num_coords},
-                    DLDataType{kDLFloat, 32, 1}, dev);
-
-                output_tensor_2 =
-                    tr::NDArray::Empty({batch_size, box_options.num_boxes, 1},
-                                       DLDataType{kDLFloat, 32, 1}, dev);
-
-            } catch (...) {
-                can_execute = false;
-            }
-        } else {
-            can_execute = false;
+    // Loads one module per compiled batch size, <stem>_b<N>.so next to the
+    // model path for batch sizes above 1, see GetBatchModelPath. The batch
+    // sizes whose module is missing are skipped.
+    explicit TVM_Blazeface(const fs::path& model_path,
+                           BlazefaceModel model = BlazefaceModel::Front,
+                           const std::vector<int>& batch_sizes = {1})
+        : model_type(model) {
+        switch (model) {
+            case BlazefaceModel::Front:
+                _configure<FrontModel>();
+                break;
+            case BlazefaceModel::ShortRange:
+                _configure<ShortRangeModel>();
+                break;
+            case BlazefaceModel::FullRange:
+                _configure<FullRangeModel>();
+                break;
         }
 
-        // Set the post processing options
-        _get_anchor_boxes();
+        nms_options.iou_threshold = min_supression_threshold;
+        nms_options.min_score = box_options.min_score_thresh;
+
+        for (auto batch_size : batch_sizes) {
+            _load_executor(mukham::GetBatchModelPath(model_path, batch_size),
+                           batch_size);
+        }
+        can_execute = !executors.empty();
     }
 
+    ~TVM_Blazeface();
+
+    TVM_Blazeface(const TVM_Blazeface&) = delete;
+    TVM_Blazeface& operator=(const TVM_Blazeface&) = delete;
+
+    // DetectFace, DetectFaces and DetectFaceTiled are thread safe, every
+    // call leases its own executor of the model
     std::vector<Detection> DetectFace(const cv::Mat& input_image);
 
+    // Asynchronous detection over a ring of nb_buffers executors, each with
+    // its own input and output tensors. SubmitFrame letterboxes the frame
+    // into the next free buffer and queues its inference on a runner
+    // thread, CompleteFrame waits for the oldest submitted frame and
+    // decodes it. The caller preprocesses frame N+1 and decodes frame N-1
+    // while frame N runs:
+    //
+    //   detector.SubmitFrame(frames[0]);
+    //   for (size_t i = 1; i < frames.size(); ++i) {
+    //       detector.SubmitFrame(frames[i]);
+    //       detector.CompleteFrame(detections[i - 1]);
+    //   }
+    //   detector.CompleteFrame(detections.back());
+    //
+    // The buffers are loaded by the first call. SubmitFrame fails when all
+    // the buffers are in flight, CompleteFrame when none is. Unlike the
+    // synchronous calls, these are for a single caller.
+    bool EnableAsync(size_t nb_buffers = 2);
+    bool SubmitFrame(const cv::Mat& input_image);
+    bool CompleteFrame(std::vector<Detection>& detections);
+
+    size_t GetFramesInFlight() const { return frames_in_flight; }
+
+    // Detections of every frame, in frame coordinates. The frames run
+    // through the compiled batches in as few inferences as possible.
+    std::vector<DetectionsVec> DetectFaces(
+        const std::vector<cv::Mat>& input_images);
+
+    // Runs the tiles of the frame as one batch and merges the detections
+    // found on both sides of a seam with the weighted NMS
+    std::vector<Detection> DetectFaceTiled(const cv::Mat& input_image,
+                                           const TileOptions& options);
+
     bool CanExecute() const { return can_execute; }
 
+    BlazefaceModel GetModel() const { return model_type; }
+
+    std::vector<int> GetBatchSizes() const;
+
    private:
-    void _get_anchor_boxes();
+    // Buffers of the weighted NMS, reused from call to call
+    struct NmsScratch {
+        mukham::NmsEngine engine;
+        std::vector<cv::Rect2d> boxes;
+        std::vector<double> scores;
+        std::vector<mukham::WeightedBox> weighted_boxes;
+    };
 
-    void _make_indexed_scores(const DetectionsVec& detections,
-                              IndexedScoresVec& idx_scores);
+    // Per-call state of an executor, leased with it
+    struct CallState {
+        int batch_size = 1;
+        tr::NDArray input_tensor;
+        // The model normalises the image bytes in its graph
+        bool uint8_input = false;
 
-    void _decode_boxes(std::unique_ptr<float[]> raw_boxes,
-                       std::unique_ptr<float[]> raw_scores,
-                       std::vector<Detection>& detections);
+        std::vector<cv::Point> frame_pads;
+        std::vector<cv::Size> frame_sizes;
 
-    void _nms(const std::vector<std::pair<double, cv::Rect2d>> detections,
-              std::vector<cv::Rect2d>& output);
+        // Host copies of the input and outputs, only used for non-host
+        // devices
+        std::vector<float> host_input;
+        std::vector<uint8_t> host_input_bytes;
+        std::vector<float> host_boxes;
+        std::vector<float> host_scores;
 
-    void _weighted_nms(const std::vector<Detection> detections,
-                       std::vector<Detection>& output);
+        NmsScratch nms;
+    };
+    using ExecutorPool = mukham::TvmExecutorPool<CallState>;
+    using Lease = ExecutorPool::Lease;
+    using Slot = ExecutorPool::Slot;
 
-    double _overlap_similarity(const cv::Rect2d& box1, const cv::Rect2d& box2);
+    // The executors of one compiled batch size
+    struct BatchExecutors {
+        int batch_size;
+        std::unique_ptr<ExecutorPool> pool;
+    };
 
-    cv::Rect2d _get_intesection(const cv::Rect2d& box1, const cv::Rect2d& box2);
+    template <typename Model>
+    void _configure() {
+        anchor_options = Model::anchor_options;
+        box_options = Model::box_options;
+        input_name = Model::input_name;
+        min_supression_threshold = Model::min_suppression_threshold;
+    }
 
-    int input_width = 128;
-    int input_height = 128;
-    int num_boxes = 896;
-    int batch_size = 1;
-    double min_supression_threshold = 0.3;
+    // Binds a new executor of the model, sharing its weights, to its state
+    bool _prepare_executor(int batch_size, mukham::TvmExecutor& executor,
+                           CallState& state);
+    bool _load_executor(const fs::path& module_path, int batch_size);
 
-    tr::Module gmod;
-    tr::PackedFunc set_input;
-    tr::PackedFunc get_output;
-    tr::PackedFunc run;
+    // Letterboxes the images into the batch, runs it once and decodes every
+    // slice of the outputs into the detections of its frame
+    void _run_batch(Slot& slot, const cv::Mat* images, size_t nb_images,
+                    DetectionsVec* detections);
 
-    tr::NDArray input_tensor;
-    tr::NDArray output_tensor_1;
-    tr::NDArray output_tensor_2;
+    // The two halves of _run_batch around the inference, pads[i] receives
+    // the letterbox padding of images[i]
+    void _fill_batch(CallState& state, const cv::Mat* images,
+                     size_t nb_images, cv::Point* pads);
+    template <typename T>
+    void _fill_slots(CallState& state, const cv::Mat* images,
+                     size_t nb_images, cv::Point* pads,
+                     std::vector<T>& host_buffer);
+    void _decode_batch(const mukham::TvmExecutor& executor, CallState& state,
+                       const cv::Size* frame_sizes, const cv::Point* pads,
+                       size_t nb_images, DetectionsVec* detections);
+
+    // Runs the inferences of the submitted buffers in order
+    void _async_loop();
+
+    void _decode_boxes(NmsScratch& nms, const float* raw_boxes,
+                       const float* raw_scores,
+                       std::vector<Detection>& detections);
+
+    void _nms(NmsScratch& nms,
+              const std::vector<std::pair<double, cv::Rect2d>>& detections,
+              std::vector<cv::Rect2d>& output);
+
+    void _weighted_nms(NmsScratch& nms, const DetectionsVec& detections,
+                       DetectionsVec& output);
+
+    BlazefaceModel model_type;
+    const char* input_name;
+    double min_supression_threshold = 0.3;
+    mukham::NmsOptions nms_options;
+
+    // Sorted by batch size, declared before the buffers so that their
+    // leases end first
+    std::vector<BatchExecutors> executors;
 
     SSDOptions anchor_options;
-    std::vector<std::pair<double, double>> anchors;
 
     TensorToBoxesOptions box_options;
-    bool can_execute;
+    bool can_execute = false;
+
+    // A buffer is written by the caller until it is submitted, then owned
+    // by the runner thread until its inference is done
+    struct AsyncBuffer {
+        Lease lease;
+        cv::Size frame_size;
+        cv::Point pad;
+        bool done = false;
+        bool failed = false;
+    };
+    std::vector<AsyncBuffer> async_buffers;
+    size_t next_submit = 0;
+    size_t next_complete = 0;
+    size_t frames_in_flight = 0;
+
+    std::mutex async_mutex;
+    std::condition_variable async_cond;
+    std::deque<size_t> queued_buffers;
+    bool stop_async = false;
+    std::thread async_runner;
 };
 }  // namespace tvm_blazeface
@@ -1,68 +1,109 @@
 
 #include "tvm_deeplab_segmentation.h"
 
+#include "fused_preprocess.h"
 #include "spdlog/spdlog.h"
+#include "tvm_tensor_view.h"
 
 namespace mukham {
 DeeplabSegmentationModel::DeeplabSegmentationModel() {
     const fs::path model_path{"./lite-model_deeplabv3_1_metadata_2.so"};
-    model_loaded = fs::exists(model_path);
+    //@todo: Add option to choose the device type
+    auto model = TvmModel::Load(model_path);
+    model_loaded = model != nullptr;
     if (model_loaded) {
-        try {
-            tr::Module mod_factory =
-                tr::Module::LoadFromFile(model_path.string());
-            DLDevice dev{kDLCPU,
-                         0};  //@todo: Add option to choose the device type
-            gmod = mod_factory.GetFunction("default")(dev);
-            set_input = gmod.GetFunction("set_input");
-            get_output = gmod.GetFunction("get_output");
-            run = gmod.GetFunction("run");
-
-            input_tensor = tr::NDArray::Empty({1, 257, 257, 3},
-                                              DLDataType{kDLFloat, 32, 1}, dev);
-            output_tensor = tr::NDArray::Empty(
-                {1, 257, 257, 21}, DLDataType{kDLFloat, 32, 1}, dev);
-        } catch (...) {
+        executors = std::make_unique<ExecutorPool>(
+            model, [](TvmExecutor& executor, CallState& state) {
+                // The preprocessing writes into the executor's own input
+                state.input_tensor = executor.GetInput("sub_7");
+                state.uint8_input = HasUint8Elements(state.input_tensor);
+                return true;
+            });
+        // The first executor is created up front, it stays in the pool for
+        // the first call
+        model_loaded = (bool)executors->Acquire();
+        if (!model_loaded)
             spdlog::error("Failed to load the deeplab v3 model");
-            model_loaded = false;
-        }
     }
 }
 
 void DeeplabSegmentationModel::Segment(const cv::Mat& input_image,
                                        cv::Mat& output_image) {
-    cv::Mat preprocessed_image;
+    if (!model_loaded) return;
+
+    // Held until the output view has been read
+    auto lease = executors->Acquire();
+    if (!lease) return;
+
     cv::Mat model_output;
 
-    _preprocess(input_image, preprocessed_image);
-    _infer(preprocessed_image, model_output);
+    _preprocess(lease->state, input_image);
+    _infer(*lease, model_output);
     _postprocess(model_output, output_image,
                  cv::Size(input_image.cols, input_image.rows));
 }
 
-void DeeplabSegmentationModel::_preprocess(const cv::Mat& input,
-                                           cv::Mat& output) {
-    cv::Mat scaled_image;
-    auto output_size = cv::Size(257, 257);
-    cv::resize(input, scaled_image, output_size, cv::INTER_AREA);
-    const double max_val = 1.0;
-    const double min_val = -1.0;
-    scaled_image.convertTo(output, CV_32FC3, (max_val - min_val) / 255.0,
-                           min_val);
+void DeeplabSegmentationModel::_preprocess(CallState& state,
+                                           const cv::Mat& input) {
+    const auto input_size = cv::Size(257, 257);
+    const size_t nb_values = input_size.area() * 3;
+
+    if (state.uint8_input) {
+        _preprocess_bytes(state, input);
+        return;
+    }
+
+    auto input_data = HostData<float>(state.input_tensor);
+    if (!input_data) {
+        state.host_input.resize(nb_values);
+        input_data = state.host_input.data();
+    }
+
+    int padx, pady;
+    if (!ResizeNormalizeInto(input, input_size, -1.0f, 1.0f, false,
+                             input_data, padx, pady)) {
+        cv::Mat scaled_image;
+        cv::resize(input, scaled_image, input_size, cv::INTER_AREA);
+        cv::Mat preprocessed_image(input_size, CV_32FC3, input_data);
+        scaled_image.convertTo(preprocessed_image, CV_32FC3, 2.0 / 255.0,
+                               -1.0);
+    }
+    if (input_data == state.host_input.data()) {
+        state.input_tensor.CopyFromBytes(input_data,
+                                         nb_values * sizeof(float));
+    }
 }
 
-void DeeplabSegmentationModel::_infer(const cv::Mat& input, cv::Mat& output) {
-    auto image_size =
-        input.rows * input.cols * input.channels() * sizeof(float);
-    input_tensor.CopyFromBytes(input.data, image_size);
-    set_input("sub_7", input_tensor);
-    run();
-    get_output(0, output_tensor);
-
-    constexpr auto output_tensor_size = 257 * 257 * 21;
-    std::array<float, output_tensor_size> output_arr;
-    output_tensor.CopyToBytes(output_arr.data(),
-                              output_tensor_size * sizeof(float));
+void DeeplabSegmentationModel::_preprocess_bytes(CallState& state,
+                                                 const cv::Mat& input) {
+    const auto input_size = cv::Size(257, 257);
+    const size_t nb_values = input_size.area() * 3;
+
+    auto input_data = HostData<uint8_t>(state.input_tensor);
+    if (!input_data) {
+        state.host_input_bytes.resize(nb_values);
+        input_data = state.host_input_bytes.data();
+    }
+
+    int padx, pady;
+    if (!ResizeInto(input, input_size, false, input_data, padx, pady)) {
+        cv::Mat scaled_image;
+        cv::resize(input, scaled_image, input_size, cv::INTER_AREA);
+        cv::Mat preprocessed_image(input_size, CV_8UC3, input_data);
+        scaled_image.convertTo(preprocessed_image, CV_8UC3);
+    }
+    if (input_data == state.host_input_bytes.data()) {
+        state.input_tensor.CopyFromBytes(input_data, nb_values);
+    }
+}
+
+void DeeplabSegmentationModel::_infer(Slot& slot, cv::Mat& output) {
+    slot.executor.Run();
+
+    // 257x257 map of the 21 class scores, read in place
+    auto scores = slot.executor.Output<float>(0, slot.state.host_output);
+    output = cv::Mat(257, 257, CV_32FC(21),
+                     const_cast<float*>(scores.data()));
 }
 
 void DeeplabSegmentationModel::_postprocess(const cv::Mat& input,
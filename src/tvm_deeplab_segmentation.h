@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <vector>
 
 #include "opencv2/core.hpp"
 #include "opencv2/core/matx.hpp"
@@ -8,6 +11,7 @@
 #include "tvm/runtime/module.h"
 #include "tvm/runtime/ndarray.h"
 #include "tvm/runtime/packed_func.h"
+#include "tvm_model.h"
 
 namespace mukham {
 
@@ -19,22 +23,37 @@ using Vec21f = cv::Vec<float, 21>;
 class DeeplabSegmentationModel {
    public:
     DeeplabSegmentationModel();
+    bool CanExecute() const { return model_loaded; }
+    // Thread safe, every call leases its own executor of the model
     void Segment(const cv::Mat& input_image, cv::Mat& output_image);
 
    private:
-    void _preprocess(const cv::Mat& input, cv::Mat& output);
+    // Per-call state of an executor, leased with it
+    struct CallState {
+        tr::NDArray input_tensor;
+        bool uint8_input = false;
+
+        // Host copies of the input and output, only used for non-host
+        // devices
+        std::vector<float> host_input;
+        std::vector<uint8_t> host_input_bytes;
+        std::vector<float> host_output;
+    };
+    using ExecutorPool = TvmExecutorPool<CallState>;
+    using Slot = ExecutorPool::Slot;
+
+    // Writes the resized and normalised image into the model input
+    void _preprocess(CallState& state, const cv::Mat& input);
+    // Only resizes it, for a model that normalises the bytes in its graph
+    void _preprocess_bytes(CallState& state, const cv::Mat& input);
     void _postprocess(const cv::Mat& input, cv::Mat& output,
                       const cv::Size& output_size);
-    void _infer(const cv::Mat& input, cv::Mat& output);
+    // output is a view over the model output, valid until the next run of
+    // the executor
+    void _infer(Slot& slot, cv::Mat& output);
 
     bool model_loaded;
 
-    tr::Module gmod;
-    tr::PackedFunc set_input;
-    tr::PackedFunc get_output;
-    tr::PackedFunc run;
-
-    tr::NDArray input_tensor;
-    tr::NDArray output_tensor;
+    std::unique_ptr<ExecutorPool> executors;
 };
 }  // namespace mukham
@@ -1,47 +1,176 @@
 
 #include "tvm_facemesh.h"
 
-#include <memory>
+#include <algorithm>
+#include <cstring>
 #include <opencv2/core.hpp>
 #include <opencv2/core/mat.hpp>
-#include <opencv2/dnn/dnn.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "fused_preprocess.h"
 #include "spdlog/spdlog.h"
 
 namespace tvm_facemesh {
 
-bool TVM_Facemesh::Detect(const cv::Mat& input, TVM_FacemeshResult& result) {
-    if (!can_execute) return false;
+bool TVM_Facemesh::_load_executor(const fs::path& model_path,
+                                  int batch_size) {
+    try {
+        if (batch_size < 1) return false;
+        if (!fs::exists(model_path)) {
+            // The batched modules are optional, most setups only compile
+            // the batch size 1
+            if (batch_size == 1)
+                spdlog::error("Facemesh model {} not found",
+                              model_path.string());
+            else
+                spdlog::debug("No Facemesh module for batch size {}: {}",
+                              batch_size, model_path.string());
+            return false;
+        }
+        spdlog::info("Model: {} (batch size {})", model_path.string(),
+                     batch_size);
+
+        //@todo: Add option to choose the device type
+        auto model = mukham::TvmModel::Load(model_path);
+        if (!model) return false;
+
+        BatchExecutors batch{batch_size, nullptr};
+        batch.pool = std::make_unique<ExecutorPool>(
+            model,
+            [batch_size](mukham::TvmExecutor& executor, CallState& state) {
+                state.batch_size = batch_size;
+                // set_input copies its argument, so the crops are written
+                // straight into the executor's own input storage instead
+                state.input_tensor = executor.GetInput("input_1");
+                state.uint8_input =
+                    mukham::HasUint8Elements(state.input_tensor);
+                return true;
+            });
+        // The first executor is created up front, it stays in the pool for
+        // the first call
+        if (!batch.pool->Acquire()) {
+            spdlog::error("Failed to create FaceMesh model object");
+            return false;
+        }
 
-    // preprocessing
-    cv::Mat scaled_image, preprocessed_image;
-    cv::resize(input, scaled_image, cv::Size(input_width, input_height));
-    scaled_image.convertTo(preprocessed_image, CV_32FC3, 1.0 / 255.0);
+        auto position = std::find_if(
+            executors.begin(), executors.end(), [&](const BatchExecutors& e) {
+                return e.batch_size >= batch_size;
+            });
+        executors.insert(position, std::move(batch));
+    } catch (...) {
+        spdlog::error("Failed to create FaceMesh model object");
+        return false;
+    }
+    return true;
+}
 
-    auto image_size = input_width * input_height * channels * sizeof(float);
-    input_tensor.CopyFromBytes(preprocessed_image.data, image_size);
-    set_input("input_1", input_tensor);
+std::vector<int> TVM_Facemesh::GetBatchSizes() const {
+    std::vector<int> batch_sizes;
+    for (const auto& executor : executors) {
+        batch_sizes.push_back(executor.batch_size);
+    }
+    return batch_sizes;
+}
+
+void TVM_Facemesh::_fill_slot(CallState& state, float* slot_data,
+                              const cv::Mat& image) {
+    const auto input_size = cv::Size(input_width, input_height);
+    int padx, pady;
+    if (mukham::ResizeNormalizeInto(image, input_size, 0.0f, 1.0f, false,
+                                    slot_data, padx, pady))
+        return;
+
+    // Images other than CV_8UC3 take the generic OpenCV path. convertTo
+    // keeps the preallocated header, so this still writes in place.
+    cv::resize(image, state.scaled_image, input_size);
+    cv::Mat slot_image(input_height, input_width, CV_32FC3, slot_data);
+    state.scaled_image.convertTo(slot_image, CV_32FC3, 1.0 / 255.0);
+}
+
+void TVM_Facemesh::_fill_slot(CallState& state, uint8_t* slot_data,
+                              const cv::Mat& image) {
+    const auto input_size = cv::Size(input_width, input_height);
+    int padx, pady;
+    if (mukham::ResizeInto(image, input_size, false, slot_data, padx, pady))
+        return;
+
+    cv::resize(image, state.scaled_image, input_size);
+    cv::Mat slot_image(input_height, input_width, CV_8UC3, slot_data);
+    state.scaled_image.convertTo(slot_image, CV_8UC3);
+}
 
-    run();
+template <typename T>
+void TVM_Facemesh::_fill_batch(CallState& state, const cv::Mat* images,
+                               size_t nb_images,
+                               std::vector<T>& host_buffer) {
+    const size_t slot_size = input_width * input_height * channels;
+    const size_t input_size = state.batch_size * slot_size;
+
+    // On the CPU the crops are written straight into the input tensor, other
+    // devices go through a host staging buffer that is uploaded once
+    auto input_data = mukham::HostData<T>(state.input_tensor);
+    if (!input_data) {
+        host_buffer.resize(input_size);
+        input_data = host_buffer.data();
+    }
 
-    get_output(0, output_tensor_1);
-    get_output(1, output_tensor_2);
+    for (size_t idx = 0; idx < nb_images; ++idx) {
+        _fill_slot(state, input_data + idx * slot_size, images[idx]);
+    }
 
-    auto landmarks_tensor = std::make_unique<float[]>(nr_landmarks);
-    auto face_confidence = std::make_unique<float>(1);
-    output_tensor_1.CopyToBytes(landmarks_tensor.get(),
-                                nr_landmarks * sizeof(float));
-    output_tensor_2.CopyToBytes(face_confidence.get(), sizeof(float));
+    // Zero the padding of a partial batch so it does not carry a stale face
+    const size_t nb_padding = state.batch_size - nb_images;
+    if (nb_padding > 0) {
+        std::memset(input_data + nb_images * slot_size, 0,
+                    nb_padding * slot_size * sizeof(T));
+    }
+    if (input_data == host_buffer.data()) {
+        state.input_tensor.CopyFromBytes(input_data, input_size * sizeof(T));
+    }
+}
 
-    result.face_score = *face_confidence;
-    result.has_face = (*face_confidence) > 10;
-    for (int idx = 0; idx < nr_landmarks; idx += 3) {
-        result.mesh.push_back(
-            cv::Point2d(landmarks_tensor[idx] * input.cols / input_width,
-                        landmarks_tensor[idx + 1] * input.rows / input_height));
+void TVM_Facemesh::_run_batch(Slot& slot, const cv::Mat* images,
+                              size_t nb_images, TVM_FacemeshResult* results) {
+    auto& state = slot.state;
+    // A uint8 input takes the resized bytes, a quarter of the float data
+    if (state.uint8_input)
+        _fill_batch(state, images, nb_images, state.staging_bytes);
+    else
+        _fill_batch(state, images, nb_images, state.staging_buffer);
+
+    slot.executor.Run();
+
+    // Read the outputs in place from the executor's storage
+    tr::NDArray landmarks_tensor = slot.executor.GetOutput(0);
+    tr::NDArray scores_tensor = slot.executor.GetOutput(1);
+    mukham::TensorView<float> landmarks(landmarks_tensor,
+                                        state.landmarks_buffer);
+    mukham::TensorView<float> scores(scores_tensor, state.scores_buffer);
+
+    for (size_t batch_idx = 0; batch_idx < nb_images; ++batch_idx) {
+        auto& result = results[batch_idx];
+        const auto& image = images[batch_idx];
+        const auto* positions = landmarks.data() + batch_idx * nr_landmarks;
+
+        result.face_score = scores[batch_idx];
+        result.has_face = scores[batch_idx] > 10;
+        result.mesh.clear();
+        result.mesh.reserve(nr_landmarks / 3);
+        for (int idx = 0; idx < nr_landmarks; idx += 3) {
+            result.mesh.push_back(
+                cv::Point2f(positions[idx] * image.cols / input_width,
+                            positions[idx + 1] * image.rows / input_height));
+        }
     }
+}
 
+bool TVM_Facemesh::Detect(const cv::Mat& input, TVM_FacemeshResult& result) {
+    if (!can_execute) return false;
+
+    auto lease = mukham::SelectExecutor(executors, 1).pool->Acquire();
+    if (!lease) return false;
+    _run_batch(*lease, &input, 1, &result);
     return true;
 }
 
@@ -52,56 +181,21 @@ bool TVM_Facemesh::Detect(
         return false;
     }
 
-    // Preprocessing
-    auto single_image_size =
-        input_width * input_height * channels * sizeof(float);
-    size_t batch_image_size = single_image_size * _batch_size;
-    float* input_data = new float[batch_image_size];
-
-    auto dest_data_ptr = input_data;
-
-    std::vector<cv::Mat> batch_images;
-    for (auto& image : input) {
-        cv::Mat scaled_image, preprocessed_image;
-        cv::resize(image, scaled_image, cv::Size(input_width, input_height));
-        scaled_image.convertTo(preprocessed_image, CV_32FC4, 1.0 / 255.0, 0);
-        batch_images.push_back(preprocessed_image);
-    }
-
-    cv::Mat image_batch;
-    cv::vconcat(batch_images, image_batch);
-    input_tensor.CopyFromBytes(image_batch.data, batch_image_size);
-    set_input("input_1", input_tensor);
-
-    // Execute the model
-    run();
-
-    // Get the output tensors
-    get_output(0, output_tensor_1);
-    get_output(1, output_tensor_2);
-
-    // Postprocessing
-    auto positions = std::make_unique<float[]>(nr_positions);
-    auto face_flag = std::make_unique<float[]>(_batch_size * 1);
-    output_tensor_1.CopyToBytes(positions.get(), nr_positions * sizeof(float));
-    output_tensor_2.CopyToBytes(face_flag.get(), _batch_size * sizeof(float));
-
-    for (int batch_idx = 0; batch_idx < _batch_size; ++batch_idx) {
-        tvm_facemesh::TVM_FacemeshResult result_item;
-
-        auto start_idx = batch_idx * nr_landmarks;
-        auto stop_idx = start_idx + nr_landmarks;
-        for (int idx = start_idx; idx < stop_idx; idx += 3) {
-            float x = positions[idx] * input[batch_idx].cols / input_width;
-            float y = positions[idx + 1] * input[batch_idx].rows / input_height;
-            result_item.mesh.push_back(cv::Point(x, y));
-        }
-        result_item.has_face = face_flag[batch_idx] > 10.0;
-        result_item.face_score = face_flag[batch_idx];
-        result.push_back(result_item);
+    result.resize(input.size());
+
+    // Inputs larger than the biggest compiled batch run in several chunks,
+    // each on the smallest batch that holds it
+    size_t start = 0;
+    while (start < input.size()) {
+        auto& batch = mukham::SelectExecutor(executors, input.size() - start);
+        auto lease = batch.pool->Acquire();
+        if (!lease) return false;
+        auto nb_images =
+            (std::min)((size_t)batch.batch_size, input.size() - start);
+        _run_batch(*lease, &input[start], nb_images, &result[start]);
+        start += nb_images;
     }
 
-    delete[] input_data;
     return true;
 }
 }  // namespace tvm_facemesh
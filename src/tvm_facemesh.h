@@ -2,6 +2,8 @@
 
 #include <chrono>
 #include <filesystem>
+#include <memory>
+#include <vector>
 
 #include "dlpack/dlpack.h"
 #include "opencv2/core.hpp"
@@ -10,6 +12,9 @@
 #include "tvm/runtime/module.h"
 #include "tvm/runtime/ndarray.h"
 #include "tvm/runtime/packed_func.h"
+#include "tvm_batching.h"
+#include "tvm_model.h"
+#include "tvm_tensor_view.h"
 
 namespace tvm_facemesh {
 namespace fs = std::filesystem;
@@ -24,59 +29,78 @@ struct TVM_FacemeshResult {
 class TVM_Facemesh {
    public:
     TVM_Facemesh(const fs::path& model_path, int batch_size = 1) {
-        can_execute = true;
-        _batch_size = batch_size;
-        nr_positions = _batch_size * nr_landmarks;
-        try {
-            spdlog::info("Model: {}", model_path.string());
-            if (!fs::exists(model_path)) {
-                spdlog::error("Facemesh model exists: {}", fs::exists(model_path));
-                can_execute = false;
-            } else {
-                tr::Module mod_factory =
-                    tr::Module::LoadFromFile(model_path.string());
-                //@todo: Add option to choose the device type
-                DLDevice dev{kDLCPU, 0};
-                gmod = mod_factory.GetFunction("default")(dev);
-                set_input = gmod.GetFunction("set_input");
-                get_output = gmod.GetFunction("get_output");
-                run = gmod.GetFunction("run");
-
-                input_tensor = tr::NDArray::Empty(
-                    {batch_size, input_width, input_height, 3},
-                    DLDataType{kDLFloat, 32, 1}, dev);
-                output_tensor_1 = tr::NDArray::Empty(
-                    {batch_size, 1, 1, 1404}, DLDataType{kDLFloat, 32, 1}, dev);
-                output_tensor_2 = tr::NDArray::Empty(
-                    {batch_size, 1, 1, 1}, DLDataType{kDLFloat, 32, 1}, dev);
-            }
-        } catch (...) {
-            spdlog::error("Failed to create FaceMesh model object");
-            can_execute = false;
+        can_execute = _load_executor(model_path, batch_size);
+    }
+
+    // Loads one module per compiled batch size, face_landmark_b<N>.so next
+    // to the model path for batch sizes above 1, see GetBatchModelPath. The
+    // batch sizes whose module is missing are skipped.
+    TVM_Facemesh(const fs::path& model_path,
+                 const std::vector<int>& batch_sizes) {
+        for (auto batch_size : batch_sizes) {
+            _load_executor(mukham::GetBatchModelPath(model_path, batch_size),
+                           batch_size);
         }
+        can_execute = !executors.empty();
     }
 
+    // Thread safe, every call leases its own executor of the model
     bool Detect(const std::vector<cv::Mat>& frame,
                 std::vector<TVM_FacemeshResult>& result);
 
     bool Detect(const cv::Mat& frame, TVM_FacemeshResult& result);
 
+    bool CanExecute() const { return can_execute; }
+
+    std::vector<int> GetBatchSizes() const;
+
    private:
-    bool can_execute;
-    int _batch_size = 1;
+    // Per-call state of an executor, leased with it
+    struct CallState {
+        int batch_size = 1;
+        tr::NDArray input_tensor;
+        // The model normalises the image bytes in its graph
+        bool uint8_input = false;
+
+        cv::Mat scaled_image;
+        std::vector<float> staging_buffer;
+        std::vector<uint8_t> staging_bytes;
+        // Host copies of the outputs, only used for non-host devices
+        std::vector<float> landmarks_buffer;
+        std::vector<float> scores_buffer;
+    };
+    using ExecutorPool = mukham::TvmExecutorPool<CallState>;
+    using Slot = ExecutorPool::Slot;
+
+    // The executors of one compiled batch size
+    struct BatchExecutors {
+        int batch_size;
+        std::unique_ptr<ExecutorPool> pool;
+    };
+
+    bool _load_executor(const fs::path& model_path, int batch_size);
+
+    // Resizes and normalises the images into the input of the executor
+    template <typename T>
+    void _fill_batch(CallState& state, const cv::Mat* images,
+                     size_t nb_images, std::vector<T>& host_buffer);
+
+    // Resizes and normalises the image into its slot of the batch, or only
+    // resizes it for a uint8 input
+    void _fill_slot(CallState& state, float* slot_data, const cv::Mat& image);
+    void _fill_slot(CallState& state, uint8_t* slot_data,
+                    const cv::Mat& image);
+
+    void _run_batch(Slot& slot, const cv::Mat* images, size_t nb_images,
+                    TVM_FacemeshResult* results);
+
+    bool can_execute = false;
     const int input_width = 192;
     const int input_height = 192;
     const int channels = 3;
     const int nr_landmarks = 1404;
-    int nr_positions = _batch_size * nr_landmarks;
-
-    tr::Module gmod;
-    tr::PackedFunc set_input;
-    tr::PackedFunc get_output;
-    tr::PackedFunc run;
 
-    tr::NDArray input_tensor;
-    tr::NDArray output_tensor_1;
-    tr::NDArray output_tensor_2;
+    // Sorted by batch size
+    std::vector<BatchExecutors> executors;
 };
 }  // namespace tvm_facemesh
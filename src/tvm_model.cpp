@@ -0,0 +1,190 @@
+#include "tvm_model.h"
+
+#include <map>
+#include <system_error>
+#include <tuple>
+#include <utility>
+
+#include "activation_arena.h"
+#include "spdlog/spdlog.h"
+#include "tvm/runtime/registry.h"
+
+namespace mukham {
+
+// Type of the factory module of the libraries built with the AOT executor
+static const std::string aot_factory_type = "AotExecutorFactory";
+
+TvmExecutor::TvmExecutor(tr::Module executor_module)
+    : module(std::move(executor_module)) {
+    run = module.GetFunction("run");
+    get_input = module.GetFunction("get_input");
+    get_output = module.GetFunction("get_output");
+}
+
+// Loaded modules by path and device, the entries expire with their last user
+using ModelKey = std::tuple<std::string, int, int>;
+static std::mutex loaded_models_mutex;
+static std::map<ModelKey, std::weak_ptr<TvmModel>> loaded_models;
+
+static void RemoveExpiredModels() {
+    for (auto entry = loaded_models.begin(); entry != loaded_models.end();) {
+        if (entry->second.expired())
+            entry = loaded_models.erase(entry);
+        else
+            ++entry;
+    }
+}
+
+std::shared_ptr<TvmModel> TvmModel::Load(const fs::path& module_path,
+                                         DLDevice device) {
+    if (!fs::exists(module_path)) return nullptr;
+
+    std::error_code error;
+    auto canonical_path = fs::weakly_canonical(module_path, error);
+    if (error) canonical_path = module_path;
+    const ModelKey key{canonical_path.string(), (int)device.device_type,
+                       device.device_id};
+
+    // Held while loading, so that two threads loading the same module do
+    // not both read it
+    std::lock_guard<std::mutex> lock(loaded_models_mutex);
+    RemoveExpiredModels();
+    if (auto model = loaded_models[key].lock()) return model;
+
+    std::shared_ptr<TvmModel> model(new TvmModel(module_path, device));
+    if (!model->_load()) {
+        loaded_models.erase(key);
+        return nullptr;
+    }
+    loaded_models[key] = model;
+    return model;
+}
+
+size_t TvmModel::NumLoadedModels() {
+    std::lock_guard<std::mutex> lock(loaded_models_mutex);
+    RemoveExpiredModels();
+    return loaded_models.size();
+}
+
+bool TvmModel::_load() {
+    try {
+        factory = tr::Module::LoadFromFile(module_path.string());
+    } catch (...) {
+        spdlog::error("Failed to load the TVM module {}",
+                      module_path.string());
+        return false;
+    }
+
+    // The parameters of an AOT module are constants of its library, its
+    // executors only allocate their activations
+    is_aot = std::string(factory->type_key()) == aot_factory_type;
+    if (is_aot) {
+        use_arena = ActivationArena::IsEnabled();
+        if (use_arena) return true;
+        try {
+            primary = TvmExecutor(factory.GetFunction("default")(device));
+        } catch (...) {
+            spdlog::error("Failed to load the TVM module {}",
+                          module_path.string());
+            return false;
+        }
+        return true;
+    }
+
+    // Executors created from the parameter free factory do not copy the
+    // weights, share_params only reads the parameter names from the blob
+    try {
+        auto save_params = tr::Registry::Get("runtime.SaveParams");
+        auto get_params = factory.GetFunction("get_graph_params");
+        auto remove_params = factory.GetFunction("remove_params");
+        if (save_params && get_params != nullptr &&
+            remove_params != nullptr) {
+            params = get_params();
+            params_blob = (*save_params)(params).operator std::string();
+            param_free_factory = remove_params();
+        }
+    } catch (...) {
+        param_free_factory = tr::Module();
+        params_blob.clear();
+    }
+
+    // The arena executors bind the parameters of the module, no executor
+    // owns them
+    use_arena = ActivationArena::IsEnabled() && param_free_factory.defined();
+    if (use_arena) return true;
+    params = tr::Map<tr::String, tr::NDArray>();
+
+    try {
+        primary = TvmExecutor(factory.GetFunction("default")(device));
+    } catch (...) {
+        spdlog::error("Failed to load the TVM module {}",
+                      module_path.string());
+        return false;
+    }
+    if (primary.module.GetFunction("share_params") == nullptr) {
+        param_free_factory = tr::Module();
+        params_blob.clear();
+    }
+    if (!param_free_factory.defined()) {
+        spdlog::warn("{}: the executors do not share their parameters",
+                     module_path.filename().string());
+    }
+    return true;
+}
+
+size_t TvmModel::NumExecutors() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return nb_executors;
+}
+
+TvmExecutor TvmModel::CreateExecutor() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (use_arena) return _create_arena_executor();
+    if (nb_executors == 0) {
+        nb_executors++;
+        return primary;
+    }
+
+    try {
+        if (param_free_factory.defined()) {
+            TvmExecutor executor(
+                param_free_factory.GetFunction("default")(device));
+            executor.module.GetFunction("share_params")(primary.module,
+                                                        params_blob);
+            nb_executors++;
+            return executor;
+        }
+
+        TvmExecutor executor(factory.GetFunction("default")(device));
+        nb_executors++;
+        return executor;
+    } catch (...) {
+        spdlog::error("Failed to create an executor of {}",
+                      module_path.string());
+        return TvmExecutor();
+    }
+}
+
+TvmExecutor TvmModel::_create_arena_executor() {
+    try {
+        tr::Module module;
+        {
+            ActivationArena::Scope scope;
+            auto& executor_factory = is_aot ? factory : param_free_factory;
+            module = executor_factory.GetFunction("default")(device);
+        }
+        // The parameters stay in the module, the storage the executor got
+        // for them in the arena is left unused
+        auto set_input_zero_copy = module.GetFunction("set_input_zero_copy");
+        for (const auto& param : params) {
+            set_input_zero_copy(param.first, param.second);
+        }
+        nb_executors++;
+        return TvmExecutor(module);
+    } catch (...) {
+        spdlog::error("Failed to create an arena executor of {}",
+                      module_path.string());
+        return TvmExecutor();
+    }
+}
+}  // namespace mukham
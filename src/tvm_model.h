@@ -0,0 +1,270 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dlpack/dlpack.h"
+#include "tvm/runtime/container/map.h"
+#include "tvm/runtime/module.h"
+#include "tvm/runtime/ndarray.h"
+#include "tvm/runtime/packed_func.h"
+#include "tvm_tensor_view.h"
+
+namespace mukham {
+namespace fs = std::filesystem;
+namespace tr = tvm::runtime;
+
+/**
+ * One graph executor instance of a TvmModel.
+ *
+ * The inputs are written in place through InputData, set_input would copy
+ * them, and the outputs are read in place through Output. Copies refer to
+ * the same instance. An executor is not thread safe, each thread runs its
+ * own, see TvmExecutorPool.
+ */
+class TvmExecutor {
+   public:
+    TvmExecutor() = default;
+
+    bool IsValid() const { return module.defined(); }
+
+    void Run() { run(); }
+
+    tr::NDArray GetInput(const std::string& name) const {
+        return get_input(name);
+    }
+    tr::NDArray GetOutput(int index) const { return get_output(index); }
+
+    // Writable host memory of an input, nullptr when the tensor lives on
+    // another device and has to be written with CopyFromBytes
+    template <typename T>
+    T* InputData(const std::string& name) const {
+        return HostData<T>(GetInput(name));
+    }
+
+    // The view is valid until the next Run
+    template <typename T>
+    TensorView<T> Output(int index, std::vector<T>& host_buffer) const {
+        return TensorView<T>(GetOutput(index), host_buffer);
+    }
+
+    const tr::Module& GetModule() const { return module; }
+
+   private:
+    friend class TvmModel;
+
+    explicit TvmExecutor(tr::Module executor_module);
+
+    tr::Module module;
+    tr::PackedFunc run;
+    tr::PackedFunc get_input;
+    tr::PackedFunc get_output;
+};
+
+/**
+ * A compiled TVM module, loaded once.
+ *
+ * The first executor gets the parameters of the module, the following ones
+ * are created without parameters and share those of the first executor
+ * through the graph executor's share_params, so that running a model on
+ * several threads does not duplicate its weights.
+ *
+ * A module built with the AOT executor has its parameters linked into its
+ * library as constants, its executors share them without share_params. Its
+ * executor has the same run, get_input and get_output functions, so the
+ * model wrappers take either kind of module.
+ *
+ * With the ActivationArena enabled, every executor is created without
+ * parameters in the arena and binds those of the module.
+ *
+ * Loading a module that is already loaded returns the same TvmModel, so the
+ * model wrappers of the landmark workers or of several streams share one
+ * copy of the weights and only allocate their own activations. The module
+ * is unloaded with its last user.
+ */
+class TvmModel {
+   public:
+    // nullptr when the module can not be loaded. Thread safe.
+    static std::shared_ptr<TvmModel> Load(const fs::path& module_path,
+                                          DLDevice device = {kDLCPU, 0});
+
+    // Modules currently loaded in the process
+    static size_t NumLoadedModels();
+
+    const fs::path& GetPath() const { return module_path; }
+
+    // Built with the AOT executor rather than the graph executor
+    bool IsAot() const { return is_aot; }
+
+    // Executors created so far, the first one included
+    size_t NumExecutors() const;
+
+    // An invalid executor on failure. Thread safe.
+    TvmExecutor CreateExecutor();
+
+   private:
+    TvmModel(const fs::path& module_path, DLDevice device)
+        : module_path(module_path), device(device) {}
+
+    bool _load();
+    TvmExecutor _create_arena_executor();
+
+    fs::path module_path;
+    DLDevice device;
+
+    mutable std::mutex mutex;
+    tr::Module factory;
+    bool is_aot = false;
+    // Factory without the parameters and serialised parameter names, empty
+    // when the runtime can not share parameters
+    tr::Module param_free_factory;
+    std::string params_blob;
+    // Executors draw their storage from the ActivationArena and bind the
+    // parameters of the module with set_input_zero_copy
+    bool use_arena = false;
+    tr::Map<tr::String, tr::NDArray> params;
+    // Owner of the shared parameters
+    TvmExecutor primary;
+    size_t nb_executors = 0;
+};
+
+/**
+ * Hands out the executors of a model to concurrent callers, each with the
+ * per-call State of the model wrapper: its input bindings, host buffers and
+ * scratch.
+ *
+ * Executors are created on demand, up to max_executors, and bound to a new
+ * state by prepare. They return to the pool with their state when their
+ * lease ends, so a thread that keeps calling the model keeps reusing a warm
+ * executor and its buffers. Acquire blocks while all the executors are
+ * leased.
+ */
+template <typename State>
+class TvmExecutorPool {
+   public:
+    struct Slot {
+        TvmExecutor executor;
+        State state;
+    };
+
+    // Binds a new executor to its state, false when it can not be used
+    using Prepare = std::function<bool(TvmExecutor&, State&)>;
+
+    class Lease {
+       public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept { *this = std::move(other); }
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                Release();
+                pool = other.pool;
+                slot = std::move(other.slot);
+                other.pool = nullptr;
+            }
+            return *this;
+        }
+        ~Lease() { Release(); }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        explicit operator bool() const { return pool != nullptr; }
+        Slot& operator*() { return *slot; }
+        Slot* operator->() { return slot.get(); }
+
+        void Release() {
+            if (!pool) return;
+            pool->_release(std::move(slot));
+            pool = nullptr;
+        }
+
+       private:
+        friend class TvmExecutorPool;
+        Lease(TvmExecutorPool* pool, std::unique_ptr<Slot> slot)
+            : pool(pool), slot(std::move(slot)) {}
+
+        TvmExecutorPool* pool = nullptr;
+        std::unique_ptr<Slot> slot;
+    };
+
+    // max_executors 0 creates one executor per concurrent caller
+    explicit TvmExecutorPool(std::shared_ptr<TvmModel> model,
+                             Prepare prepare = nullptr,
+                             size_t max_executors = 0)
+        : model(std::move(model)),
+          prepare(std::move(prepare)),
+          max_executors(max_executors) {}
+
+    // The leases must end before the pool
+    TvmExecutorPool(const TvmExecutorPool&) = delete;
+    TvmExecutorPool& operator=(const TvmExecutorPool&) = delete;
+
+    // An empty lease when no executor can be created. Thread safe.
+    Lease Acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (!idle_slots.empty()) {
+                auto slot = std::move(idle_slots.back());
+                idle_slots.pop_back();
+                return Lease(this, std::move(slot));
+            }
+            if (max_executors == 0 || nb_executors < max_executors) break;
+            executor_released.wait(lock);
+        }
+
+        // Created outside the lock, it loads the graph and allocates its
+        // storage
+        nb_executors++;
+        lock.unlock();
+        auto slot = std::make_unique<Slot>();
+        if (model) slot->executor = model->CreateExecutor();
+        bool ready = slot->executor.IsValid();
+        if (ready && prepare) {
+            try {
+                ready = prepare(slot->executor, slot->state);
+            } catch (...) {
+                ready = false;
+            }
+        }
+        if (!ready) {
+            lock.lock();
+            nb_executors--;
+            executor_released.notify_one();
+            return Lease();
+        }
+        return Lease(this, std::move(slot));
+    }
+
+    size_t NumExecutors() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return nb_executors;
+    }
+
+    const std::shared_ptr<TvmModel>& GetModel() const { return model; }
+
+   private:
+    void _release(std::unique_ptr<Slot> slot) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle_slots.push_back(std::move(slot));
+        }
+        executor_released.notify_one();
+    }
+
+    std::shared_ptr<TvmModel> model;
+    Prepare prepare;
+    size_t max_executors;
+
+    mutable std::mutex mutex;
+    std::condition_variable executor_released;
+    std::vector<std::unique_ptr<Slot>> idle_slots;
+    size_t nb_executors = 0;
+};
+}  // namespace mukham
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "dlpack/dlpack.h"
+#include "tvm/runtime/ndarray.h"
+
+namespace mukham {
+namespace tr = tvm::runtime;
+
+// True when the tensor memory can be dereferenced from the host
+inline bool IsHostAccessible(const tr::NDArray& tensor) {
+    const auto device_type = tensor->device.device_type;
+    return device_type == kDLCPU || device_type == kDLCUDAHost;
+}
+
+inline size_t NumElements(const tr::NDArray& tensor) {
+    size_t nb_elements = 1;
+    for (int dim = 0; dim < tensor->ndim; ++dim) {
+        nb_elements *= static_cast<size_t>(tensor->shape[dim]);
+    }
+    return nb_elements;
+}
+
+// True for the uint8 input of a model that normalises the image bytes in
+// its graph
+inline bool HasUint8Elements(const tr::NDArray& tensor) {
+    const auto& dtype = tensor->dtype;
+    return dtype.code == kDLUInt && dtype.bits == 8 && dtype.lanes == 1;
+}
+
+// Writable host pointer to the tensor elements, nullptr when the tensor is
+// not host accessible or not compact
+template <typename T>
+T* HostData(const tr::NDArray& tensor) {
+    if (!IsHostAccessible(tensor) || tensor->strides != nullptr) return nullptr;
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(tensor->data) +
+                                tensor->byte_offset);
+}
+
+/**
+ * Read-only typed view over the memory of a TVM tensor.
+ *
+ * Host tensors are read in place, so post-processing can work directly on
+ * the outputs of the graph executor. Tensors on another device, or with a
+ * non compact layout, are copied into the caller's host buffer, which is
+ * kept across frames so that the copy does not allocate either.
+ *
+ * The view is only valid as long as the tensor is not written to, that is
+ * until the next run of the executor that owns it.
+ */
+template <typename T>
+class TensorView {
+   public:
+    TensorView(const tr::NDArray& tensor, std::vector<T>& host_buffer)
+        : nb_elements(NumElements(tensor)) {
+        if (tensor->dtype.bits * tensor->dtype.lanes != sizeof(T) * 8) {
+            throw std::invalid_argument("Tensor element size mismatch");
+        }
+
+        elements = HostData<T>(tensor);
+        if (!elements) {
+            host_buffer.resize(nb_elements);
+            tensor.CopyToBytes(host_buffer.data(), nb_elements * sizeof(T));
+            elements = host_buffer.data();
+        }
+    }
+
+    const T* data() const { return elements; }
+    size_t size() const { return nb_elements; }
+    const T& operator[](size_t idx) const { return elements[idx]; }
+
+   private:
+    const T* elements;
+    size_t nb_elements;
+};
+}  // namespace mukham
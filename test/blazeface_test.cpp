@@ -1,9 +1,15 @@
 #include <gtest/gtest.h>
 
 #include <filesystem>
+#include <random>
+#include <vector>
 
+#include "fused_preprocess.h"
+#include "nms.h"
 #include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
 #include "tvm_blazeface.h"
+#include "tvm_model.h"
 
 namespace fs = std::filesystem;
 
@@ -13,6 +19,89 @@ TEST(BlazeFaceTest, TestCanExecute) {
     EXPECT_EQ(model.CanExecute(), false);
 }
 
+TEST(BlazeFaceTest, TestDetectFacesWithoutModel) {
+    auto model_path = fs::current_path() / "dummy.so";
+    tvm_blazeface::TVM_Blazeface model(
+        model_path, tvm_blazeface::BlazefaceModel::Front, {1, 4});
+    EXPECT_EQ(model.CanExecute(), false);
+    EXPECT_TRUE(model.GetBatchSizes().empty());
+
+    std::vector<cv::Mat> frames(3, cv::Mat(64, 48, CV_8UC3));
+    auto detections = model.DetectFaces(frames);
+    ASSERT_EQ(detections.size(), frames.size());
+    for (const auto& frame_detections : detections) {
+        EXPECT_TRUE(frame_detections.empty());
+    }
+}
+
+TEST(BlazeFaceTest, TestAsyncWithoutModel) {
+    auto model_path = fs::current_path() / "dummy.so";
+    tvm_blazeface::TVM_Blazeface model(model_path);
+    EXPECT_FALSE(model.EnableAsync(2));
+
+    std::vector<tvm_blazeface::Detection> detections;
+    EXPECT_FALSE(model.SubmitFrame(cv::Mat(64, 48, CV_8UC3)));
+    EXPECT_EQ(model.GetFramesInFlight(), 0);
+    EXPECT_FALSE(model.CompleteFrame(detections));
+    EXPECT_TRUE(detections.empty());
+}
+
+TEST(TvmModelTest, TestMissingModule) {
+    auto model_path = fs::current_path() / "dummy.so";
+    EXPECT_EQ(mukham::TvmModel::Load(model_path), nullptr);
+    EXPECT_FALSE(mukham::TvmExecutor().IsValid());
+
+    // Without an executor the state is never prepared nor leased
+    bool prepared = false;
+    mukham::TvmExecutorPool<std::vector<float>> pool(
+        nullptr,
+        [&](mukham::TvmExecutor&, std::vector<float>&) {
+            prepared = true;
+            return true;
+        },
+        2);
+    auto lease = pool.Acquire();
+    EXPECT_FALSE(lease);
+    EXPECT_FALSE(prepared);
+    EXPECT_EQ(pool.NumExecutors(), 0u);
+}
+
+TEST(BlazeFaceTest, TestBatchModelPath) {
+    auto model_path = fs::path("models") / "face_detection_front.so";
+    EXPECT_EQ(mukham::GetBatchModelPath(model_path, 1), model_path);
+    EXPECT_EQ(mukham::GetBatchModelPath(model_path, 4),
+              fs::path("models") / "face_detection_front_b4.so");
+}
+
+TEST(BlazeFaceTest, TestMakeTilesCoversFrame) {
+    tvm_blazeface::TileOptions options;
+    options.rows = 2;
+    options.cols = 3;
+    options.overlap = 0.25;
+    const cv::Size frame_size(3840, 2160);
+    auto tiles = tvm_blazeface::MakeTiles(frame_size, options);
+    ASSERT_EQ(tiles.size(), (size_t)options.NumTiles());
+
+    for (int row = 0; row < options.rows; ++row) {
+        for (int col = 0; col < options.cols; ++col) {
+            const auto& tile = tiles[row * options.cols + col];
+            EXPECT_EQ(tile.size(), tiles[0].size());
+            EXPECT_GE(tile.x, 0);
+            EXPECT_GE(tile.y, 0);
+            EXPECT_LE(tile.x + tile.width, frame_size.width);
+            EXPECT_LE(tile.y + tile.height, frame_size.height);
+            // Neighbours share about a quarter of a tile
+            if (col > 0) {
+                const auto& left = tiles[row * options.cols + col - 1];
+                EXPECT_NEAR(left.x + left.width - tile.x, 0.25 * tile.width,
+                            1.0);
+            }
+        }
+    }
+    EXPECT_EQ(tiles.back().x + tiles.back().width, frame_size.width);
+    EXPECT_EQ(tiles.back().y + tiles.back().height, frame_size.height);
+}
+
 TEST(BlazeFaceTest, TestNormalize) {
     cv::Mat image = cv::imread("face_detect.bmp");
     cv::Mat out_image;
@@ -30,3 +119,219 @@ TEST(BlazeFaceTest, TestNormalize) {
     EXPECT_FLOAT_EQ(maxval, 0.77254903);
     EXPECT_FLOAT_EQ(minval, -0.7882353);
 }
+
+TEST(BlazeFaceTest, TestFusedPreprocessMatchesReference) {
+    cv::Mat image = cv::imread("face_detect.bmp");
+    ASSERT_FALSE(image.empty());
+
+    const auto output_size = cv::Size(128, 128);
+    cv::Mat reference;
+    int ref_padx, ref_pady;
+    tvm_blazeface::PreprocessImage(image, output_size, -1.0, 1.0, reference,
+                                   ref_padx, ref_pady);
+
+    cv::Mat fused(output_size, CV_32FC3);
+    int padx, pady;
+    ASSERT_TRUE(mukham::ResizeNormalizeInto(image, output_size, -1.0f, 1.0f,
+                                            true, fused.ptr<float>(), padx,
+                                            pady));
+    EXPECT_EQ(padx, ref_padx);
+    EXPECT_EQ(pady, ref_pady);
+
+    // cv::resize rounds to 8 bits before the normalisation, the fused kernel
+    // does not
+    EXPECT_LE(cv::norm(fused, reference, cv::NORM_INF), 2.0 / 255.0 + 1e-6);
+}
+
+TEST(BlazeFaceTest, TestFusedResizeMatchesReference) {
+    // Wider than high so that the letterbox pads rows, no black pixels in
+    // the image itself
+    cv::Mat image(96, 160, CV_8UC3);
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> values(1, 255);
+    for (size_t idx = 0; idx < image.total() * 3; ++idx)
+        image.data[idx] = (uint8_t)values(rng);
+
+    const auto output_size = cv::Size(128, 128);
+    cv::Mat bytes(output_size, CV_8UC3);
+    int padx, pady;
+    ASSERT_TRUE(mukham::ResizeInto(image, output_size, true,
+                                   bytes.ptr<uint8_t>(), padx, pady));
+    EXPECT_EQ(padx, 0);
+    EXPECT_EQ(pady, 32);
+
+    cv::Mat padded, reference;
+    cv::copyMakeBorder(image, padded, pady, pady, padx, padx,
+                       cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0));
+    cv::resize(padded, reference, output_size, cv::INTER_AREA);
+
+    // cv::resize rounds its fixed point sums, the fused kernel its float sums
+    EXPECT_LE(cv::norm(bytes, reference, cv::NORM_INF), 1.0);
+
+    // The 32 padded rows cover the first and last 25.6 output rows: those
+    // are black, the rows of the image are not
+    const int border_rows = 25;
+    EXPECT_EQ(cv::countNonZero(bytes.rowRange(0, border_rows).reshape(1)),
+              0);
+    EXPECT_EQ(cv::countNonZero(
+                  bytes.rowRange(output_size.height - border_rows,
+                                 output_size.height)
+                      .reshape(1)),
+              0);
+    const cv::Mat inside =
+        bytes.rowRange(border_rows + 1, output_size.height - border_rows - 1)
+            .reshape(1);
+    EXPECT_EQ(cv::countNonZero(inside), (int)inside.total());
+}
+
+struct KnownAnchor {
+    size_t index;
+    float x_center;
+    float y_center;
+};
+
+// The anchors of a model against values worked out by hand from its layout,
+// both for the compile time table and the runtime one
+template <typename Model>
+void ExpectKnownAnchors(size_t nb_anchors,
+                        const std::vector<KnownAnchor>& known) {
+    const auto& anchors = tvm_blazeface::ModelAnchors<Model>::anchors;
+    tvm_blazeface::AnchorTable runtime_anchors;
+    tvm_blazeface::GenerateAnchors(Model::anchor_options, runtime_anchors);
+
+    ASSERT_EQ(anchors.size(), nb_anchors);
+    ASSERT_EQ(runtime_anchors.size(), nb_anchors);
+    for (const auto& anchor : known) {
+        EXPECT_FLOAT_EQ(anchors.x_center[anchor.index], anchor.x_center);
+        EXPECT_FLOAT_EQ(anchors.y_center[anchor.index], anchor.y_center);
+        EXPECT_FLOAT_EQ(runtime_anchors.x_center[anchor.index],
+                        anchor.x_center);
+        EXPECT_FLOAT_EQ(runtime_anchors.y_center[anchor.index],
+                        anchor.y_center);
+    }
+}
+
+TEST(BlazeFaceTest, TestCompileTimeAnchors) {
+    // 128x128 input: a 16x16 map with 2 anchors per cell for stride 8, then
+    // the three stride 16 layers merged into an 8x8 map with 6 per cell
+    const std::vector<KnownAnchor> front = {
+        {0, 0.5f / 16, 0.5f / 16},     {1, 0.5f / 16, 0.5f / 16},
+        {2, 1.5f / 16, 0.5f / 16},     {32, 0.5f / 16, 1.5f / 16},
+        {511, 15.5f / 16, 15.5f / 16}, {512, 0.5f / 8, 0.5f / 8},
+        {518, 1.5f / 8, 0.5f / 8},     {895, 7.5f / 8, 7.5f / 8}};
+    ExpectKnownAnchors<tvm_blazeface::FrontModel>(896, front);
+    ExpectKnownAnchors<tvm_blazeface::ShortRangeModel>(896, front);
+
+    // 192x192 input: a 48x48 map with 1 anchor per cell
+    ExpectKnownAnchors<tvm_blazeface::FullRangeModel>(
+        2304, {{0, 0.5f / 48, 0.5f / 48},
+               {1, 1.5f / 48, 0.5f / 48},
+               {48, 0.5f / 48, 1.5f / 48},
+               {2303, 47.5f / 48, 47.5f / 48}});
+}
+
+TEST(BlazeFaceTest, TestDecodeBoxesMatchesReference) {
+    auto box_options = tvm_blazeface::FrontModel::box_options;
+    tvm_blazeface::AnchorTable anchors;
+    tvm_blazeface::GenerateAnchors(tvm_blazeface::FrontModel::anchor_options,
+                                   anchors);
+    ASSERT_EQ(anchors.size(), (size_t)box_options.num_boxes);
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coords(-40.0f, 40.0f);
+    std::uniform_real_distribution<float> logits(-8.0f, 8.0f);
+
+    std::vector<float> raw_boxes(box_options.num_boxes *
+                                 box_options.num_coords);
+    std::vector<float> raw_scores(box_options.num_boxes);
+
+    for (double threshold : {0.1, 0.5, 0.9}) {
+        box_options.min_score_thresh = threshold;
+        for (int iteration = 0; iteration < 10; ++iteration) {
+            for (auto& value : raw_boxes) value = coords(rng);
+            for (auto& value : raw_scores) value = logits(rng);
+
+            tvm_blazeface::DetectionsVec detections, expected;
+            tvm_blazeface::DecodeBoxes(raw_boxes.data(), raw_scores.data(),
+                                       box_options, anchors, detections);
+            tvm_blazeface::DecodeBoxesReference(raw_boxes.data(),
+                                                raw_scores.data(), box_options,
+                                                anchors, expected);
+
+            ASSERT_EQ(detections.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                const auto& box = detections[i].bounding_box;
+                const auto& expected_box = expected[i].bounding_box;
+                EXPECT_NEAR(detections[i].score, expected[i].score, 1e-6);
+                EXPECT_NEAR(box.x, expected_box.x, 1e-6);
+                EXPECT_NEAR(box.y, expected_box.y, 1e-6);
+                EXPECT_NEAR(box.width, expected_box.width, 1e-6);
+                EXPECT_NEAR(box.height, expected_box.height, 1e-6);
+                for (size_t k = 0; k < expected[i].key_points.size(); ++k) {
+                    EXPECT_NEAR(detections[i].key_points[k].x,
+                                expected[i].key_points[k].x, 1e-6);
+                    EXPECT_NEAR(detections[i].key_points[k].y,
+                                expected[i].key_points[k].y, 1e-6);
+                }
+            }
+        }
+    }
+}
+
+TEST(BlazeFaceTest, TestWeightedNmsMatchesReference) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> position(0.0, 0.5);
+    std::uniform_real_distribution<double> size(0.01, 0.2);
+    std::uniform_real_distribution<double> score(0.3, 1.0);
+
+    // Small inputs take the linear scan, the large one the grid
+    for (int nb_boxes : {1, 20, 100, 600}) {
+        tvm_blazeface::DetectionsVec detections;
+        std::vector<cv::Rect2d> boxes;
+        std::vector<double> scores;
+        for (int i = 0; i < nb_boxes; ++i) {
+            tvm_blazeface::Detection detection;
+            detection.score = score(rng);
+            detection.bounding_box = cv::Rect2d(position(rng), position(rng),
+                                                size(rng), size(rng));
+            detections.push_back(detection);
+            boxes.push_back(detection.bounding_box);
+            scores.push_back(detection.score);
+        }
+
+        tvm_blazeface::DetectionsVec expected;
+        tvm_blazeface::WeightedNmsReference(detections, 0.5, 0.3, expected);
+
+        mukham::NmsOptions options;
+        options.iou_threshold = 0.3;
+        options.min_score = 0.5;
+        mukham::NmsEngine engine(options);
+        std::vector<mukham::WeightedBox> output;
+        engine.WeightedNms(boxes, scores, output);
+
+        ASSERT_EQ(output.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(detections[output[i].index].score, expected[i].score);
+            EXPECT_EQ(output[i].box.x, expected[i].bounding_box.x);
+            EXPECT_EQ(output[i].box.y, expected[i].bounding_box.y);
+            EXPECT_EQ(output[i].box.width, expected[i].bounding_box.width);
+            EXPECT_EQ(output[i].box.height, expected[i].bounding_box.height);
+        }
+    }
+}
+
+TEST(BlazeFaceTest, TestNmsKeepsBestOfOverlappingBoxes) {
+    std::vector<cv::Rect2d> boxes = {cv::Rect2d(0, 0, 10, 10),
+                                     cv::Rect2d(1, 1, 10, 10),
+                                     cv::Rect2d(20, 20, 10, 10),
+                                     cv::Rect2d(40, 40, 10, 10)};
+    std::vector<double> scores = {0.9, 0.8, 0.7, 0.4};
+
+    mukham::NmsEngine engine;
+    std::vector<int> kept;
+    engine.Nms(boxes, scores, kept);
+
+    ASSERT_EQ(kept.size(), 2u);
+    EXPECT_EQ(kept[0], 0);
+    EXPECT_EQ(kept[1], 2);
+}
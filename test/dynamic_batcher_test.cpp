@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "dynamic_batcher.h"
+
+TEST(DynamicBatcherTest, TestResultsOfConcurrentRequests) {
+    mukham::DynamicBatcherOptions options;
+    options.max_batch_size = 4;
+    options.max_delay_ms = 5.0;
+
+    std::vector<size_t> batch_sizes;
+    mukham::DynamicBatcher<int, int> batcher(
+        [&](std::vector<int>& requests, std::vector<int>& results) {
+            batch_sizes.push_back(requests.size());
+            for (auto request : requests) results.push_back(request * 2);
+        },
+        options);
+
+    const int nb_threads = 4;
+    const int nb_requests = 100;
+    std::vector<std::thread> threads;
+    std::vector<int> failures(nb_threads, 0);
+    for (int thread_idx = 0; thread_idx < nb_threads; ++thread_idx) {
+        threads.emplace_back([&, thread_idx] {
+            for (int idx = 0; idx < nb_requests; ++idx) {
+                const int request = thread_idx * nb_requests + idx;
+                if (batcher.Submit(request).get() != request * 2)
+                    failures[thread_idx]++;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    batcher.Stop();
+
+    for (auto failure : failures) EXPECT_EQ(failure, 0);
+
+    auto stats = batcher.GetStats();
+    EXPECT_EQ(stats.requests, nb_threads * nb_requests);
+    EXPECT_EQ(stats.batches, batch_sizes.size());
+    EXPECT_EQ(stats.queue_delay.Count(), stats.requests);
+    for (auto batch_size : batch_sizes) EXPECT_LE(batch_size, 4);
+}
+
+TEST(DynamicBatcherTest, TestFullBatchDoesNotWaitForTheDeadline) {
+    mukham::DynamicBatcherOptions options;
+    options.max_batch_size = 2;
+    options.max_delay_ms = 10000.0;
+
+    mukham::DynamicBatcher<int, int> batcher(
+        [](std::vector<int>& requests, std::vector<int>& results) {
+            results = requests;
+        },
+        options);
+
+    auto first = batcher.Submit(1);
+    auto second = batcher.Submit(2);
+    ASSERT_EQ(first.wait_for(std::chrono::seconds(5)),
+              std::future_status::ready);
+    EXPECT_EQ(first.get(), 1);
+    EXPECT_EQ(second.get(), 2);
+
+    auto stats = batcher.GetStats();
+    EXPECT_EQ(stats.batches, 1);
+    EXPECT_EQ(stats.batch_sizes[2], 1);
+}
+
+TEST(DynamicBatcherTest, TestErrorReachesEveryRequest) {
+    mukham::DynamicBatcher<int, int> batcher(
+        [](std::vector<int>&, std::vector<int>&) {
+            throw std::runtime_error("inference failed");
+        });
+
+    auto result = batcher.Submit(1);
+    EXPECT_THROW(result.get(), std::runtime_error);
+
+    batcher.Stop();
+    EXPECT_THROW(batcher.Submit(2).get(), std::runtime_error);
+}
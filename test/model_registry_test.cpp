@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "face_models.h"
+#include "latency_stats.h"
+#include "model_registry.h"
+
+// dlib's HOG detector is built into the library, the only model that loads
+// without a file next to the test
+static const auto built_in_detector = mukham::FaceDetectorType::DlibHog;
+
+static mukham::ModelRegistryOptions FastOptions() {
+    mukham::ModelRegistryOptions options;
+    options.warmup_runs = 1;
+    options.warmup_frame_size = cv::Size(64, 48);
+    options.idle_unload_s = 0.0;
+    return options;
+}
+
+TEST(ModelRegistryTest, TestLoadsOnFirstUse) {
+    mukham::FaceModels models;
+    mukham::ModelRegistry registry(models, FastOptions());
+    EXPECT_EQ(registry.GetState(built_in_detector),
+              mukham::ModelState::Unloaded);
+    EXPECT_EQ(registry.GetState(mukham::LandmarkModelType::None),
+              mukham::ModelState::Ready);
+
+    EXPECT_FALSE(registry.Use(built_in_detector,
+                              mukham::LandmarkModelType::None));
+    registry.WaitUntilLoaded();
+
+    EXPECT_EQ(registry.GetState(built_in_detector), mukham::ModelState::Ready);
+    EXPECT_TRUE(models.IsDetectorLoaded(built_in_detector));
+    EXPECT_TRUE(
+        registry.Use(built_in_detector, mukham::LandmarkModelType::None));
+}
+
+TEST(ModelRegistryTest, TestMissingModelFails) {
+    mukham::FaceModels models;
+    mukham::ModelRegistry registry(models, FastOptions());
+
+    // No compiled Blazeface next to the test, its warm-up fails
+    registry.Use(mukham::FaceDetectorType::Blazeface,
+                 mukham::LandmarkModelType::None);
+    registry.WaitUntilLoaded();
+
+    EXPECT_EQ(registry.GetState(mukham::FaceDetectorType::Blazeface),
+              mukham::ModelState::Failed);
+    EXPECT_FALSE(models.IsDetectorLoaded(mukham::FaceDetectorType::Blazeface));
+    EXPECT_FALSE(registry.Use(mukham::FaceDetectorType::Blazeface,
+                              mukham::LandmarkModelType::None));
+}
+
+TEST(ModelRegistryTest, TestUnloadsIdleModels) {
+    auto options = FastOptions();
+    options.idle_unload_s = 0.05;
+    mukham::FaceModels models;
+    mukham::ModelRegistry registry(models, options);
+
+    registry.Use(built_in_detector, mukham::LandmarkModelType::None);
+    registry.WaitUntilLoaded();
+    ASSERT_EQ(registry.GetState(built_in_detector), mukham::ModelState::Ready);
+
+    // The registry looks for idle models about once a second
+    const auto start = mukham::Clock::now();
+    while (models.IsDetectorLoaded(built_in_detector) &&
+           mukham::ElapsedMs(start, mukham::Clock::now()) < 5000.0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    EXPECT_FALSE(models.IsDetectorLoaded(built_in_detector));
+    EXPECT_EQ(registry.GetState(built_in_detector),
+              mukham::ModelState::Unloaded);
+
+    // Used again, it is loaded again
+    registry.Use(built_in_detector, mukham::LandmarkModelType::None);
+    registry.WaitUntilLoaded();
+    EXPECT_TRUE(models.IsDetectorLoaded(built_in_detector));
+}
+
+TEST(FaceModelsTest, TestTakeAndUnloadWhileDetecting) {
+    mukham::FaceModels models;
+    models.LoadDetector(built_in_detector);
+
+    // The detections keep running on their own reference while the model
+    // is replaced and unloaded under them
+    std::atomic<bool> stop{false};
+    std::atomic<int> nb_detections{0};
+    std::thread detect_thread([&] {
+        cv::Mat frame(48, 64, CV_8UC3, cv::Scalar::all(0));
+        mukham::FaceDetections detections;
+        while (!stop) {
+            if (models.DetectFaces(built_in_detector, frame, detections)) {
+                EXPECT_TRUE(detections.faces.empty());
+                nb_detections++;
+            }
+        }
+    });
+
+    for (int swap = 0; swap < 10; ++swap) {
+        mukham::FaceModels staging;
+        staging.LoadDetector(built_in_detector);
+        models.TakeDetector(built_in_detector, staging);
+        EXPECT_FALSE(staging.IsDetectorLoaded(built_in_detector));
+        EXPECT_TRUE(models.IsDetectorLoaded(built_in_detector));
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        models.UnloadDetector(built_in_detector);
+        EXPECT_FALSE(models.IsDetectorLoaded(built_in_detector));
+    }
+    models.LoadDetector(built_in_detector);
+    const auto start = mukham::Clock::now();
+    while (nb_detections == 0 &&
+           mukham::ElapsedMs(start, mukham::Clock::now()) < 5000.0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    stop = true;
+    detect_thread.join();
+
+    EXPECT_GT(nb_detections, 0);
+}
+
+TEST(FaceModelsTest, TestShareLandmarkModel) {
+    EXPECT_TRUE(mukham::FaceModels::CanShareLandmarkModel(
+        mukham::LandmarkModelType::Dlib));
+    EXPECT_FALSE(mukham::FaceModels::CanShareLandmarkModel(
+        mukham::LandmarkModelType::Facemesh));
+
+    // Nothing to share until the other instance has loaded the model
+    mukham::FaceModels models;
+    mukham::FaceModels worker;
+    EXPECT_FALSE(
+        worker.ShareLandmarkModel(mukham::LandmarkModelType::Dlib, models));
+    EXPECT_FALSE(worker.IsLandmarkModelLoaded(mukham::LandmarkModelType::Dlib));
+    EXPECT_FALSE(
+        worker.ShareLandmarkModel(mukham::LandmarkModelType::Facemesh, models));
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "operator_profiler.h"
+#include "spdlog/fmt/fmt.h"
+
+namespace fs = std::filesystem;
+
+// Two runs of three operators, 500 us per run on average
+static mukham::ModelProfile TestProfile() {
+    mukham::ModelProfile profile;
+    profile.module_path = fs::path("models") / "test_model.so";
+    profile.runs = 2;
+    profile.operators = {{"conv", {100.0, 300.0}},
+                         {"relu", {50.0, 50.0}},
+                         {"dense", {250.0, 250.0}}};
+    return profile;
+}
+
+static std::vector<std::string> SplitLines(const std::string& text) {
+    std::vector<std::string> lines;
+    std::istringstream stream(text);
+    for (std::string line; std::getline(stream, line);) lines.push_back(line);
+    return lines;
+}
+
+static size_t CountOccurrences(const std::string& text,
+                               const std::string& pattern) {
+    size_t count = 0;
+    for (auto pos = text.find(pattern); pos != std::string::npos;
+         pos = text.find(pattern, pos + pattern.size())) {
+        count++;
+    }
+    return count;
+}
+
+TEST(OperatorProfilerTest, TestProfileMeans) {
+    const auto profile = TestProfile();
+    EXPECT_DOUBLE_EQ(profile.operators[0].MeanUs(), 200.0);
+    EXPECT_DOUBLE_EQ(profile.MeanRunUs(), 500.0);
+    EXPECT_DOUBLE_EQ(mukham::OperatorProfile().MeanUs(), 0.0);
+}
+
+TEST(OperatorProfilerTest, TestFormatReport) {
+    const auto lines =
+        SplitLines(mukham::OperatorProfiler::FormatReport(TestProfile()));
+    ASSERT_EQ(lines.size(), 5u);
+    EXPECT_EQ(lines[0], "test_model.so: 3 operators, 2 runs, 500.0 us per run");
+
+    // Slowest first, with their share of a run and the running total
+    auto row = [](double mean, double p50, double max, double share,
+                  double cumulative, const std::string& name) {
+        return fmt::format("  {:10.1f} {:10.1f} {:10.1f} {:6.1f}% {:6.1f}%  {}",
+                           mean, p50, max, share, cumulative, name);
+    };
+    EXPECT_EQ(lines[2], row(250.0, 250.0, 250.0, 50.0, 50.0, "dense"));
+    EXPECT_EQ(lines[3], row(200.0, 100.0, 300.0, 40.0, 90.0, "conv"));
+    EXPECT_EQ(lines[4], row(50.0, 50.0, 50.0, 10.0, 100.0, "relu"));
+}
+
+TEST(OperatorProfilerTest, TestFormatReportSlowestOperators) {
+    const auto lines =
+        SplitLines(mukham::OperatorProfiler::FormatReport(TestProfile(), 2));
+    ASSERT_EQ(lines.size(), 4u);
+    EXPECT_NE(lines[2].find("dense"), std::string::npos);
+    EXPECT_NE(lines[3].find("conv"), std::string::npos);
+    // The share stays relative to the whole run
+    EXPECT_NE(lines[3].find("  40.0%   90.0%  conv"), std::string::npos);
+}
+
+TEST(OperatorProfilerTest, TestRepeatedOperatorNames) {
+    // Nodes sharing a fused kernel or a no-op share its name
+    mukham::ModelProfile profile;
+    profile.module_path = "test_model.so";
+    ASSERT_TRUE(profile.AddRun({{"conv", 100.0},
+                                {"__nop", 1.0},
+                                {"conv", 60.0},
+                                {"__nop", 3.0}}));
+    ASSERT_TRUE(profile.AddRun({{"conv", 120.0},
+                                {"__nop", 1.0},
+                                {"conv", 80.0},
+                                {"__nop", 3.0}}));
+    EXPECT_EQ(profile.runs, 2u);
+
+    // A profile per node, each with a duration per run
+    ASSERT_EQ(profile.operators.size(), 4u);
+    for (const auto& op : profile.operators) {
+        EXPECT_EQ(op.durations_us.size(), 2u);
+    }
+    EXPECT_DOUBLE_EQ(profile.operators[0].MeanUs(), 110.0);
+    EXPECT_DOUBLE_EQ(profile.operators[2].MeanUs(), 70.0);
+    EXPECT_DOUBLE_EQ(profile.MeanRunUs(), 184.0);
+
+    const auto lines =
+        SplitLines(mukham::OperatorProfiler::FormatReport(profile));
+    ASSERT_EQ(lines.size(), 6u);
+    EXPECT_EQ(lines[0], "test_model.so: 4 operators, 2 runs, 184.0 us per run");
+    EXPECT_NE(lines[2].find("  59.8%   59.8%  conv"), std::string::npos);
+    EXPECT_NE(lines[3].find("  38.0%   97.8%  conv"), std::string::npos);
+    EXPECT_NE(lines[4].find("   1.6%   99.5%  __nop"), std::string::npos);
+    EXPECT_NE(lines[5].find("   0.5%  100.0%  __nop"), std::string::npos);
+
+    // Later runs must run the same nodes
+    EXPECT_FALSE(profile.AddRun({{"conv", 100.0}, {"__nop", 1.0}}));
+    EXPECT_FALSE(profile.AddRun(
+        {{"conv", 100.0}, {"conv", 1.0}, {"conv", 60.0}, {"__nop", 3.0}}));
+    EXPECT_EQ(profile.runs, 2u);
+    EXPECT_EQ(profile.operators[0].durations_us.size(), 2u);
+}
+
+TEST(OperatorProfilerTest, TestWriteChromeTrace) {
+    auto second = TestProfile();
+    second.module_path = "quoted\"model.so";
+    second.runs = 1;
+    second.operators = {{"fused_add", {20.0}}};
+
+    const auto trace_path = fs::temp_directory_path() / "mukham_trace.json";
+    ASSERT_TRUE(mukham::OperatorProfiler::WriteChromeTrace(
+        {TestProfile(), second}, trace_path));
+    std::ifstream in(trace_path);
+    const std::string trace((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+    in.close();
+    fs::remove(trace_path);
+
+    EXPECT_EQ(trace.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0),
+              0u);
+    EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+
+    // A process per model, an event per operator and run
+    EXPECT_EQ(CountOccurrences(trace, "\"ph\":\"M\""), 2u);
+    EXPECT_EQ(CountOccurrences(trace, "\"ph\":\"X\""), 7u);
+    EXPECT_NE(trace.find("\"args\":{\"name\":\"test_model.so\"}"),
+              std::string::npos);
+    EXPECT_NE(trace.find("\"args\":{\"name\":\"quoted\\\"model.so\"}"),
+              std::string::npos);
+
+    // The operators and the runs follow each other
+    EXPECT_NE(trace.find("{\"name\":\"conv\",\"cat\":\"operator\",\"ph\":\"X\","
+                         "\"ts\":0.000,\"dur\":100.000,\"pid\":0,\"tid\":0,"
+                         "\"args\":{\"run\":0}}"),
+              std::string::npos);
+    EXPECT_NE(trace.find("{\"name\":\"dense\",\"cat\":\"operator\","
+                         "\"ph\":\"X\",\"ts\":150.000,\"dur\":250.000,"
+                         "\"pid\":0,\"tid\":0,\"args\":{\"run\":0}}"),
+              std::string::npos);
+    EXPECT_NE(trace.find("{\"name\":\"conv\",\"cat\":\"operator\",\"ph\":\"X\","
+                         "\"ts\":400.000,\"dur\":300.000,\"pid\":0,"
+                         "\"tid\":0,\"args\":{\"run\":1}}"),
+              std::string::npos);
+    EXPECT_NE(
+        trace.find("{\"name\":\"fused_add\",\"cat\":\"operator\",\"ph\":\"X\","
+                   "\"ts\":0.000,\"dur\":20.000,\"pid\":1,\"tid\":0,"
+                   "\"args\":{\"run\":0}}"),
+        std::string::npos);
+}
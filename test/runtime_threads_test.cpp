@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "runtime_threads.h"
+
+TEST(RuntimeThreadsTest, TestParseCoreList) {
+    std::vector<int> cores;
+    EXPECT_TRUE(mukham::ParseCoreList("3", cores));
+    EXPECT_EQ(cores, std::vector<int>({3}));
+
+    EXPECT_TRUE(mukham::ParseCoreList("0-3", cores));
+    EXPECT_EQ(cores, std::vector<int>({0, 1, 2, 3}));
+
+    EXPECT_TRUE(mukham::ParseCoreList("0,2-3,5", cores));
+    EXPECT_EQ(cores, std::vector<int>({0, 2, 3, 5}));
+
+    EXPECT_TRUE(mukham::ParseCoreList("1-1", cores));
+    EXPECT_EQ(cores, std::vector<int>({1}));
+}
+
+TEST(RuntimeThreadsTest, TestParseInvalidCoreList) {
+    std::vector<int> cores;
+    for (const char* text :
+         {"", ",", "1,", ",1", "1,,2", "a", "1a", "1-", "-1", "3-1", "1-2x",
+          "1-2-3", "1;2"}) {
+        EXPECT_FALSE(mukham::ParseCoreList(text, cores)) << text;
+    }
+}
+
+TEST(RuntimeThreadsTest, TestFormatCoreList) {
+    EXPECT_EQ(mukham::FormatCoreList({}), "");
+    EXPECT_EQ(mukham::FormatCoreList({2}), "2");
+    EXPECT_EQ(mukham::FormatCoreList({0, 2, 3}), "0,2,3");
+
+    std::vector<int> cores;
+    ASSERT_TRUE(mukham::ParseCoreList(mukham::FormatCoreList({1, 4}), cores));
+    EXPECT_EQ(cores, std::vector<int>({1, 4}));
+}
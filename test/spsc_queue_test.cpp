@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "backpressure_queue.h"
+#include "spsc_queue.h"
+
+TEST(SpscQueueTest, TestBounded) {
+    mukham::SpscQueue<int> queue(2);
+    EXPECT_TRUE(queue.TryPush(1));
+    EXPECT_TRUE(queue.TryPush(2));
+    EXPECT_FALSE(queue.TryPush(3));
+    EXPECT_EQ(queue.Size(), 2);
+
+    int value = 0;
+    EXPECT_TRUE(queue.TryPop(value));
+    EXPECT_EQ(value, 1);
+    EXPECT_TRUE(queue.TryPush(3));
+    EXPECT_TRUE(queue.TryPop(value));
+    EXPECT_EQ(value, 2);
+    EXPECT_TRUE(queue.TryPop(value));
+    EXPECT_EQ(value, 3);
+    EXPECT_FALSE(queue.TryPop(value));
+}
+
+TEST(SpscQueueTest, TestOrderAcrossThreads) {
+    const int nb_items = 10000;
+    mukham::SpscQueue<int> queue(4);
+
+    std::thread producer([&] {
+        for (int i = 0; i < nb_items; ++i) queue.Push(int(i));
+        queue.Close();
+    });
+
+    int expected = 0;
+    int value = 0;
+    while (queue.Pop(value)) {
+        EXPECT_EQ(value, expected);
+        expected++;
+    }
+    producer.join();
+
+    EXPECT_EQ(expected, nb_items);
+    auto stats = queue.GetStats();
+    EXPECT_EQ(stats.pushed, nb_items);
+    EXPECT_EQ(stats.popped, nb_items);
+}
+
+TEST(SpscQueueTest, TestCloseUnblocksProducer) {
+    mukham::SpscQueue<int> queue(1);
+    EXPECT_TRUE(queue.Push(1));
+
+    std::thread closer([&] { queue.Close(); });
+    EXPECT_FALSE(queue.Push(2));
+    closer.join();
+
+    EXPECT_EQ(queue.GetStats().push_stalls, 1);
+}
+
+TEST(BackpressureQueueTest, TestDropOldest) {
+    mukham::BackpressureQueue<int> queue(2,
+                                         mukham::BackpressurePolicy::DropOldest);
+    for (int i = 0; i < 5; ++i) EXPECT_TRUE(queue.Push(int(i)));
+
+    int value = 0;
+    EXPECT_TRUE(queue.TryPop(value));
+    EXPECT_EQ(value, 3);
+    EXPECT_TRUE(queue.TryPop(value));
+    EXPECT_EQ(value, 4);
+    EXPECT_EQ(queue.Dropped(), 3);
+}
+
+TEST(BackpressureQueueTest, TestLatestOnly) {
+    mukham::BackpressureQueue<int> queue(4,
+                                         mukham::BackpressurePolicy::LatestOnly);
+    for (int i = 0; i < 5; ++i) EXPECT_TRUE(queue.Push(int(i)));
+
+    EXPECT_EQ(queue.Size(), 1);
+    int value = 0;
+    EXPECT_TRUE(queue.TryPop(value));
+    EXPECT_EQ(value, 4);
+    EXPECT_EQ(queue.Dropped(), 4);
+}
+
+TEST(BackpressureQueueTest, TestBlockKeepsEverything) {
+    const int nb_items = 1000;
+    mukham::BackpressureQueue<int> queue(2, mukham::BackpressurePolicy::Block);
+
+    std::thread producer([&] {
+        for (int i = 0; i < nb_items; ++i) queue.Push(int(i));
+        queue.Close();
+    });
+
+    int expected = 0;
+    int value = 0;
+    while (queue.Pop(value)) {
+        EXPECT_EQ(value, expected);
+        expected++;
+    }
+    producer.join();
+
+    EXPECT_EQ(expected, nb_items);
+    EXPECT_EQ(queue.Dropped(), 0);
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "face_tracker.h"
+#include "motion_gate.h"
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include "roi_tracker.h"
+
+namespace {
+
+// Landmarks spanning the given box, one point per corner
+std::vector<cv::Point2d> CornerLandmarks(const cv::Rect2d& box) {
+    return {box.tl(), cv::Point2d(box.x + box.width, box.y),
+            cv::Point2d(box.x, box.y + box.height), box.br()};
+}
+}  // namespace
+
+TEST(RoiTrackerTest, TestKeyframeInterval) {
+    mukham::RoiTrackerOptions options;
+    options.keyframe_interval = 4;
+    mukham::RoiTracker tracker(options);
+    const cv::Size frame_size(640, 480);
+    const cv::Rect2d face(100, 100, 80, 80);
+
+    std::vector<bool> keyframes;
+    for (int frame = 0; frame < 9; ++frame) {
+        const bool is_keyframe = tracker.NeedsDetection();
+        keyframes.push_back(is_keyframe);
+        tracker.Update({CornerLandmarks(face)}, is_keyframe, frame_size);
+    }
+    EXPECT_EQ(keyframes, std::vector<bool>({true, false, false, false, true,
+                                            false, false, false, true}));
+
+    std::vector<cv::Rect2d> faces;
+    tracker.PredictFaces(faces);
+    ASSERT_EQ(faces.size(), 1u);
+    EXPECT_EQ(faces[0], face);
+}
+
+TEST(RoiTrackerTest, TestLostFaceTriggersDetection) {
+    mukham::RoiTracker tracker;
+    const cv::Size frame_size(640, 480);
+    const cv::Rect2d face(100, 100, 80, 80);
+
+    tracker.Update({CornerLandmarks(face)}, true, frame_size);
+    EXPECT_FALSE(tracker.NeedsDetection());
+
+    // The second face is no longer found by the landmark model
+    tracker.Update({CornerLandmarks(face), {}}, false, frame_size);
+    EXPECT_TRUE(tracker.NeedsDetection());
+
+    // Without re-detection the remaining face keeps being tracked
+    auto options = tracker.GetOptions();
+    options.redetect_on_lost_face = false;
+    tracker.SetOptions(options);
+    EXPECT_FALSE(tracker.NeedsDetection());
+
+    tracker.Reset();
+    EXPECT_TRUE(tracker.NeedsDetection());
+}
+
+TEST(FaceTrackerTest, TestIdsFollowMovingFaces) {
+    mukham::FaceTracker tracker;
+    std::vector<int> ids;
+    std::vector<int> first_ids;
+
+    // Two faces moving in opposite directions, listed in a different order
+    // on every other frame
+    for (int frame = 0; frame < 30; ++frame) {
+        const cv::Rect2d left(100 + 4 * frame, 200, 60, 60);
+        const cv::Rect2d right(500 - 4 * frame, 220, 60, 60);
+        const bool swap = frame % 2 == 1;
+        tracker.Update(swap ? std::vector<cv::Rect2d>{right, left}
+                            : std::vector<cv::Rect2d>{left, right},
+                       ids);
+        ASSERT_EQ(ids.size(), 2u);
+        if (swap) std::swap(ids[0], ids[1]);
+
+        if (frame == 0) first_ids = ids;
+        EXPECT_EQ(ids, first_ids);
+    }
+    EXPECT_NE(first_ids[0], first_ids[1]);
+    EXPECT_EQ(tracker.GetTracks().size(), 2u);
+}
+
+TEST(FaceTrackerTest, TestTrackSurvivesMissedFrames) {
+    mukham::FaceTrackerOptions options;
+    options.max_missed_frames = 2;
+    mukham::FaceTracker tracker(options);
+    std::vector<int> ids;
+    const cv::Rect2d face(100, 100, 50, 50);
+
+    tracker.Update({face}, ids);
+    const int id = ids[0];
+
+    // Coasts through two missed frames
+    tracker.Update({}, ids);
+    tracker.Update({}, ids);
+    tracker.Update({face}, ids);
+    EXPECT_EQ(ids[0], id);
+
+    // And is dropped after the third one
+    for (int frame = 0; frame < 3; ++frame) tracker.Update({}, ids);
+    EXPECT_TRUE(tracker.GetTracks().empty());
+    tracker.Update({face}, ids);
+    EXPECT_NE(ids[0], id);
+}
+
+TEST(MotionGateTest, TestStaticAndMovingFrames) {
+    mukham::MotionGateOptions options;
+    options.max_skipped_frames = 3;
+    mukham::MotionGate gate(options);
+
+    cv::Mat frame(480, 640, CV_8UC3, cv::Scalar(40, 40, 40));
+    cv::rectangle(frame, cv::Rect(100, 100, 120, 120),
+                  cv::Scalar(200, 200, 200), -1);
+
+    // The first frame has nothing to compare with
+    EXPECT_FALSE(gate.IsStatic(frame));
+    EXPECT_TRUE(gate.IsStatic(frame));
+    EXPECT_TRUE(gate.IsStatic(frame.clone()));
+
+    cv::Mat moved(480, 640, CV_8UC3, cv::Scalar(40, 40, 40));
+    cv::rectangle(moved, cv::Rect(300, 200, 120, 120),
+                  cv::Scalar(200, 200, 200), -1);
+    EXPECT_FALSE(gate.IsStatic(moved));
+
+    // Static frames are refreshed after max_skipped_frames
+    EXPECT_TRUE(gate.IsStatic(moved));
+    EXPECT_TRUE(gate.IsStatic(moved));
+    EXPECT_TRUE(gate.IsStatic(moved));
+    EXPECT_FALSE(gate.IsStatic(moved));
+
+    EXPECT_EQ(gate.GetStats().frames, 8u);
+    EXPECT_EQ(gate.GetStats().static_frames, 5u);
+}